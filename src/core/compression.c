@@ -0,0 +1,327 @@
+#include "../include/core/compression.h"
+
+#include "../include/drivers/threading.h"
+
+
+
+/* A run of consecutive frames decompressed by one processor. `Destination` is where
+    `FirstFrame` goes; the rest of the run follows it. */
+typedef
+struct {
+    CONST COMPRESSED_IMAGE  *Image;
+    UINT8                   *Destination;
+    UINTN                   FirstFrame;
+    UINTN                   FramesCount;
+    UINTN VOLATILE          FramesDone;
+    EFI_STATUS VOLATILE     Status;
+} DECOMPRESS_THREAD_CTX;
+
+
+
+/* LZ4 lengths of 15 continue into extra bytes, each adding up to 255 more. */
+STATIC
+BOOLEAN
+Lz4ReadLength(IN OUT CONST UINT8 **Cursor,
+              IN CONST UINT8 *End,
+              IN OUT UINTN *Length)
+{
+    UINT8 Next = 0;
+
+    if (15 != *Length) return TRUE;
+
+    do {
+        if (*Cursor >= End) return FALSE;
+
+        Next = **Cursor;
+        ++(*Cursor);
+
+        *Length += Next;
+    } while (255 == Next);
+
+    return TRUE;
+}
+
+
+EFI_STATUS
+EFIAPI
+Lz4DecompressBlock(IN CONST VOID *Source,
+                   IN UINTN SourceLength,
+                   OUT VOID *Destination,
+                   IN UINTN DestinationLength,
+                   OUT UINTN *Written)
+{
+    if (NULL == Source || NULL == Destination || NULL == Written) return EFI_INVALID_PARAMETER;
+
+    CONST UINT8 *In = (CONST UINT8 *)Source;
+    CONST UINT8 *InEnd = In + SourceLength;
+    UINT8 *Out = (UINT8 *)Destination;
+    UINT8 *OutEnd = Out + DestinationLength;
+
+    *Written = 0;
+
+    while (In < InEnd) {
+        UINT8 Token = *In++;
+        UINTN Literals = (Token >> 4);
+        UINTN MatchLength = (Token & 0x0F);
+        UINTN Offset = 0;
+
+        if (FALSE == Lz4ReadLength(&In, InEnd, &Literals)) return EFI_VOLUME_CORRUPTED;
+
+        if (Literals > (UINTN)(InEnd - In) || Literals > (UINTN)(OutEnd - Out)) return EFI_VOLUME_CORRUPTED;
+
+        CopyMem(Out, In, Literals);
+        In += Literals;
+        Out += Literals;
+
+        /* The last sequence of a block is only literals. */
+        if (In >= InEnd) break;
+
+        if (2 > (UINTN)(InEnd - In)) return EFI_VOLUME_CORRUPTED;
+
+        Offset = (UINTN)In[0] | ((UINTN)In[1] << 8);
+        In += 2;
+
+        if (0 == Offset || Offset > (UINTN)(Out - (UINT8 *)Destination)) return EFI_VOLUME_CORRUPTED;
+
+        if (FALSE == Lz4ReadLength(&In, InEnd, &MatchLength)) return EFI_VOLUME_CORRUPTED;
+        MatchLength += 4;   /* the minimum match */
+
+        if (MatchLength > (UINTN)(OutEnd - Out)) return EFI_VOLUME_CORRUPTED;
+
+        /* A match may overlap the output it's repeating, in which case it has to be
+            copied forwards one byte at a time. */
+        CONST UINT8 *Match = Out - Offset;
+        if (Offset >= MatchLength) {
+            CopyMem(Out, Match, MatchLength);
+            Out += MatchLength;
+        } else {
+            for (UINTN i = 0; i < MatchLength; ++i) *Out++ = *Match++;
+        }
+    }
+
+    *Written = (UINTN)(Out - (UINT8 *)Destination);
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+CompressedImageOpen(IN CONST VOID *Image,
+                    IN UINTN ImageSize,
+                    OUT COMPRESSED_IMAGE *Parsed)
+{
+    if (NULL == Image || NULL == Parsed) return EFI_INVALID_PARAMETER;
+
+    CONST COMPRESSED_IMAGE_HEADER *Header = (CONST COMPRESSED_IMAGE_HEADER *)Image;
+    CONST UINT64 *Offsets = NULL;
+    UINT64 ExpectedFrames = 0;
+    UINT64 IndexEnd = 0;
+
+    if (ImageSize < sizeof(COMPRESSED_IMAGE_HEADER)) return EFI_UNSUPPORTED;
+
+    if (
+        0 != CompareMem(Header->Signature, COMPRESSED_IMAGE_SIGNATURE, sizeof(Header->Signature))
+        || COMPRESSED_IMAGE_VERSION != Header->Version
+        || Header->FrameSize < COMPRESSED_IMAGE_MIN_FRAME_SIZE
+        || Header->FrameSize > COMPRESSED_IMAGE_MAX_FRAME_SIZE
+        || 0 != (Header->FrameSize & (Header->FrameSize - 1))
+    ) return EFI_UNSUPPORTED;
+
+    ExpectedFrames = (Header->UncompressedSize + (Header->FrameSize - 1)) / Header->FrameSize;
+    if (0 == Header->UncompressedSize || ExpectedFrames != Header->FramesCount) return EFI_VOLUME_CORRUPTED;
+
+    /* The index has to fit inside the image. Frame counts are bounded by the image
+        size here, so the multiplication below cannot overflow. */
+    if (Header->FramesCount >= (ImageSize / sizeof(UINT64))) return EFI_VOLUME_CORRUPTED;
+
+    IndexEnd = sizeof(COMPRESSED_IMAGE_HEADER) + ((Header->FramesCount + 1) * sizeof(UINT64));
+    if (IndexEnd > ImageSize) return EFI_VOLUME_CORRUPTED;
+
+    Offsets = (CONST UINT64 *)((EFI_PHYSICAL_ADDRESS)Image + sizeof(COMPRESSED_IMAGE_HEADER));
+
+    if (Offsets[0] < IndexEnd || Offsets[Header->FramesCount] > ImageSize) return EFI_VOLUME_CORRUPTED;
+
+    for (UINTN i = 0; i < Header->FramesCount; ++i) {
+        if (Offsets[i + 1] < Offsets[i]) return EFI_VOLUME_CORRUPTED;
+    }
+
+    Parsed->Base             = (CONST UINT8 *)Image;
+    Parsed->Size             = ImageSize;
+    Parsed->FrameSize        = Header->FrameSize;
+    Parsed->UncompressedSize = Header->UncompressedSize;
+    Parsed->FramesCount      = (UINTN)Header->FramesCount;
+    Parsed->FrameOffsets     = Offsets;
+
+    return EFI_SUCCESS;
+}
+
+
+UINTN
+EFIAPI
+CompressedImageFrameLength(IN CONST COMPRESSED_IMAGE *Image,
+                           IN UINTN FrameIndex)
+{
+    if (NULL == Image || FrameIndex >= Image->FramesCount) return 0;
+
+    return (UINTN)MIN((UINT64)Image->FrameSize,
+                      (Image->UncompressedSize - ((UINT64)FrameIndex * Image->FrameSize)));
+}
+
+
+EFI_STATUS
+EFIAPI
+CompressedImageReadFrame(IN CONST COMPRESSED_IMAGE *Image,
+                         IN UINTN FrameIndex,
+                         OUT VOID *Destination)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN Length = CompressedImageFrameLength(Image, FrameIndex);
+    UINTN Written = 0;
+
+    if (0 == Length || NULL == Destination) return EFI_INVALID_PARAMETER;
+
+    CONST UINT8 *Frame = Image->Base + Image->FrameOffsets[FrameIndex];
+    UINTN StoredLength = (UINTN)(Image->FrameOffsets[FrameIndex + 1] - Image->FrameOffsets[FrameIndex]);
+
+    /* Frames which wouldn't compress are stored as-is. */
+    if (StoredLength == Length) {
+        CopyMem(Destination, Frame, Length);
+        return EFI_SUCCESS;
+    }
+
+    ERRCHECK(Lz4DecompressBlock(Frame, StoredLength, Destination, Length, &Written));
+
+    return (Written == Length) ? EFI_SUCCESS : EFI_VOLUME_CORRUPTED;
+}
+
+
+/* Runs on an AP (or the BSP). Stops at the first frame which fails. */
+STATIC
+VOID
+EFIAPI
+DecompressFramesWorker(IN VOID *Context)
+{
+    DECOMPRESS_THREAD_CTX *Work = (DECOMPRESS_THREAD_CTX *)Context;
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    for (UINTN i = Work->FirstFrame; i < (Work->FirstFrame + Work->FramesCount); ++i) {
+        Status = CompressedImageReadFrame(Work->Image,
+                                          i,
+                                          (Work->Destination
+                                            + ((UINT64)(i - Work->FirstFrame) * Work->Image->FrameSize)));
+        if (EFI_ERROR(Status)) break;
+
+        ++Work->FramesDone;
+    }
+
+    Work->Status = Status;
+}
+
+
+EFI_STATUS
+EFIAPI
+CompressedImageDecompressFrames(IN CONST COMPRESSED_IMAGE *Image,
+                                IN UINTN FirstFrame,
+                                IN UINTN FramesCount,
+                                OUT VOID *Destination,
+                                IN PROGRESS_UPDATE_HOOK ProgressHook OPTIONAL)
+{
+    if (
+        NULL == Image
+        || NULL == Destination
+        || 0 == FramesCount
+        || FirstFrame >= Image->FramesCount
+        || FramesCount > (Image->FramesCount - FirstFrame)
+    ) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    DECOMPRESS_THREAD_CTX *Work = NULL;
+    MFTAH_THREAD *Threads[COMPRESSED_IMAGE_MAX_WORKERS] = {0};
+    UINTN Workers = 1, PerWorker = 0, Done = 0;
+    BOOLEAN StillWorking = FALSE;
+
+    /* The BSP always takes a run of its own, alongside up to one per AP. */
+    if (TRUE == IsThreadingEnabled()) {
+        Workers = MIN((GetThreadLimit() + 1), COMPRESSED_IMAGE_MAX_WORKERS);
+        Workers = MIN(Workers, FramesCount);
+    }
+
+    Work = (DECOMPRESS_THREAD_CTX *)AllocateZeroPool(sizeof(DECOMPRESS_THREAD_CTX) * Workers);
+    if (NULL == Work) return EFI_OUT_OF_RESOURCES;
+
+    PerWorker = (FramesCount + (Workers - 1)) / Workers;
+
+    for (UINTN i = 0, Frame = 0; i < Workers; ++i, Frame += PerWorker) {
+        Work[i].Image       = Image;
+        Work[i].Destination = (UINT8 *)Destination + ((UINT64)MIN(Frame, FramesCount) * Image->FrameSize);
+        Work[i].FirstFrame  = FirstFrame + MIN(Frame, FramesCount);
+        Work[i].FramesCount = MIN(PerWorker, (FramesCount - MIN(Frame, FramesCount)));
+    }
+
+    /* Runs which can't be handed to an AP are left for the BSP below. */
+    for (UINTN i = 1; i < Workers; ++i) {
+        Threads[i] = (MFTAH_THREAD *)AllocateZeroPool(sizeof(MFTAH_THREAD));
+        if (NULL == Threads[i]) continue;
+
+        if (
+            EFI_ERROR(CreateThread(DecompressFramesWorker, (VOID *)&Work[i], Threads[i]))
+            || EFI_ERROR(StartThread(Threads[i], TRUE))
+        ) {
+            if (NULL != Threads[i]->CompletionEvent) BS->CloseEvent(Threads[i]->CompletionEvent);
+            FreePool(Threads[i]);
+            Threads[i] = NULL;
+        }
+    }
+
+    for (UINTN i = 0; i < Workers; ++i) {
+        if (NULL == Threads[i]) DecompressFramesWorker((VOID *)&Work[i]);
+
+        if (NULL != ProgressHook) {
+            Done = 0;
+            for (UINTN j = 0; j < Workers; ++j) Done += Work[j].FramesDone;
+
+            ProgressHook(&Done, &FramesCount, NULL);
+        }
+    }
+
+    /* Keep the progress moving until every AP is through with its run. */
+    do {
+        StillWorking = FALSE;
+        Done = 0;
+
+        for (UINTN i = 0; i < Workers; ++i) {
+            Done += Work[i].FramesDone;
+
+            if (NULL != Threads[i] && FALSE == Threads[i]->Finished) StillWorking = TRUE;
+        }
+
+        if (NULL != ProgressHook) ProgressHook(&Done, &FramesCount, NULL);
+
+        if (TRUE == StillWorking) BS->Stall(10 * 1000);   /* 10ms */
+    } while (TRUE == StillWorking);
+
+    for (UINTN i = 0; i < Workers; ++i) {
+        if (NULL != Threads[i]) {
+            JoinThread(Threads[i]);
+            BS->CloseEvent(Threads[i]->CompletionEvent);
+            DestroyThread(Threads[i]);
+        }
+
+        if (EFI_ERROR(Work[i].Status) && !EFI_ERROR(Status)) Status = Work[i].Status;
+    }
+
+    FreePool(Work);
+    return Status;
+}
+
+
+EFI_STATUS
+EFIAPI
+CompressedImageDecompress(IN CONST COMPRESSED_IMAGE *Image,
+                          OUT VOID *Destination,
+                          IN PROGRESS_UPDATE_HOOK ProgressHook OPTIONAL)
+{
+    if (NULL == Image) return EFI_INVALID_PARAMETER;
+
+    return CompressedImageDecompressFrames(Image, 0, Image->FramesCount, Destination, ProgressHook);
+}
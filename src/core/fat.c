@@ -0,0 +1,498 @@
+#include "../include/core/fat.h"
+
+
+
+/* Partition tables in a ramdisk are always laid out with its own block size. */
+#define FAT_PARTITION_SECTOR_SIZE   512
+
+#define FAT_MBR_PARTITIONS_OFFSET   446
+#define FAT_MBR_PROTECTIVE_TYPE     0xEE
+#define FAT_BOOT_SIGNATURE_OFFSET   510
+
+#define FAT16_END_OF_CHAIN          0xFFF8
+#define FAT32_END_OF_CHAIN          0x0FFFFFF8
+#define FAT32_CLUSTER_MASK          0x0FFFFFFF
+
+
+/* The layout of a single validated FAT16 or FAT32 volume. Offsets are from `Base`. */
+typedef
+struct {
+    CONST UINT8     *Base;
+    UINT64          Size;
+    UINT32          BytesPerCluster;
+    UINT64          FatOffset;
+    UINT64          FatLength;
+    UINT64          RootOffset;
+    UINT32          RootEntries;
+    UINT32          RootCluster;
+    UINT64          DataOffset;
+    UINT32          ClustersCount;
+    BOOLEAN         IsFat32;
+} FAT_VOLUME;
+
+
+
+STATIC
+BOOLEAN
+FatHasBootSignature(IN CONST UINT8 *Sector)
+{
+    return (0x55 == Sector[FAT_BOOT_SIGNATURE_OFFSET] && 0xAA == Sector[FAT_BOOT_SIGNATURE_OFFSET + 1]);
+}
+
+
+STATIC
+EFI_STATUS
+FatOpenVolume(IN CONST UINT8 *Base,
+              IN UINT64 Size,
+              OUT FAT_VOLUME *Volume)
+{
+    CONST FAT_BOOT_SECTOR *Bpb = (CONST FAT_BOOT_SECTOR *)Base;
+    UINT64 TotalSectors = 0, FatSectors = 0, RootSectors = 0, DataSector = 0;
+    UINT64 Clusters = 0;
+
+    if (Size < FAT_PARTITION_SECTOR_SIZE || FALSE == FatHasBootSignature(Base)) return EFI_UNSUPPORTED;
+
+    if (
+        (512 != Bpb->BytesPerSector && 1024 != Bpb->BytesPerSector
+            && 2048 != Bpb->BytesPerSector && 4096 != Bpb->BytesPerSector)
+        || 0 == Bpb->SectorsPerCluster
+        || 0 != (Bpb->SectorsPerCluster & (Bpb->SectorsPerCluster - 1))
+        || 0 == Bpb->ReservedSectors
+        || 0 == Bpb->NumberOfFats
+    ) return EFI_UNSUPPORTED;
+
+    TotalSectors = (0 != Bpb->TotalSectors16) ? Bpb->TotalSectors16 : Bpb->TotalSectors32;
+    FatSectors   = (0 != Bpb->SectorsPerFat16) ? Bpb->SectorsPerFat16 : Bpb->SectorsPerFat32;
+    RootSectors  = (((UINT64)Bpb->RootEntries * sizeof(FAT_DIRECTORY_ENTRY)) + (Bpb->BytesPerSector - 1))
+                    / Bpb->BytesPerSector;
+    DataSector   = Bpb->ReservedSectors + (Bpb->NumberOfFats * FatSectors) + RootSectors;
+
+    if (0 == FatSectors || DataSector >= TotalSectors) return EFI_UNSUPPORTED;
+
+    /* Whatever the boot sector claims, nothing past the end of the image can be read. */
+    if ((TotalSectors * Bpb->BytesPerSector) > Size) return EFI_VOLUME_CORRUPTED;
+
+    /* The FAT type is decided only by the amount of clusters. */
+    Clusters = (TotalSectors - DataSector) / Bpb->SectorsPerCluster;
+    if (Clusters <= FAT12_MAX_CLUSTERS) return EFI_UNSUPPORTED;
+
+    Volume->Base            = Base;
+    Volume->Size            = TotalSectors * Bpb->BytesPerSector;
+    Volume->BytesPerCluster = (UINT32)Bpb->SectorsPerCluster * Bpb->BytesPerSector;
+    Volume->FatOffset       = (UINT64)Bpb->ReservedSectors * Bpb->BytesPerSector;
+    Volume->FatLength       = FatSectors * Bpb->BytesPerSector;
+    Volume->RootOffset      = Volume->FatOffset + (Bpb->NumberOfFats * Volume->FatLength);
+    Volume->RootEntries     = Bpb->RootEntries;
+    Volume->DataOffset      = DataSector * Bpb->BytesPerSector;
+    Volume->ClustersCount   = (UINT32)Clusters;
+    Volume->IsFat32         = (Clusters > FAT16_MAX_CLUSTERS);
+    Volume->RootCluster     = (TRUE == Volume->IsFat32) ? Bpb->RootCluster : 0;
+
+    if (TRUE == Volume->IsFat32 && 0 != Bpb->RootEntries) return EFI_UNSUPPORTED;
+    if (FALSE == Volume->IsFat32 && 0 == Bpb->RootEntries) return EFI_UNSUPPORTED;
+
+    /* Every cluster (plus the two reserved entries) needs a FAT entry. */
+    if (Volume->FatLength < ((Clusters + 2) * (TRUE == Volume->IsFat32 ? 4 : 2))) return EFI_VOLUME_CORRUPTED;
+
+    return EFI_SUCCESS;
+}
+
+
+STATIC
+BOOLEAN
+FatIsDataCluster(IN CONST FAT_VOLUME *Volume,
+                 IN UINT32 Cluster)
+{
+    return (Cluster >= 2 && Cluster < (Volume->ClustersCount + 2));
+}
+
+
+STATIC
+BOOLEAN
+FatIsEndOfChain(IN CONST FAT_VOLUME *Volume,
+                IN UINT32 Value)
+{
+    return (TRUE == Volume->IsFat32) ? (Value >= FAT32_END_OF_CHAIN) : (Value >= FAT16_END_OF_CHAIN);
+}
+
+
+STATIC
+UINT32
+FatNextCluster(IN CONST FAT_VOLUME *Volume,
+               IN UINT32 Cluster)
+{
+    CONST UINT8 *Fat = Volume->Base + Volume->FatOffset;
+
+    if (TRUE == Volume->IsFat32) return (((CONST UINT32 *)Fat)[Cluster] & FAT32_CLUSTER_MASK);
+
+    return ((CONST UINT16 *)Fat)[Cluster];
+}
+
+
+STATIC
+UINT64
+FatClusterOffset(IN CONST FAT_VOLUME *Volume,
+                 IN UINT32 Cluster)
+{
+    return Volume->DataOffset + ((UINT64)(Cluster - 2) * Volume->BytesPerCluster);
+}
+
+
+STATIC
+UINT32
+FatEntryCluster(IN CONST FAT_VOLUME *Volume,
+                IN CONST FAT_DIRECTORY_ENTRY *Entry)
+{
+    UINT32 High = (TRUE == Volume->IsFat32) ? ((UINT32)Entry->FirstClusterHigh << 16) : 0;
+
+    return (High | Entry->FirstClusterLow);
+}
+
+
+STATIC
+CHAR8
+FatToUpper(IN CHAR8 c)
+{
+    return ('a' <= c && 'z' >= c) ? (c - ('a' - 'A')) : c;
+}
+
+
+STATIC
+UINT8
+FatShortNameChecksum(IN CONST UINT8 *ShortName)
+{
+    UINT8 Sum = 0;
+
+    for (UINTN i = 0; i < 11; ++i) Sum = (UINT8)(((Sum & 1) << 7) + (Sum >> 1) + ShortName[i]);
+
+    return Sum;
+}
+
+
+STATIC
+BOOLEAN
+FatShortNameMatches(IN CONST UINT8 *ShortName,
+                    IN CONST CHAR8 *Name,
+                    IN UINTN NameLength)
+{
+    CHAR8 Expected[11];
+    UINTN Dot = NameLength;
+
+    SetMem(Expected, sizeof(Expected), ' ');
+
+    /* The '.' and '..' entries are the only short names with a dot in them. */
+    if ((1 == NameLength || 2 == NameLength) && '.' == Name[0] && '.' == Name[NameLength - 1]) {
+        CopyMem(Expected, Name, NameLength);
+    } else {
+        for (UINTN i = 0; i < NameLength; ++i) if ('.' == Name[i]) Dot = i;
+
+        if (0 == Dot || Dot > 8 || (NameLength - MIN(Dot + 1, NameLength)) > 3) return FALSE;
+
+        for (UINTN i = 0; i < Dot; ++i) {
+            if ('.' == Name[i]) return FALSE;
+            Expected[i] = FatToUpper(Name[i]);
+        }
+
+        for (UINTN i = Dot + 1; i < NameLength; ++i) Expected[8 + (i - (Dot + 1))] = FatToUpper(Name[i]);
+    }
+
+    for (UINTN i = 0; i < 11; ++i) {
+        /* A leading 0x05 stands in for a real 0xE5, which marks deleted entries. */
+        CHAR8 c = (0 == i && 0x05 == ShortName[i]) ? (CHAR8)0xE5 : (CHAR8)ShortName[i];
+
+        if (FatToUpper(c) != Expected[i]) return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+STATIC
+BOOLEAN
+FatLongNameMatches(IN CONST CHAR16 *LongName,
+                   IN CONST CHAR8 *Name,
+                   IN UINTN NameLength)
+{
+    for (UINTN i = 0; i < NameLength; ++i) {
+        if (LongName[i] >= 0x80 || FatToUpper((CHAR8)LongName[i]) != FatToUpper(Name[i])) return FALSE;
+    }
+
+    /* The name ends with a NUL unless it exactly fills its last entry. */
+    return (0x0000 == LongName[NameLength] || 0xFFFF == LongName[NameLength]);
+}
+
+
+/* Long name entries are collected as they're seen. A sequence is dropped whenever its
+    parts arrive out of order, so a stale name can never be attached to the wrong file. */
+STATIC
+VOID
+FatCollectLongName(IN CONST FAT_LONG_NAME_ENTRY *Entry,
+                   IN OUT CHAR16 *LongName,
+                   IN OUT UINT8 *Expected,
+                   IN OUT UINT8 *Checksum)
+{
+    UINT8 Order = (Entry->Order & 0x1F);
+    UINTN At = 0;
+
+    if (0x40 == (Entry->Order & 0x40)) {
+        SetMem(LongName, sizeof(CHAR16) * ((FAT_MAX_LONG_NAME_ENTRIES * FAT_LONG_NAME_ENTRY_CHARS) + 1), 0x00);
+        *Expected = Order;
+        *Checksum = Entry->Checksum;
+    }
+
+    if (0 == Order || Order > FAT_MAX_LONG_NAME_ENTRIES || Order != *Expected || Entry->Checksum != *Checksum) {
+        *Expected = 0;
+        return;
+    }
+
+    At = (Order - 1) * FAT_LONG_NAME_ENTRY_CHARS;
+
+    for (UINTN i = 0; i < 5; ++i) LongName[At++] = Entry->Name1[i];
+    for (UINTN i = 0; i < 6; ++i) LongName[At++] = Entry->Name2[i];
+    for (UINTN i = 0; i < 2; ++i) LongName[At++] = Entry->Name3[i];
+
+    /* The next part expected is the one before this (the short entry follows part 1). */
+    --(*Expected);
+    if (0 == *Expected) *Expected = 0xFF;
+}
+
+
+/* Directory cluster 0 is the root directory, which is also what '..' entries point to
+    from a directory just below the root. */
+STATIC
+EFI_STATUS
+FatFindEntry(IN CONST FAT_VOLUME *Volume,
+             IN UINT32 DirectoryCluster,
+             IN CONST CHAR8 *Name,
+             IN UINTN NameLength,
+             OUT FAT_DIRECTORY_ENTRY *Found)
+{
+    CHAR16 LongName[(FAT_MAX_LONG_NAME_ENTRIES * FAT_LONG_NAME_ENTRY_CHARS) + 1] = {0};
+    UINT8 Expected = 0, Checksum = 0;
+    UINT32 Cluster = DirectoryCluster;
+    UINT64 SpanOffset = 0, SpanLength = 0;
+
+    if (0 == Cluster && FALSE == Volume->IsFat32) {
+        SpanOffset = Volume->RootOffset;
+        SpanLength = (UINT64)Volume->RootEntries * sizeof(FAT_DIRECTORY_ENTRY);
+    } else if (0 == Cluster) {
+        Cluster = Volume->RootCluster;
+    }
+
+    /* A chain can't be any longer than the volume has clusters, even if it loops. */
+    for (UINT32 Steps = 0; Steps <= Volume->ClustersCount; ++Steps) {
+        if (0 != Cluster) {
+            if (FALSE == FatIsDataCluster(Volume, Cluster)) return EFI_VOLUME_CORRUPTED;
+
+            SpanOffset = FatClusterOffset(Volume, Cluster);
+            SpanLength = Volume->BytesPerCluster;
+        }
+
+        if ((SpanOffset + SpanLength) > Volume->Size) return EFI_VOLUME_CORRUPTED;
+
+        CONST FAT_DIRECTORY_ENTRY *Entries = (CONST FAT_DIRECTORY_ENTRY *)(Volume->Base + SpanOffset);
+
+        for (UINTN i = 0; i < (SpanLength / sizeof(FAT_DIRECTORY_ENTRY)); ++i) {
+            CONST FAT_DIRECTORY_ENTRY *e = &(Entries[i]);
+
+            if (0x00 == e->Name[0]) return EFI_NOT_FOUND;   /* end of the directory */
+
+            if (0xE5 == e->Name[0]) {
+                Expected = 0;
+                continue;
+            }
+
+            if (FAT_ATTRIBUTE_LONG_NAME == (e->Attributes & FAT_ATTRIBUTE_LONG_NAME_MASK)) {
+                FatCollectLongName((CONST FAT_LONG_NAME_ENTRY *)e, LongName, &Expected, &Checksum);
+                continue;
+            }
+
+            BOOLEAN HasLongName = (0xFF == Expected && Checksum == FatShortNameChecksum(e->Name));
+            Expected = 0;
+
+            if (FAT_ATTRIBUTE_VOLUME_ID == (e->Attributes & FAT_ATTRIBUTE_VOLUME_ID)) continue;
+
+            if (
+                (TRUE == HasLongName && TRUE == FatLongNameMatches(LongName, Name, NameLength))
+                || TRUE == FatShortNameMatches(e->Name, Name, NameLength)
+            ) {
+                CopyMem(Found, e, sizeof(FAT_DIRECTORY_ENTRY));
+                return EFI_SUCCESS;
+            }
+        }
+
+        /* The FAT16 root directory is a single fixed region. */
+        if (0 == Cluster) return EFI_NOT_FOUND;
+
+        Cluster = FatNextCluster(Volume, Cluster);
+        if (TRUE == FatIsEndOfChain(Volume, Cluster)) return EFI_NOT_FOUND;
+    }
+
+    return EFI_VOLUME_CORRUPTED;
+}
+
+
+STATIC
+EFI_STATUS
+FatLocateInVolume(IN CONST FAT_VOLUME *Volume,
+                  IN CONST CHAR8 *Path,
+                  OUT EFI_PHYSICAL_ADDRESS *FileBase,
+                  OUT UINT64 *FileSize)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    FAT_DIRECTORY_ENTRY Entry = {0};
+    BOOLEAN IsDirectory = TRUE;
+    UINT32 Cluster = 0, Next = 0;
+    UINT64 Clusters = 0;
+    CONST CHAR8 *p = Path;
+
+    while ('\0' != *p) {
+        while ('/' == *p || '\\' == *p) ++p;
+        if ('\0' == *p) break;
+
+        CONST CHAR8 *Name = p;
+        while ('\0' != *p && '/' != *p && '\\' != *p) ++p;
+
+        /* A file can't have anything below it. */
+        if (FALSE == IsDirectory || (UINTN)(p - Name) > FAT_MAX_LONG_NAME) return EFI_NOT_FOUND;
+
+        ERRCHECK(FatFindEntry(Volume, Cluster, Name, (UINTN)(p - Name), &Entry));
+
+        IsDirectory = (FAT_ATTRIBUTE_DIRECTORY == (Entry.Attributes & FAT_ATTRIBUTE_DIRECTORY));
+        Cluster = FatEntryCluster(Volume, &Entry);
+    }
+
+    if (TRUE == IsDirectory) return EFI_NOT_FOUND;
+
+    if (0 == Entry.FileSize) return EFI_UNSUPPORTED;
+    if (FALSE == FatIsDataCluster(Volume, Cluster)) return EFI_VOLUME_CORRUPTED;
+
+    /* The file can only be handed out in place if its chain never skips a cluster. */
+    Clusters = (Entry.FileSize + (Volume->BytesPerCluster - 1)) / Volume->BytesPerCluster;
+
+    for (UINT64 i = 1, c = Cluster; i < Clusters; ++i, ++c) {
+        Next = FatNextCluster(Volume, (UINT32)c);
+
+        if (Next != (c + 1)) {
+            return (TRUE == FatIsDataCluster(Volume, Next)) ? EFI_UNSUPPORTED : EFI_VOLUME_CORRUPTED;
+        }
+
+        if (FALSE == FatIsDataCluster(Volume, Next)) return EFI_VOLUME_CORRUPTED;
+    }
+
+    if ((FatClusterOffset(Volume, Cluster) + Entry.FileSize) > Volume->Size) return EFI_VOLUME_CORRUPTED;
+
+    *FileBase = (EFI_PHYSICAL_ADDRESS)(Volume->Base + FatClusterOffset(Volume, Cluster));
+    *FileSize = Entry.FileSize;
+
+    return EFI_SUCCESS;
+}
+
+
+/* Opens one candidate volume and searches it. The best answer seen across every
+    candidate so far is kept in `Result`. Returns TRUE when the search is over. */
+STATIC
+BOOLEAN
+FatTryVolume(IN CONST UINT8 *Base,
+             IN UINT64 Size,
+             IN CONST CHAR8 *Path,
+             OUT EFI_PHYSICAL_ADDRESS *FileBase,
+             OUT UINT64 *FileSize,
+             IN OUT EFI_STATUS *Result)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    FAT_VOLUME Volume = {0};
+
+    Status = FatOpenVolume(Base, Size, &Volume);
+    if (EFI_UNSUPPORTED == Status) return FALSE;
+
+    if (!EFI_ERROR(Status)) Status = FatLocateInVolume(&Volume, Path, FileBase, FileSize);
+
+    /* A file which was found (contiguous or not) ends the search. */
+    if (!EFI_ERROR(Status) || EFI_UNSUPPORTED == Status) {
+        *Result = Status;
+        return TRUE;
+    }
+
+    if (EFI_VOLUME_CORRUPTED == Status || EFI_UNSUPPORTED == *Result) *Result = Status;
+    return FALSE;
+}
+
+
+EFI_STATUS
+EFIAPI
+FatLocateContiguousFile(IN CONST VOID *Disk,
+                        IN UINT64 DiskSize,
+                        IN CONST CHAR8 *Path,
+                        OUT EFI_PHYSICAL_ADDRESS *FileBase,
+                        OUT UINT64 *FileSize)
+{
+    if (NULL == Disk || NULL == Path || NULL == FileBase || NULL == FileSize) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Result = EFI_UNSUPPORTED;
+    CONST UINT8 *Base = (CONST UINT8 *)Disk;
+    CONST FAT_MBR_PARTITION *Mbr = NULL;
+    BOOLEAN IsGpt = FALSE;
+
+    if (DiskSize < FAT_PARTITION_SECTOR_SIZE) return EFI_UNSUPPORTED;
+
+    /* A bare volume starts right at the beginning of the image. */
+    if (TRUE == FatTryVolume(Base, DiskSize, Path, FileBase, FileSize, &Result)) return Result;
+
+    if (FALSE == FatHasBootSignature(Base)) return Result;
+
+    Mbr = (CONST FAT_MBR_PARTITION *)(Base + FAT_MBR_PARTITIONS_OFFSET);
+
+    for (UINTN i = 0; i < 4; ++i) {
+        if (FAT_MBR_PROTECTIVE_TYPE == Mbr[i].OsType) IsGpt = TRUE;
+    }
+
+    if (FALSE == IsGpt) {
+        for (UINTN i = 0; i < 4; ++i) {
+            UINT64 Start = (UINT64)Mbr[i].StartingLba * FAT_PARTITION_SECTOR_SIZE;
+            UINT64 Length = (UINT64)Mbr[i].SizeInLba * FAT_PARTITION_SECTOR_SIZE;
+
+            if (0 == Mbr[i].OsType || 0 == Length || Start >= DiskSize) continue;
+
+            if (TRUE == FatTryVolume(Base + Start, MIN(Length, DiskSize - Start), Path, FileBase, FileSize, &Result)) {
+                return Result;
+            }
+        }
+
+        return Result;
+    }
+
+    if (DiskSize < (2 * FAT_PARTITION_SECTOR_SIZE)) return Result;
+
+    CONST FAT_GPT_HEADER *Gpt = (CONST FAT_GPT_HEADER *)(Base + FAT_PARTITION_SECTOR_SIZE);
+    if (
+        0 != CompareMem(Gpt->Signature, "EFI PART", sizeof(Gpt->Signature))
+        || Gpt->SizeOfPartitionEntry < 48
+        || Gpt->PartitionEntryLba >= (DiskSize / FAT_PARTITION_SECTOR_SIZE)
+    ) return Result;
+
+    UINT64 EntriesOffset = Gpt->PartitionEntryLba * FAT_PARTITION_SECTOR_SIZE;
+
+    for (UINT32 i = 0; i < Gpt->NumberOfPartitionEntries; ++i) {
+        UINT64 At = EntriesOffset + ((UINT64)i * Gpt->SizeOfPartitionEntry);
+        if ((At + 48) > DiskSize) break;
+
+        /* Each entry starts with its type GUID, its own GUID, and then its first and last LBAs. */
+        CONST EFI_GUID *Type = (CONST EFI_GUID *)(Base + At);
+        CONST UINT64 *Lbas = (CONST UINT64 *)(Base + At + (2 * sizeof(EFI_GUID)));
+        EFI_GUID Unused = {0};
+
+        if (0 == CompareMem(Type, &Unused, sizeof(EFI_GUID)) || Lbas[1] < Lbas[0]) continue;
+
+        UINT64 Start = Lbas[0] * FAT_PARTITION_SECTOR_SIZE;
+        UINT64 Length = ((Lbas[1] - Lbas[0]) + 1) * FAT_PARTITION_SECTOR_SIZE;
+
+        if (Start >= DiskSize) continue;
+
+        if (TRUE == FatTryVolume(Base + Start, MIN(Length, DiskSize - Start), Path, FileBase, FileSize, &Result)) {
+            return Result;
+        }
+    }
+
+    return Result;
+}
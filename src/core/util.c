@@ -22,52 +22,177 @@ FileSize(IN EFI_FILE_PROTOCOL *FileHandle)
 }
 
 
-EFI_STATUS
+/* Upper bounds on the amount of volume roots and file handles kept open at once. */
+#define UTIL_MAX_CACHED_VOLUMES     32
+#define UTIL_MAX_CACHED_FILES       64
+
+
+/* A simple filesystem volume which was opened once and is kept open until flushed. */
+typedef
+struct {
+    EFI_HANDLE          DeviceHandle;
+    EFI_FILE_PROTOCOL   *Root;
+    CHAR16              *Label;
+} CACHED_VOLUME;
+
+/* A file opened from a cached volume, along with its size (only queried once). */
+typedef
+struct {
+    EFI_HANDLE          DeviceHandle;
+    CHAR16              *Path;
+    EFI_FILE_PROTOCOL   *Handle;
+    UINTN               Size;
+} CACHED_FILE;
+
+
+STATIC CACHED_VOLUME mCachedVolumes[UTIL_MAX_CACHED_VOLUMES] = {0};
+STATIC UINTN mCachedVolumesLength = 0;
+
+STATIC CACHED_FILE mCachedFiles[UTIL_MAX_CACHED_FILES] = {0};
+STATIC UINTN mCachedFilesLength = 0;
+
+
+
+STATIC
+VOID
+FileCacheFlushFiles(VOID)
+{
+    for (UINTN i = 0; i < mCachedFilesLength; ++i) {
+        if (NULL != mCachedFiles[i].Handle) {
+            mCachedFiles[i].Handle->Close(mCachedFiles[i].Handle);
+        }
+
+        if (NULL != mCachedFiles[i].Path) FreePool(mCachedFiles[i].Path);
+    }
+
+    SetMem(mCachedFiles, sizeof(mCachedFiles), 0x00);
+    mCachedFilesLength = 0;
+}
+
+
+VOID
 EFIAPI
-FileSizeFromPath(IN CHAR16 *Path,
-                 IN EFI_HANDLE BaseImageHandle,
-                 IN BOOLEAN HandleIsLoadedImage,
-                 OUT UINTN *SizeOutput)
+FileCacheFlush(VOID)
 {
-    if (
-        NULL == BaseImageHandle
-        || NULL == Path
-        || NULL == SizeOutput
-    ) return EFI_INVALID_PARAMETER;
+    /* Files first, since they were opened relative to the volume roots. */
+    FileCacheFlushFiles();
 
-    EFI_STATUS Status = EFI_SUCCESS;
+    for (UINTN i = 0; i < mCachedVolumesLength; ++i) {
+        if (NULL != mCachedVolumes[i].Root) {
+            mCachedVolumes[i].Root->Close(mCachedVolumes[i].Root);
+        }
 
+        if (NULL != mCachedVolumes[i].Label) FreePool(mCachedVolumes[i].Label);
+    }
+
+    SetMem(mCachedVolumes, sizeof(mCachedVolumes), 0x00);
+    mCachedVolumesLength = 0;
+}
+
+
+STATIC
+EFI_STATUS
+ResolveDeviceHandle(IN EFI_HANDLE BaseImageHandle,
+                    IN BOOLEAN HandleIsLoadedImage,
+                    OUT EFI_HANDLE *DeviceHandle)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
     EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *ImageIoHandle = NULL;
 
-    EFI_FILE_PROTOCOL *VolumeHandle = NULL;
-    EFI_FILE_PROTOCOL *LoadedFileHandle = NULL;
-    UINTN ActualFileSize = 0;
+    if (FALSE == HandleIsLoadedImage) {
+        *DeviceHandle = BaseImageHandle;
+        return EFI_SUCCESS;
+    }
+
+    /* Open Loaded Image protocol handle. */
+    ERRCHECK(
+        BS->HandleProtocol(BaseImageHandle,
+                           &gEfiLoadedImageProtocolGuid,
+                           (VOID **)&LoadedImage)
+    );
+
+    *DeviceHandle = LoadedImage->DeviceHandle;
+    return EFI_SUCCESS;
+}
 
-    if (TRUE == HandleIsLoadedImage) {
-        /* Open Loaded Image protocol handle. */
-        Status = BS->HandleProtocol(BaseImageHandle,
-                                    &gEfiLoadedImageProtocolGuid,
-                                    (VOID **)&LoadedImage);
-        if (EFI_ERROR(Status)) return Status;
 
-        BaseImageHandle = LoadedImage->DeviceHandle;
+STATIC
+EFI_STATUS
+OpenCachedVolume(IN EFI_HANDLE DeviceHandle,
+                 OUT CACHED_VOLUME **Volume)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *fs = NULL;
+    EFI_FILE_PROTOCOL *root = NULL;
+    EFI_FILE_SYSTEM_VOLUME_LABEL_INFO *VolumeInfo = NULL;
+    CACHED_VOLUME *v = NULL;
+
+    for (UINTN i = 0; i < mCachedVolumesLength; ++i) {
+        if (DeviceHandle == mCachedVolumes[i].DeviceHandle) {
+            *Volume = &(mCachedVolumes[i]);
+            return EFI_SUCCESS;
+        }
     }
 
-    /* Use the device handle from the image to open the relative volume. */
-    Status = BS->HandleProtocol(BaseImageHandle,
-                                &gEfiSimpleFileSystemProtocolGuid,
-                                (VOID **)&ImageIoHandle);
-    if (EFI_ERROR(Status)) return Status;
+    /* Use the device handle to open the relative volume. */
+    ERRCHECK(
+        BS->HandleProtocol(DeviceHandle,
+                           &gEfiSimpleFileSystemProtocolGuid,
+                           (VOID **)&fs)
+    );
 
-    /* Open the volume directly. */
-    Status = ImageIoHandle->OpenVolume(ImageIoHandle, &VolumeHandle);
-    if (EFI_ERROR(Status)) return Status;
+    ERRCHECK(fs->OpenVolume(fs, &root));
+
+    /* Out of slots: start over rather than tracking usage. This is only hit
+        on systems with an unusual amount of attached volumes. */
+    if (mCachedVolumesLength >= UTIL_MAX_CACHED_VOLUMES) FileCacheFlush();
+
+    v = &(mCachedVolumes[mCachedVolumesLength]);
+    v->DeviceHandle = DeviceHandle;
+    v->Root = root;
+    v->Label = NULL;
+
+    /* Not every volume has a label; that's fine, it just can't be found by name. */
+    VolumeInfo = LibFileSystemVolumeLabelInfo(root);
+    if (NULL != VolumeInfo) {
+        v->Label = StrDuplicate(VolumeInfo->VolumeLabel);
+        FreePool(VolumeInfo);
+    }
+
+    ++mCachedVolumesLength;
+
+    *Volume = v;
+    return EFI_SUCCESS;
+}
+
+
+STATIC
+EFI_STATUS
+OpenCachedFile(IN EFI_HANDLE DeviceHandle,
+               IN CONST CHAR16 *Path,
+               OUT CACHED_FILE **File)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    CACHED_VOLUME *Volume = NULL;
+    EFI_FILE_PROTOCOL *LoadedFileHandle = NULL;
+    CACHED_FILE *f = NULL;
+
+    for (UINTN i = 0; i < mCachedFilesLength; ++i) {
+        if (
+            DeviceHandle == mCachedFiles[i].DeviceHandle
+            && 0 == StrCmp(mCachedFiles[i].Path, Path)
+        ) {
+            *File = &(mCachedFiles[i]);
+            return EFI_SUCCESS;
+        }
+    }
+
+    ERRCHECK(OpenCachedVolume(DeviceHandle, &Volume));
 
     /* Now try to load the file. */
-    Status = VolumeHandle->Open(VolumeHandle,
+    Status = Volume->Root->Open(Volume->Root,
                                 &LoadedFileHandle,
-                                Path,
+                                (CHAR16 *)Path,
                                 EFI_FILE_MODE_READ,
                                 (EFI_FILE_READ_ONLY
                                  | EFI_FILE_ARCHIVE
@@ -75,17 +200,49 @@ FileSizeFromPath(IN CHAR16 *Path,
                                  | EFI_FILE_SYSTEM));
     if (EFI_ERROR(Status)) return Status;
 
-    /* Update the known size of the file. */
-    ActualFileSize = FileSize(LoadedFileHandle);
-    if (0 == ActualFileSize) {
-        Status = EFI_END_OF_FILE;
+    if (mCachedFilesLength >= UTIL_MAX_CACHED_FILES) FileCacheFlushFiles();
+
+    f = &(mCachedFiles[mCachedFilesLength]);
+    f->Path = StrDuplicate(Path);
+    if (NULL == f->Path) {
+        LoadedFileHandle->Close(LoadedFileHandle);
+        return EFI_OUT_OF_RESOURCES;
     }
 
-    LoadedFileHandle->Close(LoadedFileHandle);
-    VolumeHandle->Close(VolumeHandle);
+    f->DeviceHandle = DeviceHandle;
+    f->Handle = LoadedFileHandle;
+    f->Size = FileSize(LoadedFileHandle);
 
-    *SizeOutput = ActualFileSize;
-    return Status;
+    ++mCachedFilesLength;
+
+    *File = f;
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+FileSizeFromPath(IN CHAR16 *Path,
+                 IN EFI_HANDLE BaseImageHandle,
+                 IN BOOLEAN HandleIsLoadedImage,
+                 OUT UINTN *SizeOutput)
+{
+    if (
+        NULL == BaseImageHandle
+        || NULL == Path
+        || NULL == SizeOutput
+    ) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_HANDLE DeviceHandle = NULL;
+    CACHED_FILE *File = NULL;
+
+    ERRCHECK(ResolveDeviceHandle(BaseImageHandle, HandleIsLoadedImage, &DeviceHandle));
+    ERRCHECK(OpenCachedFile(DeviceHandle, Path, &File));
+
+    /* Update the known size of the file. */
+    *SizeOutput = File->Size;
+    return (0 == File->Size) ? EFI_END_OF_FILE : EFI_SUCCESS;
 }
 
 
@@ -104,14 +261,13 @@ ReadFile(IN EFI_HANDLE BaseImageHandle,
 {
     EFI_STATUS Status = EFI_SUCCESS;
 
-    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *ImageIoHandle = NULL;
-
-    EFI_FILE_PROTOCOL *VolumeHandle = NULL;
+    EFI_HANDLE DeviceHandle = NULL;
+    CACHED_FILE *File = NULL;
     EFI_FILE_PROTOCOL *LoadedFileHandle = NULL;
 
     UINTN ChunkReadSize = MFTAH_RAMDISK_LOAD_BLOCK_SIZE;   /* 64 KiB */
     UINT8 *Buffer = NULL;
+    BOOLEAN OwnsBuffer = FALSE;
     UINTN ActualFileSize = 0;
 
     if (
@@ -121,51 +277,23 @@ ReadFile(IN EFI_HANDLE BaseImageHandle,
         || NULL == LoadedFileSize
     ) return EFI_INVALID_PARAMETER;
 
-    if (TRUE == HandleIsLoadedImage) {
-        /* Open Loaded Image protocol handle. */
-        Status = BS->HandleProtocol(BaseImageHandle,
-                                    &gEfiLoadedImageProtocolGuid,
-                                    (VOID **)&LoadedImage);
-        if (EFI_ERROR(Status)) {
-            EFI_DANGERLN("Error locating Loaded Image Protocol handle (%u).", Status);
-            return Status;
-        }
-
-        BaseImageHandle = LoadedImage->DeviceHandle;
-    }
-
-    /* Use the device handle from the image to open the relative volume. */
-    Status = BS->HandleProtocol(BaseImageHandle,
-                                &gEfiSimpleFileSystemProtocolGuid,
-                                (VOID **)&ImageIoHandle);
-    if (EFI_ERROR(Status)) {
-        EFI_DANGERLN("Error initializing SFS protocol handle (%u).", Status);
-        return Status;
-    }
-
-    /* Open the volume directly. */
-    Status = ImageIoHandle->OpenVolume(ImageIoHandle, &VolumeHandle);
+    Status = ResolveDeviceHandle(BaseImageHandle, HandleIsLoadedImage, &DeviceHandle);
     if (EFI_ERROR(Status)) {
-        EFI_DANGERLN("Error opening volume handle (%u).", Status);
+        EFI_DANGERLN("Error locating Loaded Image Protocol handle (%u).", Status);
         return Status;
     }
 
-    /* Now try to load the file. */
-    Status = VolumeHandle->Open(VolumeHandle,
-                                &LoadedFileHandle,
-                                Filename,
-                                EFI_FILE_MODE_READ,
-                                (EFI_FILE_READ_ONLY
-                                 | EFI_FILE_ARCHIVE
-                                 | EFI_FILE_HIDDEN
-                                 | EFI_FILE_SYSTEM));
+    /* Volume roots and file handles are kept open between calls. See `FileCacheFlush`. */
+    Status = OpenCachedFile(DeviceHandle, Filename, &File);
     if (EFI_ERROR(Status)) {
         EFI_DANGERLN("Error opening file handle '%s' (%u).", Filename, Status);
         return Status;
     }
 
-    /* Update the known size of the file. */
-    ActualFileSize = FileSize(LoadedFileHandle);
+    LoadedFileHandle = File->Handle;
+
+    /* Use the known size of the file. */
+    ActualFileSize = File->Size;
     if (0 == ActualFileSize) {
         Status = EFI_END_OF_FILE;
         goto ReadFile__clean_up_and_exit;
@@ -188,6 +316,8 @@ ReadFile(IN EFI_HANDLE BaseImageHandle,
             goto ReadFile__clean_up_and_exit;
         }
 
+        OwnsBuffer = TRUE;
+
         if (0 != RoundToBlockSize || 0 != ExtraEndAllocation) {
             /* Ensure the trailing padding (which won't have the file read into it) is explicitly set to zero. */
             SetMem((VOID *)((EFI_PHYSICAL_ADDRESS)Buffer + (*LoadedFileSize) - RoundToBlockSize - ExtraEndAllocation),
@@ -198,10 +328,11 @@ ReadFile(IN EFI_HANDLE BaseImageHandle,
         Buffer = *OutputBuffer;
     }
     
-    /* Set the starting position to the `Offset` value. */
+    /* Set the starting position to the `Offset` value. The handle may have been
+        used before, so this must always happen. */
     Status = LoadedFileHandle->SetPosition(LoadedFileHandle, Offset);
     if (EFI_ERROR(Status)) {
-        FreePool(Buffer);
+        if (TRUE == OwnsBuffer) FreePool(Buffer);
         goto ReadFile__clean_up_and_exit;
     }
 
@@ -214,7 +345,7 @@ ReadFile(IN EFI_HANDLE BaseImageHandle,
                                         &ChunkReadSize,
                                         (VOID *)((EFI_PHYSICAL_ADDRESS)Buffer + i));
         if (EFI_ERROR(Status)) {
-            FreePool(Buffer);
+            if (TRUE == OwnsBuffer) FreePool(Buffer);
             goto ReadFile__clean_up_and_exit;
         }
 
@@ -233,15 +364,62 @@ ReadFile(IN EFI_HANDLE BaseImageHandle,
     *OutputBuffer = Buffer;
     Status = EFI_SUCCESS;
 
-    /* Clean up after ourselves. We're not really concerned if these fail. */
+    /* The file and volume handles stay open in the cache until `FileCacheFlush`. */
 ReadFile__clean_up_and_exit:
-    LoadedFileHandle->Close(LoadedFileHandle);
-    VolumeHandle->Close(VolumeHandle);
-
     return Status;
 }
 
 
+EFI_STATUS
+EFIAPI
+ReadFileRange(IN EFI_HANDLE DeviceHandle,
+              IN CONST CHAR16 *Filename,
+              IN UINTN Offset,
+              IN UINTN Length,
+              OUT VOID *Buffer,
+              IN PROGRESS_UPDATE_HOOK ProgressHook OPTIONAL)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    CACHED_FILE *File = NULL;
+    UINTN ChunkReadSize = 0;
+
+    if (
+        NULL == DeviceHandle
+        || NULL == Filename
+        || NULL == Buffer
+    ) return EFI_INVALID_PARAMETER;
+
+    ERRCHECK(OpenCachedFile(DeviceHandle, Filename, &File));
+
+    if (Offset > File->Size || Length > (File->Size - Offset)) return EFI_END_OF_FILE;
+
+    ERRCHECK(File->Handle->SetPosition(File->Handle, Offset));
+
+    for (UINTN i = 0; i < Length; i += ChunkReadSize) {
+        ChunkReadSize = MIN(MFTAH_RAMDISK_LOAD_BLOCK_SIZE, (Length - i));
+
+        ERRCHECK(
+            File->Handle->Read(File->Handle,
+                               &ChunkReadSize,
+                               (VOID *)((EFI_PHYSICAL_ADDRESS)Buffer + i))
+        );
+
+        /* A short read of 0 bytes means the file ended early. */
+        if (0 == ChunkReadSize) return EFI_END_OF_FILE;
+
+        if (NULL != ProgressHook && 0 == (i % (1 << 20))) {
+            ProgressHook(&i, &Length, NULL);
+        }
+    }
+
+    if (NULL != ProgressHook) {
+        ProgressHook(&Length, &Length, NULL);
+    }
+
+    return EFI_SUCCESS;
+}
+
+
 EFI_STATUS
 GetFileSystemHandleByVolumeName(IN CHAR16 *VolumeName,
                                 OUT EFI_HANDLE *TargetHandle)
@@ -256,6 +434,18 @@ GetFileSystemHandleByVolumeName(IN CHAR16 *VolumeName,
     EFI_HANDLE *Handles = NULL;
     UINTN HandleCount = 0;
     BOOLEAN GotHandle = FALSE;
+    CACHED_VOLUME *Volume = NULL;
+
+    /* Volumes which were already opened don't need to be queried again. */
+    for (UINTN i = 0; i < mCachedVolumesLength; ++i) {
+        if (
+            NULL != mCachedVolumes[i].Label
+            && 0 == StriCmp(mCachedVolumes[i].Label, VolumeName)
+        ) {
+            *TargetHandle = mCachedVolumes[i].DeviceHandle;
+            return EFI_SUCCESS;
+        }
+    }
 
     ERRCHECK(
         BS->LocateHandleBuffer(ByProtocol,
@@ -265,29 +455,16 @@ GetFileSystemHandleByVolumeName(IN CHAR16 *VolumeName,
                                &Handles)
     );
 
-    /* Iterate the returned set of handles. */
+    /* Iterate the returned set of handles. Each opened volume is cached (labeled or
+        not), so handles seen by a previous search are not opened a second time. */
     for (UINTN i = 0; i < HandleCount; ++i) {
-        EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *fs = NULL;
-        EFI_FILE_PROTOCOL *root = NULL;
-
-        ERRCHECK(
-            BS->HandleProtocol(Handles[i],
-                               &gEfiSimpleFileSystemProtocolGuid,
-                               (VOID **)&fs)
-        );
-
-        ERRCHECK(fs->OpenVolume(fs, &root));
-
-        EFI_FILE_SYSTEM_VOLUME_LABEL_INFO *VolumeInfo = LibFileSystemVolumeLabelInfo(root);
-        if (NULL == VolumeInfo) continue;
+        if (EFI_ERROR(OpenCachedVolume(Handles[i], &Volume))) continue;
 
-        if (0 == StriCmp(VolumeInfo->VolumeLabel, VolumeName)) {
+        if (NULL != Volume->Label && 0 == StriCmp(Volume->Label, VolumeName)) {
             *TargetHandle = Handles[i];
             GotHandle = TRUE;
+            break;
         }
-
-        FreePool(VolumeInfo);
-        if (TRUE == GotHandle) break;
     }
 
     if (FALSE == GotHandle) Status = EFI_NOT_FOUND;
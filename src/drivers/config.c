@@ -99,10 +99,13 @@ DECL_HANDLER(now);
 DECL_HANDLER(type);
 DECL_HANDLER(subtype);
 DECL_HANDLER(cmdline);
+DECL_HANDLER(load_address);
+DECL_HANDLER(entry_offset);
 DECL_HANDLER(mftah);
 DECL_HANDLER(mftahkey);
 DECL_HANDLER(default);
 DECL_HANDLER(data_ramdisk);
+DECL_HANDLER(module);
 
 
 /* A mapping of all possible config elements to each of their handlers.
@@ -133,10 +136,13 @@ CONST CONFIG_HANDLER_TUPLE ConfigHandlers[] = {
     DECL_TUPLE(type),
     DECL_TUPLE(subtype),
     DECL_TUPLE(cmdline),
+    DECL_TUPLE(load_address),
+    DECL_TUPLE(entry_offset),
     DECL_TUPLE(mftah),
     DECL_TUPLE(mftahkey),
     DECL_TUPLE(default),
     DECL_TUPLE(data_ramdisk),
+    DECL_TUPLE(module),
     { NULL, NULL }   /* Terminal NULL entry marks end of list. */
 };
 
@@ -185,6 +191,65 @@ ParseColorHexCode(CHAR *Input,
 }
 
 
+/* Parses a '0x'-prefixed hexadecimal or a plain decimal address (or offset). */
+STATIC
+EFIAPI
+EFI_STATUS
+ParseAddress(CHAR *Input,
+             UINT64 *Out)
+{
+    if (
+        NULL == Input
+        || NULL == Out
+        || AsciiStrLen(Input) <= 0
+    ) {
+        ErrorMsg = L"Invalid `ParseAddress` parameter";
+        return EFI_INVALID_PARAMETER;
+    }
+
+    UINT64 FinalValue = 0;
+    UINT64 Base = 10;
+    UINT8 DigitValue = 0;
+    CHAR *p = Input;
+
+    if ('0' == p[0] && ('x' == p[1] || 'X' == p[1])) {
+        Base = 16;
+        p += 2;
+    }
+
+    if ('\0' == *p) {
+        ErrorMsg = L"Invalid address: no digits";
+        return EFI_INVALID_PARAMETER;
+    }
+
+    for (; *p; ++p) {
+        CHAR c = *p;
+
+        /* To lower-case */
+        if (c >= 'A' && c <= 'Z') c -= ' ';
+
+        if (c >= '0' && c <= '9') {
+            DigitValue = (c - '0');
+        } else if (16 == Base && c >= 'a' && c <= 'f') {
+            DigitValue = (10 + (c - 'a'));
+        } else {
+            ErrorMsg = L"Invalid address: bad character";
+            return EFI_INVALID_PARAMETER;
+        }
+
+        if (FinalValue > ((~0ULL - DigitValue) / Base)) {
+            ErrorMsg = L"Invalid address: too large";
+            return EFI_INVALID_PARAMETER;
+        }
+
+        FinalValue = (FinalValue * Base) + DigitValue;
+    }
+
+    *Out = FinalValue;
+    return EFI_SUCCESS;
+}
+
+
 STATIC
 EFIAPI
 EFI_STATUS
@@ -483,6 +548,14 @@ ConfigDestroyChain(CONFIG_CHAIN_BLOCK *c)
         c->DataRamdisks[i] = NULL;
     }
 
+    for (UINTN i = 0; i < c->ModulesLength; ++i) {
+        FreePool(c->Modules[i]->Path);
+        FreePool(c->Modules[i]->CmdLine);
+
+        FreePool(c->Modules[i]);
+        c->Modules[i] = NULL;
+    }
+
     FreePool(c);
 }
 
@@ -551,9 +624,24 @@ ConfigDumpChain(IN CONFIG_CHAIN_BLOCK *Chain,
         AsciiSPrint(
             (CHAR8 *)(((EFI_PHYSICAL_ADDRESS)(*ToBuffer)) + CurrentLength),
             (MaxBufferLength - CurrentLength),
-            "   {  data_rd(%a | (m%1u:c%1u:k%1u)  }\n",
+            "   {  data_rd(%a | (m%1u:c%1u:k%1u:p%1u:o%1u:s%1u:i%1u)  }\n",
                 Chain->DataRamdisks[i]->Path, Chain->DataRamdisks[i]->IsMFTAH,
-                Chain->DataRamdisks[i]->IsCompressed, (NULL != Chain->DataRamdisks[i]->MFTAHKey)
+                Chain->DataRamdisks[i]->IsCompressed, (NULL != Chain->DataRamdisks[i]->MFTAHKey),
+                Chain->DataRamdisks[i]->IsPersistent, Chain->DataRamdisks[i]->IsOverlay,
+                Chain->DataRamdisks[i]->IsSparse, Chain->DataRamdisks[i]->IsInitrd
+        );
+    }
+
+    for (UINTN i = 0; i < Chain->ModulesLength; ++i) {
+        CurrentLength = AsciiStrLen(*ToBuffer);
+
+        if (CurrentLength >= MaxBufferLength) break;
+
+        AsciiSPrint(
+            (CHAR8 *)(((EFI_PHYSICAL_ADDRESS)(*ToBuffer)) + CurrentLength),
+            (MaxBufferLength - CurrentLength),
+            "   {  module(%a | '%a')  }\n",
+                Chain->Modules[i]->Path, Chain->Modules[i]->CmdLine
         );
     }
 }
@@ -1089,6 +1177,9 @@ DECL_HANDLER(type)
     else if (AsciiStrLen(Data) >= 3 && 0 == CompareMem(Data, "bin", 3)) {
         Configuration.Chains[Configuration.ChainsLength]->Type = BIN;
     }
+    else if (AsciiStrLen(Data) >= 3 && 0 == CompareMem(Data, "uki", 3)) {
+        Configuration.Chains[Configuration.ChainsLength]->Type = UKI;
+    }
     else {
         ErrorMsg = L"Invalid Chain type";
         return EFI_INVALID_PARAMETER;
@@ -1121,6 +1212,9 @@ DECL_HANDLER(subtype)
     else if (AsciiStrLen(Data) >= 3 && 0 == CompareMem(Data, "bin", 3)) {
         Configuration.Chains[Configuration.ChainsLength]->SubType = BIN;
     }
+    else if (AsciiStrLen(Data) >= 3 && 0 == CompareMem(Data, "uki", 3)) {
+        Configuration.Chains[Configuration.ChainsLength]->SubType = UKI;
+    }
     else {
         ErrorMsg = L"Invalid Chain sub-type";
         return EFI_INVALID_PARAMETER;
@@ -1154,6 +1248,49 @@ DECL_HANDLER(cmdline)
 }
 
 
+DECL_HANDLER(load_address)
+{
+    if (!IsWithinChain) {
+        ErrorMsg = HackeneyedChainOnlyStr;
+        return EFI_INVALID_PARAMETER;
+    }
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINT64 Address = 0;
+
+    /* `ParseAddress` takes care of setting error messages. */
+    ERRCHECK(ParseAddress(Data, &Address));
+
+    /* The payload's pages are claimed at exactly this address. */
+    if (0 != (Address & EFI_PAGE_MASK)) {
+        ErrorMsg = L"The `load_address` must be page-aligned";
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Configuration.Chains[Configuration.ChainsLength]->LoadAddress = (EFI_PHYSICAL_ADDRESS)Address;
+    DPRINTLN("LOAD ADDRESS SET FOR CHAIN");
+
+    return EFI_SUCCESS;
+}
+
+
+DECL_HANDLER(entry_offset)
+{
+    if (!IsWithinChain) {
+        ErrorMsg = HackeneyedChainOnlyStr;
+        return EFI_INVALID_PARAMETER;
+    }
+
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    /* `ParseAddress` takes care of setting error messages. */
+    ERRCHECK(ParseAddress(Data, &(Configuration.Chains[Configuration.ChainsLength]->EntryOffset)));
+    DPRINTLN("ENTRY OFFSET SET FOR CHAIN");
+
+    return EFI_SUCCESS;
+}
+
+
 DECL_HANDLER(mftah)
 {
     if (!IsWithinChain) {
@@ -1234,11 +1371,19 @@ DECL_HANDLER(data_ramdisk)
     }
 
     /* Now parse the data_ramdisk string format. A leading '$' indicates compression.
-        A leading '@[string]' or just '@' indicates the payload is MFTAH-encapsulated. */
+        A leading '@[string]' or just '@' indicates the payload is MFTAH-encapsulated.
+        A leading '%' exposes the ramdisk to the OS as persistent memory.
+        A leading '&' registers a copy-on-write overlay over a shared read-only image.
+        A leading '~' drops all-zero blocks of the image from memory once it's loaded.
+        A leading '^' serves the (decrypted, decompressed) file to a Linux kernel as its initrd. */
     DATA_RAMDISK *r = (*Target);
     BOOLEAN CanStillSpecifyMftah = TRUE;
     BOOLEAN CanStillSpecifyCompression = TRUE;
     BOOLEAN CanStillSpecifyRequired = TRUE;
+    BOOLEAN CanStillSpecifyPersistent = TRUE;
+    BOOLEAN CanStillSpecifyOverlay = TRUE;
+    BOOLEAN CanStillSpecifySparse = TRUE;
+    BOOLEAN CanStillSpecifyInitrd = TRUE;
     CHAR8 *p = Data, *s = Data, *x = NULL;
 
     do {
@@ -1251,6 +1396,38 @@ DECL_HANDLER(data_ramdisk)
 
                 break;
             }
+            case '%': {
+                if (FALSE == CanStillSpecifyPersistent) goto DataRamdisk__default_case;
+
+                r->IsPersistent = TRUE;
+                CanStillSpecifyPersistent = FALSE;
+
+                break;
+            }
+            case '&': {
+                if (FALSE == CanStillSpecifyOverlay) goto DataRamdisk__default_case;
+
+                r->IsOverlay = TRUE;
+                CanStillSpecifyOverlay = FALSE;
+
+                break;
+            }
+            case '~': {
+                if (FALSE == CanStillSpecifySparse) goto DataRamdisk__default_case;
+
+                r->IsSparse = TRUE;
+                CanStillSpecifySparse = FALSE;
+
+                break;
+            }
+            case '^': {
+                if (FALSE == CanStillSpecifyInitrd) goto DataRamdisk__default_case;
+
+                r->IsInitrd = TRUE;
+                CanStillSpecifyInitrd = FALSE;
+
+                break;
+            }
             case '$': {
                 if (FALSE == CanStillSpecifyCompression) goto DataRamdisk__default_case;
 
@@ -1307,6 +1484,29 @@ DECL_HANDLER(data_ramdisk)
         ++p;
     } while (*p && s == Data);
 
+    /* Reject flags which can't be honoured together, rather than letting one vanish quietly.
+        Overlays stay firmware-only (the OS would only see the untouched base image), and
+        sparse disks leave holes, so neither has anything to expose as persistent memory.
+        An initrd is handed over as a plain file, never registered as a disk at all. */
+    CONST CHAR16 *Conflict = NULL;
+
+    if (TRUE == r->IsPersistent && TRUE == r->IsOverlay) {
+        Conflict = L"A data ramdisk overlay cannot be persistent";
+    } else if (TRUE == r->IsPersistent && TRUE == r->IsSparse) {
+        Conflict = L"A sparse data ramdisk cannot be persistent";
+    } else if (TRUE == r->IsInitrd && (r->IsOverlay || r->IsSparse || r->IsPersistent)) {
+        Conflict = L"An initrd data ramdisk cannot be an overlay, sparse, or persistent";
+    }
+
+    if (NULL != Conflict) {
+        if (NULL != r->MFTAHKey) FreePool(r->MFTAHKey);
+        FreePool(r);
+        *Target = NULL;
+
+        ErrorMsg = Conflict;
+        return EFI_INVALID_PARAMETER;
+    }
+
     /* Capture the intended path string. */
     r->Path = (CHAR8 *)AllocateZeroPool(sizeof(CHAR8) * (AsciiStrLen(s) + 1));
     if (NULL == r->Path) {
@@ -1321,3 +1521,62 @@ DECL_HANDLER(data_ramdisk)
     /* All done. */
     return EFI_SUCCESS;
 }
+
+
+DECL_HANDLER(module)
+{
+    if (!IsWithinChain) {
+        ErrorMsg = HackeneyedChainOnlyStr;
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (0 == AsciiStrLen(Data)) {
+        ErrorMsg = L"Empty module details";
+        return EFI_NOT_STARTED;
+    }
+
+    CONFIG_CHAIN_BLOCK *ThisChain = Configuration.Chains[Configuration.ChainsLength];
+    CHAIN_MODULE **Target = &(ThisChain->Modules[ThisChain->ModulesLength]);
+
+    if (ThisChain->ModulesLength >= MAX_MODULES_PER_CHAIN) {
+        ErrorMsg = L"Modules length limit exceeded";
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    (*Target) = (CHAIN_MODULE *)AllocateZeroPool(sizeof(CHAIN_MODULE));
+    if (NULL == (*Target)) {
+        ErrorMsg = L"Out of resources";
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    /* The path ends at the first blank. Anything after it is the module's own string,
+        which otherwise defaults to the path (as other Multiboot2 loaders do). */
+    CHAIN_MODULE *m = (*Target);
+    CHAR8 *p = Data, *s = NULL;
+
+    while (*p && ' ' != *p && '\t' != *p) ++p;
+
+    UINTN PathLength = (p - Data);
+
+    while (' ' == *p || '\t' == *p) ++p;
+    s = ('\0' == *p) ? Data : p;
+
+    m->Path = (CHAR8 *)AllocateZeroPool(sizeof(CHAR8) * (PathLength + 1));
+    m->CmdLine = (CHAR8 *)AllocateZeroPool(sizeof(CHAR8) * (AsciiStrLen(s) + 1));
+    if (NULL == m->Path || NULL == m->CmdLine) {
+        if (NULL != m->Path) FreePool(m->Path);
+        if (NULL != m->CmdLine) FreePool(m->CmdLine);
+        FreePool(m);
+        *Target = NULL;
+
+        ErrorMsg = L"Cannot allocate module strings: out of resources";
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    CopyMem(m->Path, Data, PathLength);
+    CopyMem(m->CmdLine, s, (s == Data) ? PathLength : AsciiStrLen(s));
+
+    (ThisChain->ModulesLength)++;
+
+    return EFI_SUCCESS;
+}
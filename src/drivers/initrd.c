@@ -0,0 +1,113 @@
+#include "../include/drivers/initrd.h"
+
+
+
+STATIC EFI_GUID gInitrdLoadFile2ProtocolGuid = INITRD_LOAD_FILE2_PROTOCOL_GUID;
+
+STATIC
+INITRD_DEVICE_PATH
+mInitrdDevicePath = {
+    {
+        {
+            MEDIA_DEVICE_PATH,
+            MEDIA_VENDOR_DP,
+            {
+                (UINT8)(sizeof(VENDOR_DEVICE_PATH)),
+                (UINT8)(sizeof(VENDOR_DEVICE_PATH) >> 8)
+            }
+        },
+        LINUX_EFI_INITRD_MEDIA_GUID
+    },
+    {
+        END_DEVICE_PATH_TYPE,
+        END_ENTIRE_DEVICE_PATH_SUBTYPE,
+        {
+            (UINT8)(sizeof(EFI_DEVICE_PATH_PROTOCOL)),
+            (UINT8)(sizeof(EFI_DEVICE_PATH_PROTOCOL) >> 8)
+        }
+    }
+};
+
+STATIC EFI_HANDLE mInitrdHandle = NULL;
+STATIC CONST VOID *mInitrd = NULL;
+STATIC UINTN mInitrdLength = 0;
+
+
+
+/* The stub asks for the size first (with no buffer), then reads the whole initrd at once. */
+STATIC
+EFI_STATUS
+EFIAPI
+InitrdLoadFile(IN INITRD_LOAD_FILE2_PROTOCOL *This,
+               IN EFI_DEVICE_PATH_PROTOCOL *FilePath,
+               IN BOOLEAN BootPolicy,
+               IN OUT UINTN *BufferSize,
+               IN VOID *Buffer OPTIONAL)
+{
+    if (NULL == This || NULL == FilePath || NULL == BufferSize) return EFI_INVALID_PARAMETER;
+
+    /* Load File 2 never loads boot options. */
+    if (TRUE == BootPolicy) return EFI_UNSUPPORTED;
+
+    /* Whatever remains of the path past the vendor node must be its end. */
+    if (END_DEVICE_PATH_TYPE != FilePath->Type) return EFI_NOT_FOUND;
+
+    if (NULL == Buffer || *BufferSize < mInitrdLength) {
+        *BufferSize = mInitrdLength;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    CopyMem(Buffer, mInitrd, mInitrdLength);
+    *BufferSize = mInitrdLength;
+
+    return EFI_SUCCESS;
+}
+
+
+STATIC
+INITRD_LOAD_FILE2_PROTOCOL
+mInitrdLoadFile2 = {
+    InitrdLoadFile
+};
+
+
+
+EFI_STATUS
+EFIAPI
+InitrdInstall(IN CONST VOID *Initrd,
+              IN UINTN Length)
+{
+    if (NULL == Initrd || 0 == Length) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_DEVICE_PATH_PROTOCOL *RemainingPath = (EFI_DEVICE_PATH_PROTOCOL *)&mInitrdDevicePath;
+    EFI_HANDLE Existing = NULL;
+
+    /* Someone (maybe even the firmware) already serves an initrd. */
+    if (
+        NULL != mInitrdHandle
+        || !EFI_ERROR(BS->LocateDevicePath(&gInitrdLoadFile2ProtocolGuid, &RemainingPath, &Existing))
+    ) return EFI_ALREADY_STARTED;
+
+    mInitrd = Initrd;
+    mInitrdLength = Length;
+
+    Status = BS->InstallMultipleProtocolInterfaces(
+        &mInitrdHandle,
+        &gEfiDevicePathProtocolGuid,
+        &mInitrdDevicePath,
+        &gInitrdLoadFile2ProtocolGuid,
+        &mInitrdLoadFile2,
+        NULL
+    );
+    if (EFI_ERROR(Status)) {
+        mInitrdHandle = NULL;
+        mInitrd = NULL;
+        mInitrdLength = 0;
+
+        return Status;
+    }
+
+    DPRINTLN("Serving a %u-byte initrd from %p through Load File 2.", Length, Initrd);
+    return EFI_SUCCESS;
+}
@@ -3,6 +3,8 @@
 #include "../include/drivers/acpi.h"
 #include "../include/drivers/nfit.h"
 
+#include "../include/core/util.h"
+
 
 
 /* Implement global exported GUID objects. */
@@ -11,6 +13,8 @@ EFI_GUID gEfiRamdiskVirtualDiskGuid = EFI_VIRTUAL_DISK_GUID;
 EFI_GUID gEfiRamdiskVirtualCdGuid = EFI_VIRTUAL_CD_GUID;
 EFI_GUID gEfiRamdiskPersistentVirtualDiskGuid = EFI_PERSISTENT_VIRTUAL_DISK_GUID;
 EFI_GUID gEfiRamdiskPersistentVirtualCdGuid = EFI_PERSISTENT_VIRTUAL_CD_GUID;
+EFI_GUID gRamdiskExtentsDevicePathGuid = RAMDISK_EXTENTS_DEVICE_PATH_GUID;
+EFI_GUID gRamdiskStatsProtocolGuid = RAMDISK_STATS_PROTOCOL_GUID;
 
 /* Instance counter for registered ramdisks. Just makes the ID non-zero. */
 STATIC UINTN RamdiskCurrentInstance = 0xBFA0;
@@ -20,6 +24,21 @@ STATIC UINTN RamdiskCurrentInstance = 0xBFA0;
 STATIC VOID     *RamdiskNfit        = NULL;
 STATIC UINT32   RamdiskNfitLength   = 0;
 STATIC UINTN    RamdiskAcpiTableKey = 0;
+STATIC BOOLEAN  RamdiskNfitInstalled = FALSE;
+
+/* While a registration batch is open, NFIT changes only accumulate in `RamdiskNfit`.
+    The table is installed to ACPI once, when the batch is committed. */
+STATIC BOOLEAN  RamdiskBatchOpen    = FALSE;
+
+/* SPA Range Structure indices must be unique and non-zero across the whole NFIT. */
+STATIC UINT16   RamdiskNextSpaIndex = 1;
+
+/* Likewise for each persistent ramdisk's NVDIMM, which takes its device handle, physical
+    ID, serial number, and Control Region Structure index from this. */
+STATIC UINT16   RamdiskNextNvdimmIndex = 1;
+
+/* Every successfully registered ramdisk, most recent first. */
+STATIC RAMDISK_PRIVATE_DATA *RamdiskList = NULL;
 
 /* External references for the NVDIMM Root Device AML bytecode. */
 EXTERN unsigned char NvdimmRootAml[];
@@ -32,6 +51,14 @@ EFI_RAM_DISK_PROTOCOL
 RAMDISK = {
     RamDiskRegister,
     RamDiskUnregister,
+    RamDiskRegisterExtents,
+    RamDiskBeginBatch,
+    RamDiskCommitBatch,
+    RamDiskRegisterOverlay,
+    RamDiskRegisterSparse,
+    RamDiskRegisterCompressed,
+    RamDiskMaterializeAll,
+    RamDiskAdoptAllocation,
 };
 
 
@@ -55,6 +82,23 @@ mRamDiskDeviceNodeTemplate = {
     }
 };
 
+STATIC
+RAMDISK_EXTENTS_DEVICE_PATH
+mRamDiskExtentsNodeTemplate = {
+    {
+        {
+            MEDIA_DEVICE_PATH,
+            MEDIA_VENDOR_DP,
+            {
+                (UINT8)(sizeof(RAMDISK_EXTENTS_DEVICE_PATH)),
+                (UINT8)(sizeof(RAMDISK_EXTENTS_DEVICE_PATH) >> 8)
+            }
+        },
+        RAMDISK_EXTENTS_DEVICE_PATH_GUID
+    },
+    0
+};
+
 STATIC
 EFI_BLOCK_IO_PROTOCOL
 mRamDiskBlockIoTemplate = {
@@ -78,6 +122,15 @@ mRamDiskBlockIo2Template = {
     RamDiskBlkIo2FlushBlocksEx
 };
 
+/* The I/O statistics protocol installed for each ramdisk. */
+STATIC
+RAMDISK_STATS_PROTOCOL
+mRamDiskStatsTemplate = {
+    RAMDISK_STATS_PROTOCOL_REVISION,
+    RamDiskStatsGet,
+    RamDiskStatsReset
+};
+
 
 
 /**
@@ -102,8 +155,139 @@ RamDiskPublishSsdt(VOID)
 }
 
 
+/**
+ * Whether the ramdisk is exposed as persistent memory, which the OS can map directly
+ *  (DAX) instead of copying each block through its page cache.
+ */
+STATIC
+BOOLEAN
+RamDiskIsPersistent(IN RAMDISK_PRIVATE_DATA *PrivateData)
+{
+    return (0 == CompareMem(&PrivateData->TypeGuid,
+                            &gEfiRamdiskPersistentVirtualDiskGuid,
+                            sizeof(EFI_GUID)));
+}
+
+
+/**
+ * Get the length of every NFIT structure needed to describe the given ramdisk.
+ *
+ * @param[in]  PrivateData  A pointer to some existing ramdisk data meta-structure.
+ *
+ * @returns The length in bytes.
+ */
+STATIC
+UINT32
+RamDiskNfitStructuresLength(IN RAMDISK_PRIVATE_DATA *PrivateData)
+{
+    UINT32 Length = (UINT32)(PrivateData->ExtentsLength * sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE));
+
+    if (TRUE == RamDiskIsPersistent(PrivateData)) {
+        Length += (UINT32)(PrivateData->ExtentsLength * sizeof(EFI_ACPI_NFIT_REGION_MAPPING_STRUCTURE));
+        Length += sizeof(EFI_ACPI_NFIT_CONTROL_REGION_STRUCTURE);
+    }
+
+    return Length;
+}
+
+
+/**
+ * Fill in the NFIT structures describing the given ramdisk: an SPA Range Structure
+ *  for each extent and, for persistent ramdisks, a Region Mapping Structure for each
+ *  extent plus one Control Region Structure. A persistent ramdisk appears to the OS
+ *  as its own NVDIMM, identified by an index which is unique within the NFIT.
+ *
+ * @param[in]  PrivateData  A pointer to some existing ramdisk data meta-structure.
+ * @param[out] Destination  Zeroed space of `RamDiskNfitStructuresLength` bytes.
+ */
+STATIC
+VOID
+RamDiskFillNfitStructures(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                          OUT VOID *Destination)
+{
+    EFI_ACPI_NFIT_SPA_STRUCTURE *SpaRange = (EFI_ACPI_NFIT_SPA_STRUCTURE *)Destination;
+    EFI_ACPI_NFIT_REGION_MAPPING_STRUCTURE *Mapping = NULL;
+    EFI_ACPI_NFIT_CONTROL_REGION_STRUCTURE *ControlRegion = NULL;
+    BOOLEAN IsPersistent = RamDiskIsPersistent(PrivateData);
+    UINT16 FirstSpaIndex = RamdiskNextSpaIndex;
+    UINT16 NvdimmIndex = 0;
+
+    for (UINTN i = 0; i < PrivateData->ExtentsLength; ++i, ++SpaRange) {
+        SpaRange->Type                              = NFIT_TABLE_TYPE_SPA;
+        SpaRange->Length                            = sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE);
+        SpaRange->SpaRangeStructureIndex            = RamdiskNextSpaIndex++;
+        SpaRange->SystemPhysicalAddressRangeBase    = PrivateData->Extents[i].StartingAddr;
+        SpaRange->SystemPhysicalAddressRangeLength  = PrivateData->Extents[i].Size;
+        CopyMem(&SpaRange->AddressRangeTypeGUID,    &PrivateData->TypeGuid, sizeof(EFI_GUID));
+
+        if (TRUE == IsPersistent) {
+            SpaRange->AddressRangeMemoryMappingAttribute = (NFIT_SPA_MAPPING_WB | NFIT_SPA_MAPPING_NV);
+        }
+    }
+
+    if (FALSE == IsPersistent) return;
+
+    NvdimmIndex = RamdiskNextNvdimmIndex++;
+
+    /* Each extent is a separate, non-interleaved region of the same NVDIMM, laid out
+        on the "DIMM" in disk order. */
+    Mapping = (EFI_ACPI_NFIT_REGION_MAPPING_STRUCTURE *)SpaRange;
+    for (UINTN i = 0; i < PrivateData->ExtentsLength; ++i, ++Mapping) {
+        Mapping->Type                               = NFIT_TABLE_TYPE_REGION_MAPPING;
+        Mapping->Length                             = sizeof(EFI_ACPI_NFIT_REGION_MAPPING_STRUCTURE);
+        Mapping->NfitDeviceHandle                   = NvdimmIndex;
+        Mapping->NvdimmPhysicalId                   = NvdimmIndex;
+        Mapping->NvdimmRegionId                     = (UINT16)i;
+        Mapping->SpaRangeStructureIndex             = (UINT16)(FirstSpaIndex + i);
+        Mapping->NvdimmControlRegionStructureIndex  = NvdimmIndex;
+        Mapping->NvdimmRegionSize                   = PrivateData->Extents[i].Size;
+        Mapping->RegionOffset                       = 0;
+        Mapping->NvdimmPhysicalAddressRegionBase    = PrivateData->Extents[i].Offset;
+        Mapping->InterleaveWays                     = 1;
+    }
+
+    ControlRegion = (EFI_ACPI_NFIT_CONTROL_REGION_STRUCTURE *)Mapping;
+    ControlRegion->Type                                 = NFIT_TABLE_TYPE_CONTROL_REGION;
+    ControlRegion->Length                               = sizeof(EFI_ACPI_NFIT_CONTROL_REGION_STRUCTURE);
+    ControlRegion->NvdimmControlRegionStructureIndex    = NvdimmIndex;
+    ControlRegion->SerialNumber                         = NvdimmIndex;
+    ControlRegion->RegionFormatInterfaceCode            = 0x0301;   /* byte-addressable, no block windows */
+}
+
+
+/**
+ * Checksum the running NFIT and install it to the ACPI tables. Any previously-installed
+ *  copy must already have been removed.
+ *
+ * @param[in]  ACPI  The ACPI table protocol instance to install through.
+ *
+ * @returns Whether the table was installed.
+ */
+STATIC
+EFI_STATUS
+RamDiskInstallNfit(IN EFI_ACPI_TABLE_PROTOCOL *ACPI)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    /* Calculate the checksum of the NFIT table. */
+    AcpiChecksumTable((EFI_ACPI_DESCRIPTION_HEADER *)RamdiskNfit);
+
+    /* Publish the NFIT to the ACPI table and capture the table key. */
+    ERRCHECK(
+        ACPI->InstallAcpiTable(ACPI,
+                               RamdiskNfit,
+                               RamdiskNfitLength,
+                               &RamdiskAcpiTableKey)
+    );
+
+    RamdiskNfitInstalled = TRUE;
+    return EFI_SUCCESS;
+}
+
+
 /**
  * Publish the given ramdisk to the ACPI NVDIMM Firmware Interface Table (NFIT).
+ *  Each extent of the ramdisk gets its own SPA Range Structure.
  * 
  * @param[in]  PrivateData  A pointer to some existing ramdisk data meta-structure.
  * 
@@ -116,7 +300,8 @@ RamDiskPublishNfit(IN RAMDISK_PRIVATE_DATA *PrivateData)
     EFI_STATUS Status = EFI_SUCCESS;
     EFI_ACPI_TABLE_PROTOCOL *ACPI;
     EFI_ACPI_DESCRIPTION_HEADER *NfitHeader;
-    EFI_ACPI_NFIT_SPA_STRUCTURE *SpaRange;
+    VOID *Structures;
+    UINT32 StructuresLength = RamDiskNfitStructuresLength(PrivateData);
 
     ACPI = AcpiGetInstance();
     if (NULL == ACPI) {
@@ -129,12 +314,11 @@ RamDiskPublishNfit(IN RAMDISK_PRIVATE_DATA *PrivateData)
         /* TODO! Determine if one exists already and append the SPA. */
         ERRCHECK(RamDiskPublishSsdt());
 
-        RamdiskNfitLength = sizeof(EFI_ACPI_SDT_NFIT) + sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE);
+        RamdiskNfitLength = sizeof(EFI_ACPI_SDT_NFIT) + StructuresLength;
         RamdiskNfit = AllocateZeroPool(RamdiskNfitLength);
         if (NULL == RamdiskNfit) return EFI_OUT_OF_RESOURCES;
 
-        SpaRange = (EFI_ACPI_NFIT_SPA_STRUCTURE *)
-            ((EFI_PHYSICAL_ADDRESS)RamdiskNfit + sizeof(EFI_ACPI_SDT_NFIT));
+        Structures = (VOID *)((EFI_PHYSICAL_ADDRESS)RamdiskNfit + sizeof(EFI_ACPI_SDT_NFIT));
 
         UINT32 MftahReleaseDate = EFI_SWAP_ENDIAN_32(MFTAH_RELEASE_DATE);
         UINT8 MftahCreatorId[4] = MFTAH_CREATOR_ID;
@@ -151,226 +335,1357 @@ RamDiskPublishNfit(IN RAMDISK_PRIVATE_DATA *PrivateData)
         CopyMem(NfitHeader->CreatorId,      &MftahCreatorId,    4);
         CopyMem(NfitHeader->OemTableId,     &MftahOemTableId,   8);
         CopyMem(NfitHeader->OemId,          &MftahOemId,        6);
-
-        /* Fill in the content of the first SPA Range Structure. */
-        SpaRange->Type                              = NFIT_TABLE_TYPE_SPA;
-        SpaRange->Length                            = sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE);
-        SpaRange->SystemPhysicalAddressRangeBase    = PrivateData->StartingAddr;
-        SpaRange->SystemPhysicalAddressRangeLength  = PrivateData->Size;
-        CopyMem(&SpaRange->AddressRangeTypeGUID,    &PrivateData->TypeGuid, sizeof(EFI_GUID));
     } else {
-        /* Adding an additional SPA entry to the ramdisks list. */
+        /* Adding additional SPA entries to the ramdisks list. */
         VOID *RamdiskNfitRealloc =
-            AllocateZeroPool(RamdiskNfitLength + sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE));
+            AllocateZeroPool(RamdiskNfitLength + StructuresLength);
         if (NULL == RamdiskNfitRealloc) return EFI_OUT_OF_RESOURCES;
 
         CopyMem(RamdiskNfitRealloc, RamdiskNfit, RamdiskNfitLength);
 
-        /* Remove the old NFIT entry. */
-        Status = ACPI->UninstallAcpiTable(ACPI, RamdiskAcpiTableKey);
-        if (EFI_ERROR(Status)) {
-            EFI_DANGERLN("WARNING: RAMDISK:  Failed to remove previous ACPI NFIT table (%u).", Status);
-            return Status;
+        /* Remove the old NFIT entry. Within a batch, this only happens for the first
+            ramdisk added after a previous batch's table was installed. */
+        if (TRUE == RamdiskNfitInstalled) {
+            Status = ACPI->UninstallAcpiTable(ACPI, RamdiskAcpiTableKey);
+            if (EFI_ERROR(Status)) {
+                EFI_DANGERLN("WARNING: RAMDISK:  Failed to remove previous ACPI NFIT table (%u).", Status);
+                FreePool(RamdiskNfitRealloc);
+                return Status;
+            }
+
+            RamdiskNfitInstalled = FALSE;
         }
 
-        /* Build a new SPA entry onto the end of the list. */
-        SpaRange = (EFI_ACPI_NFIT_SPA_STRUCTURE *)
-            ((EFI_PHYSICAL_ADDRESS)RamdiskNfitRealloc + RamdiskNfitLength);
-
-        SpaRange->Type                              = NFIT_TABLE_TYPE_SPA;
-        SpaRange->Length                            = sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE);
-        SpaRange->SystemPhysicalAddressRangeBase    = PrivateData->StartingAddr;
-        SpaRange->SystemPhysicalAddressRangeLength  = PrivateData->Size;
-        CopyMem(&SpaRange->AddressRangeTypeGUID,    &PrivateData->TypeGuid, sizeof(EFI_GUID));
+        /* New structures are built onto the end of the list. */
+        Structures = (VOID *)((EFI_PHYSICAL_ADDRESS)RamdiskNfitRealloc + RamdiskNfitLength);
 
         /* Adjust to the pointer for the new ramdisk. */
         FreePool(RamdiskNfit);
         RamdiskNfit = RamdiskNfitRealloc;
-        RamdiskNfitLength += sizeof(EFI_ACPI_NFIT_SPA_STRUCTURE);
+        RamdiskNfitLength += StructuresLength;
 
         /* Update NFIT's `Length` field. */
         NfitHeader = (EFI_ACPI_DESCRIPTION_HEADER *)RamdiskNfit;
         NfitHeader->Length = RamdiskNfitLength;
     }
 
-    /* Finally, calculate the checksum of the NFIT table. */
-    AcpiChecksumTable((EFI_ACPI_DESCRIPTION_HEADER *)RamdiskNfit);
+    PrivateData->NfitOffset = (UINT32)((EFI_PHYSICAL_ADDRESS)Structures - (EFI_PHYSICAL_ADDRESS)RamdiskNfit);
+    PrivateData->IsPublished = TRUE;
 
-    /* Publish the NFIT to the ACPI table and capture the table key. */
-    return ACPI->InstallAcpiTable(ACPI,
-                                  RamdiskNfit,
-                                  RamdiskNfitLength,
-                                  &RamdiskAcpiTableKey);
+    RamDiskFillNfitStructures(PrivateData, Structures);
+
+    if (TRUE == RamdiskBatchOpen) return EFI_SUCCESS;
+
+    return RamDiskInstallNfit(ACPI);
 }
 
 
 /**
- * Initialize the ramdisk device node.
+ * Remove the structures of the given ramdisk from the NFIT, and re-install the table
+ *  if any other structures remain in it.
  *
- * @param[in]      PrivateData     Points to RAM disk private data.
- * @param[in, out] RamDiskDevNode  Points to the RAM disk device node.
+ * @param[in]  PrivateData  A pointer to some existing ramdisk data meta-structure.
  *
+ * @returns Whether the ramdisk was removed from the NFIT.
  */
 STATIC
-VOID
-RamDiskInitDeviceNode(IN RAMDISK_PRIVATE_DATA *PrivateData,
-                      IN OUT MEDIA_RAMDISK_DEVICE_PATH *RamDiskDevNode)
+EFI_STATUS
+RamDiskRemoveNfit(IN RAMDISK_PRIVATE_DATA *PrivateData)
 {
-    UINT64 EndingAddr = PrivateData->StartingAddr + PrivateData->Size - 1;
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_ACPI_TABLE_PROTOCOL *ACPI;
+    UINT32 StructuresLength = RamDiskNfitStructuresLength(PrivateData);
+    UINT8 *Structures;
 
-    CopyMem((UINT64 *)&(RamDiskDevNode->StartingAddr[0]),
-            &PrivateData->StartingAddr,
-            sizeof(UINT64));
-    CopyMem((UINT64 *)&(RamDiskDevNode->EndingAddr[0]),
-            &EndingAddr,
-            sizeof(UINT64));
-    CopyMem(&RamDiskDevNode->TypeGuid,
-            &PrivateData->TypeGuid,
-            sizeof(EFI_GUID));
+    if (FALSE == PrivateData->IsPublished) return EFI_SUCCESS;
 
-    RamDiskDevNode->Instance = PrivateData->InstanceNumber;
+    ACPI = AcpiGetInstance();
+    if (NULL == ACPI) {
+        return EFI_NOT_FOUND;
+    }
+
+    if (TRUE == RamdiskNfitInstalled) {
+        ERRCHECK(ACPI->UninstallAcpiTable(ACPI, RamdiskAcpiTableKey));
+        RamdiskNfitInstalled = FALSE;
+    }
+
+    /* Close the gap left by the structures. Later disks' structures shift down. */
+    Structures = (UINT8 *)RamdiskNfit + PrivateData->NfitOffset;
+    CopyMem(Structures,
+            (Structures + StructuresLength),
+            (RamdiskNfitLength - (PrivateData->NfitOffset + StructuresLength)));
+
+    RamdiskNfitLength -= StructuresLength;
+    ((EFI_ACPI_DESCRIPTION_HEADER *)RamdiskNfit)->Length = RamdiskNfitLength;
+
+    for (RAMDISK_PRIVATE_DATA *p = RamdiskList; NULL != p; p = p->Next) {
+        if (TRUE == p->IsPublished && p->NfitOffset > PrivateData->NfitOffset) {
+            p->NfitOffset -= StructuresLength;
+        }
+    }
+
+    PrivateData->IsPublished = FALSE;
+
+    /* An empty NFIT is left out entirely, and an open batch installs it on commit. */
+    if (TRUE == RamdiskBatchOpen || sizeof(EFI_ACPI_SDT_NFIT) == RamdiskNfitLength) return EFI_SUCCESS;
+
+    return RamDiskInstallNfit(ACPI);
 }
 
 
-EFI_STATUS
-EFIAPI
-RamDiskRegister(IN UINT64 RamDiskBase,
-                IN UINT64 RamDiskSize,
-                IN EFI_GUID *RamDiskType,
-                IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
-                OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+/**
+ * Copy memory, streaming large copies around the cache with non-temporal stores.
+ */
+STATIC
+VOID
+RamDiskStreamCopy(OUT VOID *Destination,
+                  IN CONST VOID *Source,
+                  IN UINTN Length)
 {
-    EFI_STATUS Status;
-    RAMDISK_PRIVATE_DATA *PrivateData;
-    MEDIA_RAMDISK_DEVICE_PATH *RamDiskDevNode;
+    UINT64 *To = (UINT64 *)Destination;
+    CONST UINT64 *From = (CONST UINT64 *)Source;
+    UINTN Words = 0;
 
-    if ((0 == RamDiskSize) || (NULL == RamDiskType) || (NULL == DevicePath)) {
-        EFI_DANGERLN("\r\nNo ramdisk or ramdisk device path was found.");
-        return EFI_NOT_FOUND;
+    if (Length < RAMDISK_STREAM_COPY_MIN_SIZE || 0 != ((UINTN)Destination % sizeof(UINT64))) {
+        CopyMem(Destination, Source, Length);
+        return;
     }
 
-    /* Add a check to prevent data read across the memory boundary. */
-    if (0 != (RamDiskSize % RAM_DISK_BLOCK_SIZE)) {
-        EFI_DANGERLN(
-            "\r\nThe ramdisk size of '%d' is not a multiple of block size '%d' (R: %d).",
-            RamDiskSize,
-            RAM_DISK_BLOCK_SIZE,
-            (RamDiskSize % RAM_DISK_BLOCK_SIZE)
-        );
-        return EFI_BAD_BUFFER_SIZE;
-    }
+    Words = Length / sizeof(UINT64);
 
-    if (
-        RamDiskSize >= UINT64_MAX
-        || RamDiskBase > ((UINT64_MAX - RamDiskSize) + 1)
-    ) {
-        EFI_DANGERLN("\r\nThe ramdisk is misaligned or exceeds 64-bit memory boundaries.");
-        return EFI_INVALID_PARAMETER;
+    for (UINTN i = 0; i < Words; ++i) {
+        __builtin_nontemporal_store(From[i], &To[i]);
     }
 
-    RamDiskDevNode = NULL;
+    CopyMem(&To[Words], &From[Words], (Length % sizeof(UINT64)));
 
-    /* Initialize the loaded ramdisk's structure. */
-    PrivateData = (RAMDISK_PRIVATE_DATA *)AllocateZeroPool(sizeof(RAMDISK_PRIVATE_DATA));
-    if (NULL == PrivateData) {
-        Status = EFI_OUT_OF_RESOURCES;
-        goto ErrorExit;
-    }
+#if defined(__x86_64__)
+    /* Streaming stores are weakly ordered: fence them before anyone reads the data. */
+    __builtin_ia32_sfence();
+#endif
+}
 
-    CopyMem(PrivateData, &mRamDiskPrivateDataTemplate, sizeof(RAMDISK_PRIVATE_DATA));
-    CopyMem(&PrivateData->TypeGuid, RamDiskType, sizeof(EFI_GUID));
-    PrivateData->StartingAddr = RamDiskBase;
-    PrivateData->Size         = RamDiskSize;
 
-    /* Set an incremental ramdisk instance number to identify it in device paths. */
-    ++RamdiskCurrentInstance;
-    PrivateData->InstanceNumber = RamdiskCurrentInstance;
+/**
+ * Copy data between a caller's buffer and the ramdisk, walking the extents which back
+ *  the requested byte range. The range must already be validated against the media.
+ *
+ * @param[in]      PrivateData  Points to RAM disk private data.
+ * @param[in]      DiskOffset   The byte offset within the disk to start at.
+ * @param[in, out] Buffer       The caller's buffer to read into or write from.
+ * @param[in]      Length       The amount of bytes to copy.
+ * @param[in]      IsWrite      Whether the copy goes into the disk (TRUE) or out of it.
+ *
+ */
+STATIC
+VOID
+RamDiskCopyBlocks(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                  IN UINT64 DiskOffset,
+                  IN OUT VOID *Buffer,
+                  IN UINTN Length,
+                  IN BOOLEAN IsWrite)
+{
+    UINTN Low = 0, High = PrivateData->ExtentsLength - 1, Mid = 0;
+    UINT8 *Cursor = (UINT8 *)Buffer;
 
-    /* Generate device path information for the ramdisk. */
-    RamDiskDevNode = (MEDIA_RAMDISK_DEVICE_PATH *)AllocateZeroPool(sizeof(MEDIA_RAMDISK_DEVICE_PATH));
-    if (NULL == RamDiskDevNode) {
-        Status = EFI_OUT_OF_RESOURCES;
-        goto ErrorExit;
+    /* Extents are sorted by their offset within the disk, so find the one holding the
+        start of the range with a binary search. Everything after it follows in order. */
+    while (Low < High) {
+        Mid = Low + ((High - Low + 1) / 2);
+
+        if (PrivateData->Extents[Mid].Offset <= DiskOffset) Low = Mid;
+        else High = Mid - 1;
     }
 
-    CopyMem(RamDiskDevNode, &mRamDiskDeviceNodeTemplate, sizeof(MEDIA_RAMDISK_DEVICE_PATH));
-    RamDiskInitDeviceNode(PrivateData, RamDiskDevNode);
+    for (UINTN i = Low; i < PrivateData->ExtentsLength && Length > 0; ++i) {
+        RAMDISK_EXTENT *e = &(PrivateData->Extents[i]);
+        UINT64 Within = DiskOffset - e->Offset;
+        UINTN Chunk = (UINTN)MIN((UINT64)Length, (e->Size - Within));
+        VOID *Memory = (VOID *)(UINTN)(e->StartingAddr + Within);
 
-    *DevicePath = AppendDevicePathNode(ParentDevicePath,
-                                       (EFI_DEVICE_PATH_PROTOCOL *)RamDiskDevNode);
-    if (NULL == *DevicePath) {
-        Status = EFI_OUT_OF_RESOURCES;
-        goto ErrorExit;
+        if (TRUE == IsWrite) RamDiskStreamCopy(Memory, Cursor, Chunk);
+        else RamDiskStreamCopy(Cursor, Memory, Chunk);
+
+        Cursor += Chunk;
+        DiskOffset += Chunk;
+        Length -= Chunk;
     }
+}
 
-    PrivateData->DevicePath = *DevicePath;
 
-    /* Fill Block IO protocol informations for the ramdisk. */
-    RamDiskInitBlockIo(PrivateData);
+/* Cycle counter for transfer latencies. Reads as zero where there is no TSC. */
+STATIC
+UINT64
+RamDiskReadTsc(VOID)
+{
+#if defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
 
-    /* Install EFI_DEVICE_PATH_PROTOCOL & EFI_BLOCK_IO(2)_PROTOCOL on a new handle. */
-    Status = BS->InstallMultipleProtocolInterfaces(
-        &PrivateData->Handle,
-        &gEfiBlockIoProtocolGuid,
-        &PrivateData->BlockIo,
-        &gEfiBlockIo2ProtocolGuid,
-        &PrivateData->BlockIo2,
-        &gEfiDevicePathProtocolGuid,
-        PrivateData->DevicePath,
-        NULL
-    );
-    if (EFI_ERROR(Status)) goto ErrorExit;
 
-    Status = BS->ConnectController(PrivateData->Handle,
-                                   NULL,
-                                   NULL,
-                                   TRUE);
-    if (EFI_ERROR(Status)) goto ErrorExit;
+/**
+ * Account for a completed transfer in a ramdisk's I/O statistics.
+ *
+ * @param[in]  PrivateData  Points to RAM disk private data.
+ * @param[in]  DiskOffset   The byte offset within the disk where the transfer started.
+ * @param[in]  Length       The amount of bytes transferred.
+ * @param[in]  IsWrite      Whether the transfer went into the disk.
+ * @param[in]  StartTsc     The cycle counter from when the transfer was requested.
+ */
+STATIC
+VOID
+RamDiskRecordTransfer(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                      IN UINT64 DiskOffset,
+                      IN UINTN Length,
+                      IN BOOLEAN IsWrite,
+                      IN UINT64 StartTsc)
+{
+    RAMDISK_IO_STATISTICS *Stats = &(PrivateData->Stats);
+    UINT64 Cycles = RamDiskReadTsc() - StartTsc;
+    UINT64 BucketSize = MAX(1, ((PrivateData->Size + (RAMDISK_STATS_HEATMAP_BUCKETS - 1))
+                                 / RAMDISK_STATS_HEATMAP_BUCKETS));
+    UINTN Latency = 0;
+    EFI_TPL OldTpl;
+
+    /* Cycle counts are bucketed by their bit length. */
+    if (0 != (Cycles >> RAMDISK_STATS_LATENCY_SHIFT)) {
+        Latency = 64 - __builtin_clzll(Cycles >> RAMDISK_STATS_LATENCY_SHIFT);
+    }
 
-    FreePool(RamDiskDevNode);
+    /* Block IO calls can come from event notifications too, which could otherwise land
+        in the middle of another update. */
+    OldTpl = BS->RaiseTPL(TPL_NOTIFY);
 
-    Status = RamDiskPublishNfit(PrivateData);
-    if (EFI_ERROR(Status)) goto ErrorExit;
+    if (TRUE == IsWrite) {
+        ++Stats->WriteOps;
+        Stats->BytesWritten += Length;
+    } else {
+        ++Stats->ReadOps;
+        Stats->BytesRead += Length;
+    }
 
-    return Status;
+    ++Stats->LatencyHistogram[MIN(Latency, (RAMDISK_STATS_LATENCY_BUCKETS - 1))];
+    Stats->TotalCycles += Cycles;
 
-ErrorExit:
-    if (NULL != RamDiskDevNode) {
-        FreePool(RamDiskDevNode);
-    }
+    while (Length > 0) {
+        UINTN Bucket = (UINTN)(DiskOffset / BucketSize);
+        UINTN Chunk = (UINTN)MIN((UINT64)Length, (((UINT64)(Bucket + 1) * BucketSize) - DiskOffset));
 
-    if (NULL != PrivateData) {
-        if (NULL != PrivateData->DevicePath) {
-            FreePool(PrivateData->DevicePath);
-        }
-        FreePool(PrivateData);
+        Stats->Heatmap[MIN(Bucket, (RAMDISK_STATS_HEATMAP_BUCKETS - 1))] += Chunk;
+
+        DiskOffset += Chunk;
+        Length -= Chunk;
     }
 
-    return Status;
+    BS->RestoreTPL(OldTpl);
 }
 
 
 /**
- * This functionality is left incomplete because it's not currently used.
+ * Check a Block IO request against the media of a ramdisk.
+ *
+ * @retval EFI_SUCCESS  The request is valid and not empty.
+ * @retval EFI_ABORTED  The request is valid, but there is nothing to transfer.
+ * @returns Otherwise, the error the Block IO call must return.
  */
+STATIC
 EFI_STATUS
-EFIAPI
-RamDiskUnregister(IN EFI_DEVICE_PATH_PROTOCOL *DevicePath)
+RamDiskCheckTransfer(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                     IN UINT32 MediaId,
+                     IN EFI_LBA Lba,
+                     IN UINTN BufferSize,
+                     IN VOID *Buffer,
+                     IN BOOLEAN IsWrite)
 {
-    if (NULL == DevicePath) {
+    UINTN NumberOfBlocks;
+
+    if (MediaId != PrivateData->Media.MediaId) {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (TRUE == IsWrite && TRUE == PrivateData->Media.ReadOnly) {
+        return EFI_WRITE_PROTECTED;
+    }
+
+    if (NULL == Buffer) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (0 == BufferSize) {
+        return EFI_ABORTED;
+    }
+
+    if ((BufferSize % PrivateData->Media.BlockSize) != 0) {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    if (Lba > PrivateData->Media.LastBlock) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    NumberOfBlocks = BufferSize / PrivateData->Media.BlockSize;
+    if ((Lba + NumberOfBlocks - 1) > PrivateData->Media.LastBlock) {
         return EFI_INVALID_PARAMETER;
     }
 
-    BS->UninstallMultipleProtocolInterfaces(DevicePath,
-                                            &gEfiRamdiskGuid,
-                                            NULL);
     return EFI_SUCCESS;
 }
 
 
+/**
+ * Get a decompressed frame of a compressed ramdisk, through its frame cache. On a miss,
+ *  the least recently used entry is replaced. Entry buffers are only allocated the first
+ *  time they're needed, so a disk which is barely read only holds a frame or two.
+ *
+ * @param[in]  PrivateData  Points to RAM disk private data.
+ * @param[in]  FrameIndex   The frame to get.
+ * @param[out] Frame        Set to the decompressed frame.
+ *
+ * @retval EFI_SUCCESS           The frame is available.
+ * @retval EFI_OUT_OF_RESOURCES  A cache buffer could not be allocated.
+ * @retval EFI_VOLUME_CORRUPTED  The frame failed to decompress.
+ */
+STATIC
 EFI_STATUS
-EFIAPI
-RamdiskDriverInit(IN EFI_HANDLE ImageHandle)
+RamDiskGetFrame(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                IN UINTN FrameIndex,
+                OUT CONST UINT8 **Frame)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    RAMDISK_FRAME_CACHE_ENTRY *Victim = &(PrivateData->FrameCache[0]);
+
+    ++PrivateData->FrameClock;
+
+    for (UINTN i = 0; i < RAMDISK_FRAME_CACHE_LENGTH; ++i) {
+        RAMDISK_FRAME_CACHE_ENTRY *e = &(PrivateData->FrameCache[i]);
+
+        if (TRUE == e->IsValid && FrameIndex == e->FrameIndex) {
+            e->LastUsed = PrivateData->FrameClock;
+            *Frame = e->Buffer;
+            return EFI_SUCCESS;
+        }
+
+        /* Prefer empty entries, then whichever was used the longest time ago. */
+        if (TRUE == Victim->IsValid && (FALSE == e->IsValid || e->LastUsed < Victim->LastUsed)) {
+            Victim = e;
+        }
+    }
+
+    if (NULL == Victim->Buffer) {
+        Victim->Buffer = (UINT8 *)AllocatePool(PrivateData->Compressed->FrameSize);
+        if (NULL == Victim->Buffer) return EFI_OUT_OF_RESOURCES;
+    }
+
+    Victim->IsValid = FALSE;
+    ERRCHECK(CompressedImageReadFrame(PrivateData->Compressed, FrameIndex, Victim->Buffer));
+
+    Victim->FrameIndex = FrameIndex;
+    Victim->LastUsed   = PrivateData->FrameClock;
+    Victim->IsValid    = TRUE;
+
+    *Frame = Victim->Buffer;
+    return EFI_SUCCESS;
+}
+
+
+/**
+ * Free the buffers of a compressed ramdisk's frame cache.
+ */
+STATIC
+VOID
+RamDiskFreeFrameCache(IN RAMDISK_PRIVATE_DATA *PrivateData)
+{
+    for (UINTN i = 0; i < RAMDISK_FRAME_CACHE_LENGTH; ++i) {
+        if (NULL != PrivateData->FrameCache[i].Buffer) {
+            FreePool(PrivateData->FrameCache[i].Buffer);
+        }
+    }
+
+    SetMem(PrivateData->FrameCache, sizeof(PrivateData->FrameCache), 0x00);
+}
+
+
+/**
+ * Read a byte range of a block-mapped ramdisk which isn't in the block map: from the
+ *  extents of an overlay, the frames of a compressed disk, or as zeroes for a sparse disk.
+ *
+ * @param[in]  PrivateData  Points to RAM disk private data.
+ * @param[in]  DiskOffset   The byte offset within the disk to start at.
+ * @param[out] Buffer       The buffer to read into.
+ * @param[in]  Length       The amount of bytes to read.
+ *
+ * @retval EFI_SUCCESS      The range was read.
+ * @returns Any error from getting a compressed frame.
+ */
+STATIC
+EFI_STATUS
+RamDiskReadUnmapped(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                    IN UINT64 DiskOffset,
+                    OUT VOID *Buffer,
+                    IN UINTN Length)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINT8 *Cursor = (UINT8 *)Buffer;
+    CONST UINT8 *Frame = NULL;
+
+    switch (PrivateData->Backing) {
+        case RAMDISK_BACKING_SPARSE:
+            SetMem(Buffer, Length, 0x00);
+            return EFI_SUCCESS;
+
+        case RAMDISK_BACKING_COMPRESSED:
+            while (Length > 0) {
+                UINTN FrameIndex = (UINTN)(DiskOffset / PrivateData->Compressed->FrameSize);
+                UINTN Within = (UINTN)(DiskOffset % PrivateData->Compressed->FrameSize);
+                UINTN Chunk = MIN(Length, (PrivateData->Compressed->FrameSize - Within));
+
+                ERRCHECK(RamDiskGetFrame(PrivateData, FrameIndex, &Frame));
+                CopyMem(Cursor, (Frame + Within), Chunk);
+
+                Cursor += Chunk;
+                DiskOffset += Chunk;
+                Length -= Chunk;
+            }
+            return EFI_SUCCESS;
+
+        default:
+            RamDiskCopyBlocks(PrivateData, DiskOffset, Buffer, Length, FALSE);
+            return EFI_SUCCESS;
+    }
+}
+
+
+/**
+ * Copy data between a caller's buffer and a ramdisk whose blocks are tracked in a block
+ *  map. Mapped blocks are accessed in their page. Unmapped blocks read from the extents
+ *  for copy-on-write overlays, from their frame for compressed disks, or read as zeroes
+ *  for sparse disks. The first write to an unmapped block gives it a new page, filled in
+ *  from wherever it read from before, so the extents are never modified.
+ *
+ * @param[in]      PrivateData  Points to RAM disk private data.
+ * @param[in]      DiskOffset   The byte offset within the disk to start at.
+ * @param[in, out] Buffer       The caller's buffer to read into or write from.
+ * @param[in]      Length       The amount of bytes to copy.
+ * @param[in]      IsWrite      Whether the copy goes into the disk (TRUE) or out of it.
+ *
+ * @retval EFI_SUCCESS           The copy completed.
+ * @retval EFI_OUT_OF_RESOURCES  A new block page could not be allocated for a write.
+ * @retval EFI_DEVICE_ERROR      A compressed frame could not be read.
+ */
+STATIC
+EFI_STATUS
+RamDiskCopyMapped(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                  IN UINT64 DiskOffset,
+                  IN OUT VOID *Buffer,
+                  IN UINTN Length,
+                  IN BOOLEAN IsWrite)
+{
+    UINT8 *Cursor = (UINT8 *)Buffer;
+
+    while (Length > 0) {
+        UINTN Block = (UINTN)(DiskOffset / RAMDISK_MAPPED_BLOCK_SIZE);
+        UINTN Within = (UINTN)(DiskOffset % RAMDISK_MAPPED_BLOCK_SIZE);
+        UINTN Chunk = MIN(Length, (RAMDISK_MAPPED_BLOCK_SIZE - Within));
+        EFI_PHYSICAL_ADDRESS Page = PrivateData->BlockMap[Block];
+
+        if (TRUE == IsWrite && 0 == Page) {
+            UINT64 BlockStart = ((UINT64)Block * RAMDISK_MAPPED_BLOCK_SIZE);
+
+            if (EFI_ERROR(BS->AllocatePages(AllocateAnyPages,
+                                            EfiBootServicesData,
+                                            EFI_SIZE_TO_PAGES(RAMDISK_MAPPED_BLOCK_SIZE),
+                                            &Page))) return EFI_OUT_OF_RESOURCES;
+
+            /* Bring in the untouched remainder of the block before the write lands on it. */
+            if (EFI_ERROR(RamDiskReadUnmapped(PrivateData,
+                                              BlockStart,
+                                              (VOID *)Page,
+                                              (UINTN)MIN(RAMDISK_MAPPED_BLOCK_SIZE, (PrivateData->Size - BlockStart))))) {
+                BS->FreePages(Page, EFI_SIZE_TO_PAGES(RAMDISK_MAPPED_BLOCK_SIZE));
+                return EFI_DEVICE_ERROR;
+            }
+
+            PrivateData->BlockMap[Block] = Page;
+            ++PrivateData->BlockPagesLength;
+        }
+
+        if (0 != Page) {
+            if (TRUE == IsWrite) CopyMem((VOID *)(Page + Within), Cursor, Chunk);
+            else CopyMem(Cursor, (VOID *)(Page + Within), Chunk);
+        } else {
+            /* Read any following blocks which are also unmapped in one go. */
+            while (
+                Chunk < Length
+                && (Block + 1) < PrivateData->BlockMapLength
+                && 0 == PrivateData->BlockMap[Block + 1]
+            ) {
+                ++Block;
+                Chunk = MIN(Length, (Chunk + RAMDISK_MAPPED_BLOCK_SIZE));
+            }
+
+            if (EFI_ERROR(RamDiskReadUnmapped(PrivateData, DiskOffset, Cursor, Chunk))) {
+                return EFI_DEVICE_ERROR;
+            }
+        }
+
+        Cursor += Chunk;
+        DiskOffset += Chunk;
+        Length -= Chunk;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+/**
+ * Whether a whole block of memory is zero. The block is OR'd together a word at a time
+ *  without any early exit, which lets the compiler vectorize the loop.
+ */
+STATIC
+BOOLEAN
+RamDiskIsZeroBlock(IN CONST VOID *Block)
+{
+    CONST UINT64 *Words = (CONST UINT64 *)Block;
+    UINT64 Accumulated = 0;
+
+    for (UINTN i = 0; i < (RAMDISK_MAPPED_BLOCK_SIZE / sizeof(UINT64)); ++i) {
+        Accumulated |= Words[i];
+    }
+
+    return (0 == Accumulated);
+}
+
+
+/**
+ * Drop every all-zero block from the image of a sparse ramdisk. The remaining blocks are
+ *  packed towards the start of the image and mapped, then the pages this frees up at
+ *  the end of the image are returned to the firmware.
+ *
+ * @param[in]  PrivateData  Points to RAM disk private data with an empty block map.
+ */
+STATIC
+VOID
+RamDiskCompactSparse(IN RAMDISK_PRIVATE_DATA *PrivateData)
+{
+    EFI_PHYSICAL_ADDRESS Image = PrivateData->Extents[0].StartingAddr;
+    UINTN ImagePages = EFI_SIZE_TO_PAGES(PrivateData->Size);
+    UINTN Kept = 0;
+
+    for (UINTN i = 0; i < PrivateData->BlockMapLength; ++i) {
+        EFI_PHYSICAL_ADDRESS Block = Image + ((UINT64)i * RAMDISK_MAPPED_BLOCK_SIZE);
+        EFI_PHYSICAL_ADDRESS Destination = Image + ((UINT64)Kept * RAMDISK_MAPPED_BLOCK_SIZE);
+
+        /* A partial block at the end is always kept, rather than scanning past the image. */
+        if (
+            (Block + RAMDISK_MAPPED_BLOCK_SIZE) <= (Image + PrivateData->Size)
+            && TRUE == RamDiskIsZeroBlock((VOID *)Block)
+        ) continue;
+
+        /* Blocks only ever move towards the start, so this never overwrites a kept block. */
+        if (Destination != Block) {
+            CopyMem((VOID *)Destination, (VOID *)Block, RAMDISK_MAPPED_BLOCK_SIZE);
+        }
+
+        PrivateData->BlockMap[i] = Destination;
+        ++Kept;
+    }
+
+    PrivateData->SparseImagePages = Kept;
+
+    if (Kept < ImagePages) {
+        BS->FreePages(Image + ((UINT64)Kept * EFI_PAGE_SIZE), (ImagePages - Kept));
+    }
+
+    DPRINTLN("Sparse ramdisk kept %u of %u blocks.", Kept, PrivateData->BlockMapLength);
+}
+
+
+/**
+ * Initialize the ramdisk device node.
+ *
+ * @param[in]      PrivateData     Points to RAM disk private data.
+ * @param[in, out] RamDiskDevNode  Points to the RAM disk device node.
+ *
+ */
+STATIC
+VOID
+RamDiskInitDeviceNode(IN RAMDISK_PRIVATE_DATA *PrivateData,
+                      IN OUT MEDIA_RAMDISK_DEVICE_PATH *RamDiskDevNode)
+{
+    /* Only single-extent disks get a ramdisk node, so the first extent is the whole disk. */
+    UINT64 EndingAddr = PrivateData->Extents[0].StartingAddr + PrivateData->Extents[0].Size - 1;
+
+    CopyMem((UINT64 *)&(RamDiskDevNode->StartingAddr[0]),
+            &PrivateData->Extents[0].StartingAddr,
+            sizeof(UINT64));
+    CopyMem((UINT64 *)&(RamDiskDevNode->EndingAddr[0]),
+            &EndingAddr,
+            sizeof(UINT64));
+    CopyMem(&RamDiskDevNode->TypeGuid,
+            &PrivateData->TypeGuid,
+            sizeof(EFI_GUID));
+
+    RamDiskDevNode->Instance = PrivateData->InstanceNumber;
+}
+
+
+/**
+ * Register a ramdisk backed by the given extents.
+ *
+ * @param[in]  Extents           The set of memory regions backing the disk, in disk order.
+ * @param[in]  ExtentsLength     The amount of entries in `Extents`.
+ * @param[in]  RamDiskType       The type of registered RAM disk.
+ * @param[in]  ParentDevicePath  Pointer to the parent device path, if any.
+ * @param[in]  Backing           How the disk's blocks are stored.
+ * @param[in]  Compressed        For compressed disks, the parsed image held by the extents.
+ *                               The driver takes ownership of it on success.
+ * @param[out] DevicePath        On return, points to the device path of the RAM disk.
+ *
+ * @returns Whether the ramdisk was registered. See `RamDiskRegisterExtents`.
+ */
+STATIC
+EFI_STATUS
+RamDiskRegisterCommon(IN RAMDISK_EXTENT *Extents,
+                      IN UINTN ExtentsLength,
+                      IN EFI_GUID *RamDiskType,
+                      IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
+                      IN RAMDISK_BACKING Backing,
+                      IN COMPRESSED_IMAGE *Compressed OPTIONAL,
+                      OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    EFI_STATUS Status;
+    RAMDISK_PRIVATE_DATA *PrivateData;
+    EFI_DEVICE_PATH_PROTOCOL *RamDiskDevNode;
+    UINT64 RamDiskSize = 0;
+
+    if ((NULL == Extents) || (0 == ExtentsLength) || (NULL == RamDiskType) || (NULL == DevicePath)) {
+        EFI_DANGERLN("\r\nNo ramdisk or ramdisk device path was found.");
+        return EFI_NOT_FOUND;
+    }
+
+    for (UINTN i = 0; i < ExtentsLength; ++i) {
+        if (
+            0 == Extents[i].Size
+            || Extents[i].Size >= UINT64_MAX
+            || Extents[i].StartingAddr > ((UINT64_MAX - Extents[i].Size) + 1)
+            || RamDiskSize > (UINT64_MAX - Extents[i].Size)
+        ) {
+            EFI_DANGERLN("\r\nThe ramdisk is misaligned or exceeds 64-bit memory boundaries.");
+            return EFI_INVALID_PARAMETER;
+        }
+
+        RamDiskSize += Extents[i].Size;
+    }
+
+    /* The extents of a compressed disk only hold its image: the disk is bigger. */
+    if (NULL != Compressed) RamDiskSize = Compressed->UncompressedSize;
+
+    /* Add a check to prevent data read across the memory boundary. */
+    if (0 != (RamDiskSize % RAM_DISK_BLOCK_SIZE)) {
+        EFI_DANGERLN(
+            "\r\nThe ramdisk size of '%d' is not a multiple of block size '%d' (R: %d).",
+            RamDiskSize,
+            RAM_DISK_BLOCK_SIZE,
+            (RamDiskSize % RAM_DISK_BLOCK_SIZE)
+        );
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    RamDiskDevNode = NULL;
+
+    /* Initialize the loaded ramdisk's structure. */
+    PrivateData = (RAMDISK_PRIVATE_DATA *)AllocateZeroPool(sizeof(RAMDISK_PRIVATE_DATA));
+    if (NULL == PrivateData) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto ErrorExit;
+    }
+
+    CopyMem(PrivateData, &mRamDiskPrivateDataTemplate, sizeof(RAMDISK_PRIVATE_DATA));
+    CopyMem(&PrivateData->TypeGuid, RamDiskType, sizeof(EFI_GUID));
+    PrivateData->StartingAddr = Extents[0].StartingAddr;
+    PrivateData->Size         = RamDiskSize;
+
+    /* Keep a private copy of the extent table, with each extent's offset into the disk. */
+    PrivateData->Extents = (RAMDISK_EXTENT *)AllocateZeroPool(sizeof(RAMDISK_EXTENT) * ExtentsLength);
+    if (NULL == PrivateData->Extents) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto ErrorExit;
+    }
+
+    PrivateData->ExtentsLength = ExtentsLength;
+
+    for (UINTN i = 0, Offset = 0; i < ExtentsLength; Offset += Extents[i].Size, ++i) {
+        PrivateData->Extents[i].StartingAddr = Extents[i].StartingAddr;
+        PrivateData->Extents[i].Size         = Extents[i].Size;
+        PrivateData->Extents[i].Offset       = Offset;
+    }
+
+    /* Copy-on-write disks start with an empty block map: every block reads from the
+        extents until it's first written, and pages are only allocated on those writes.
+        Sparse disks map whichever blocks of the image hold any data at all. */
+    PrivateData->Backing = Backing;
+    PrivateData->Compressed = Compressed;
+
+    if (RAMDISK_BACKING_EXTENTS != Backing) {
+        PrivateData->BlockMapLength =
+            (UINTN)((RamDiskSize + (RAMDISK_MAPPED_BLOCK_SIZE - 1)) / RAMDISK_MAPPED_BLOCK_SIZE);
+
+        PrivateData->BlockMap = (EFI_PHYSICAL_ADDRESS *)
+            AllocateZeroPool(sizeof(EFI_PHYSICAL_ADDRESS) * PrivateData->BlockMapLength);
+        if (NULL == PrivateData->BlockMap) {
+            Status = EFI_OUT_OF_RESOURCES;
+            goto ErrorExit;
+        }
+
+        if (RAMDISK_BACKING_SPARSE == Backing) RamDiskCompactSparse(PrivateData);
+    }
+
+    /* Set an incremental ramdisk instance number to identify it in device paths. */
+    ++RamdiskCurrentInstance;
+    PrivateData->InstanceNumber = RamdiskCurrentInstance;
+
+    /* Generate device path information for the ramdisk. A ramdisk node can only describe
+        one memory range, and anything reading it (the OS included) would take that range
+        as the whole disk. Scattered disks are named by a vendor node instead. */
+    if (1 == ExtentsLength) {
+        RamDiskDevNode = (EFI_DEVICE_PATH_PROTOCOL *)AllocateZeroPool(sizeof(MEDIA_RAMDISK_DEVICE_PATH));
+        if (NULL == RamDiskDevNode) {
+            Status = EFI_OUT_OF_RESOURCES;
+            goto ErrorExit;
+        }
+
+        CopyMem(RamDiskDevNode, &mRamDiskDeviceNodeTemplate, sizeof(MEDIA_RAMDISK_DEVICE_PATH));
+        RamDiskInitDeviceNode(PrivateData, (MEDIA_RAMDISK_DEVICE_PATH *)RamDiskDevNode);
+    } else {
+        RamDiskDevNode = (EFI_DEVICE_PATH_PROTOCOL *)AllocateZeroPool(sizeof(RAMDISK_EXTENTS_DEVICE_PATH));
+        if (NULL == RamDiskDevNode) {
+            Status = EFI_OUT_OF_RESOURCES;
+            goto ErrorExit;
+        }
+
+        CopyMem(RamDiskDevNode, &mRamDiskExtentsNodeTemplate, sizeof(RAMDISK_EXTENTS_DEVICE_PATH));
+        ((RAMDISK_EXTENTS_DEVICE_PATH *)RamDiskDevNode)->Instance = PrivateData->InstanceNumber;
+    }
+
+    *DevicePath = AppendDevicePathNode(ParentDevicePath, RamDiskDevNode);
+    if (NULL == *DevicePath) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto ErrorExit;
+    }
+
+    PrivateData->DevicePath = *DevicePath;
+
+    /* Fill Block IO protocol informations for the ramdisk. */
+    RamDiskInitBlockIo(PrivateData);
+    CopyMem(&PrivateData->StatsProtocol, &mRamDiskStatsTemplate, sizeof(RAMDISK_STATS_PROTOCOL));
+
+    /* Install EFI_DEVICE_PATH_PROTOCOL, EFI_BLOCK_IO(2)_PROTOCOL, and the statistics
+        protocol on a new handle. */
+    Status = BS->InstallMultipleProtocolInterfaces(
+        &PrivateData->Handle,
+        &gEfiBlockIoProtocolGuid,
+        &PrivateData->BlockIo,
+        &gEfiBlockIo2ProtocolGuid,
+        &PrivateData->BlockIo2,
+        &gEfiDevicePathProtocolGuid,
+        PrivateData->DevicePath,
+        &gRamdiskStatsProtocolGuid,
+        &PrivateData->StatsProtocol,
+        NULL
+    );
+    if (EFI_ERROR(Status)) goto ErrorExit;
+
+    Status = BS->ConnectController(PrivateData->Handle,
+                                   NULL,
+                                   NULL,
+                                   TRUE);
+    if (EFI_ERROR(Status)) goto ErrorExit;
+
+    FreePool(RamDiskDevNode);
+    RamDiskDevNode = NULL;
+
+    /* The OS only ever sees the extents, not the block map. Publishing a copy-on-write,
+        sparse, or compressed disk would hand it stale (or packed) contents, so these stay
+        firmware-only. Compressed disks are published once they're materialized. */
+    if (RAMDISK_BACKING_EXTENTS == Backing) {
+        Status = RamDiskPublishNfit(PrivateData);
+        if (EFI_ERROR(Status)) goto ErrorExit;
+    }
+
+    PrivateData->Next = RamdiskList;
+    RamdiskList = PrivateData;
+
+    return EFI_SUCCESS;
+
+ErrorExit:
+    if (NULL != RamDiskDevNode) {
+        FreePool(RamDiskDevNode);
+    }
+
+    if (NULL != PrivateData) {
+        if (NULL != PrivateData->DevicePath) {
+            FreePool(PrivateData->DevicePath);
+        }
+        if (NULL != PrivateData->Extents) {
+            FreePool(PrivateData->Extents);
+        }
+        if (NULL != PrivateData->BlockMap) {
+            FreePool(PrivateData->BlockMap);
+        }
+        RamDiskFreeFrameCache(PrivateData);
+        FreePool(PrivateData);
+    }
+
+    return Status;
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskRegister(IN UINT64 RamDiskBase,
+                IN UINT64 RamDiskSize,
+                IN EFI_GUID *RamDiskType,
+                IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
+                OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    /* A contiguous ramdisk is just a ramdisk with a single extent. */
+    RAMDISK_EXTENT Extent = { RamDiskBase, RamDiskSize, 0 };
+
+    return RamDiskRegisterExtents(&Extent, 1, RamDiskType, ParentDevicePath, DevicePath);
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskRegisterExtents(IN RAMDISK_EXTENT *Extents,
+                       IN UINTN ExtentsLength,
+                       IN EFI_GUID *RamDiskType,
+                       IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
+                       OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    return RamDiskRegisterCommon(Extents,
+                                 ExtentsLength,
+                                 RamDiskType,
+                                 ParentDevicePath,
+                                 RAMDISK_BACKING_EXTENTS,
+                                 NULL,
+                                 DevicePath);
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskRegisterOverlay(IN RAMDISK_EXTENT *Extents,
+                       IN UINTN ExtentsLength,
+                       IN EFI_GUID *RamDiskType,
+                       IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
+                       OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    return RamDiskRegisterCommon(Extents,
+                                 ExtentsLength,
+                                 RamDiskType,
+                                 ParentDevicePath,
+                                 RAMDISK_BACKING_OVERLAY,
+                                 NULL,
+                                 DevicePath);
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskRegisterSparse(IN UINT64 RamDiskBase,
+                      IN UINT64 RamDiskSize,
+                      IN EFI_GUID *RamDiskType,
+                      IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
+                      OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    RAMDISK_EXTENT Extent = { RamDiskBase, RamDiskSize, 0 };
+
+    /* Blocks are packed and released in whole pages. */
+    if (0 != (RamDiskBase % EFI_PAGE_SIZE)) return EFI_INVALID_PARAMETER;
+
+    return RamDiskRegisterCommon(&Extent,
+                                 1,
+                                 RamDiskType,
+                                 ParentDevicePath,
+                                 RAMDISK_BACKING_SPARSE,
+                                 NULL,
+                                 DevicePath);
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskRegisterCompressed(IN UINT64 RamDiskBase,
+                          IN UINT64 RamDiskSize,
+                          IN EFI_GUID *RamDiskType,
+                          IN EFI_DEVICE_PATH *ParentDevicePath OPTIONAL,
+                          OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    RAMDISK_EXTENT Extent = { RamDiskBase, RamDiskSize, 0 };
+    COMPRESSED_IMAGE *Compressed = NULL;
+
+    Compressed = (COMPRESSED_IMAGE *)AllocateZeroPool(sizeof(COMPRESSED_IMAGE));
+    if (NULL == Compressed) return EFI_OUT_OF_RESOURCES;
+
+    Status = CompressedImageOpen((VOID *)RamDiskBase, (UINTN)RamDiskSize, Compressed);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("\r\nThe ramdisk is not a valid compressed image (%u).", Status);
+        FreePool(Compressed);
+        return Status;
+    }
+
+    Status = RamDiskRegisterCommon(&Extent,
+                                   1,
+                                   RamDiskType,
+                                   ParentDevicePath,
+                                   RAMDISK_BACKING_COMPRESSED,
+                                   Compressed,
+                                   DevicePath);
+    if (EFI_ERROR(Status)) FreePool(Compressed);
+
+    return Status;
+}
+
+
+/* Free the pages of a range which was allocated with AllocatePages, from the base of its
+    allocation when that's known. Otherwise, a range starting partway into its first page
+    (after an MFTAH header) can't be told apart from its neighbours, so that page is kept. */
+STATIC
+EFI_STATUS
+RamDiskFreeRange(IN EFI_PHYSICAL_ADDRESS AllocationBase OPTIONAL,
+                 IN EFI_PHYSICAL_ADDRESS Start,
+                 IN UINT64 Size)
+{
+    EFI_PHYSICAL_ADDRESS First = (Start + EFI_PAGE_MASK) & ~((EFI_PHYSICAL_ADDRESS)EFI_PAGE_MASK);
+    EFI_PHYSICAL_ADDRESS End = (Start + Size + EFI_PAGE_MASK) & ~((EFI_PHYSICAL_ADDRESS)EFI_PAGE_MASK);
+
+    if (0 != AllocationBase) First = AllocationBase;
+
+    if (End <= First) return EFI_SUCCESS;
+
+    return BS->FreePages(First, (UINTN)((End - First) / EFI_PAGE_SIZE));
+}
+
+
+/**
+ * Decompress a compressed ramdisk into new reserved pages, and switch it over to be a
+ *  plain ramdisk backed by them. Written blocks are merged in, and everything which was
+ *  only needed for the compressed image is released. The installed device path is
+ *  replaced with one describing the new pages.
+ *
+ * @param[in]  PrivateData  Points to the private data of a compressed RAM disk.
+ *
+ * @retval EFI_SUCCESS           The disk was materialized and its NFIT entries added.
+ * @retval EFI_OUT_OF_RESOURCES  The decompressed disk doesn't fit in memory.
+ * @retval EFI_VOLUME_CORRUPTED  A frame failed to decompress.
+ */
+STATIC
+EFI_STATUS
+RamDiskMaterialize(IN RAMDISK_PRIVATE_DATA *PrivateData)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_PHYSICAL_ADDRESS Image = 0;
+    UINTN ImagePages = EFI_SIZE_TO_PAGES(PrivateData->Size);
+    COMPRESSED_IMAGE *Compressed = PrivateData->Compressed;
+    EFI_DEVICE_PATH_PROTOCOL *DevicePath = NULL, *Node = NULL;
+
+    Status = BS->AllocatePages(AllocateAnyPages,
+                               EfiReservedMemoryType,   /* the OS must keep the ramdisk intact */
+                               ImagePages,
+                               &Image);
+    if (EFI_ERROR(Status)) return EFI_OUT_OF_RESOURCES;
+
+    /* Decompress every frame straight to its final place, skipping the cache. */
+    Status = CompressedImageDecompress(Compressed, (VOID *)Image, NULL);
+    if (EFI_ERROR(Status)) {
+        BS->FreePages(Image, ImagePages);
+        return Status;
+    }
+
+    /* The ramdisk node of the installed device path describes the compressed image, so
+        it's replaced by one describing the new pages. Compressed disks only ever have a
+        single extent, so their last node is always a ramdisk node. */
+    DevicePath = DuplicateDevicePath(PrivateData->DevicePath);
+    if (NULL == DevicePath) {
+        BS->FreePages(Image, ImagePages);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    /* Written blocks supersede whatever the image held. */
+    for (UINTN i = 0; i < PrivateData->BlockMapLength; ++i) {
+        UINT64 BlockStart = ((UINT64)i * RAMDISK_MAPPED_BLOCK_SIZE);
+
+        if (0 == PrivateData->BlockMap[i]) continue;
+
+        CopyMem((VOID *)(Image + BlockStart),
+                (VOID *)PrivateData->BlockMap[i],
+                (UINTN)MIN(RAMDISK_MAPPED_BLOCK_SIZE, (PrivateData->Size - BlockStart)));
+
+        BS->FreePages(PrivateData->BlockMap[i], EFI_SIZE_TO_PAGES(RAMDISK_MAPPED_BLOCK_SIZE));
+    }
+
+    RamDiskFreeFrameCache(PrivateData);
+    FreePool(PrivateData->BlockMap);
+    FreePool(Compressed);
+
+    Status = RamDiskFreeRange(PrivateData->AllocationBase,
+                              PrivateData->Extents[0].StartingAddr,
+                              PrivateData->Extents[0].Size);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("WARNING: RAMDISK:  Failed to free the compressed image of ramdisk #%u (%u).",
+                     PrivateData->InstanceNumber, Status);
+    }
+
+    PrivateData->BlockMap         = NULL;
+    PrivateData->BlockMapLength   = 0;
+    PrivateData->BlockPagesLength = 0;
+    PrivateData->Compressed       = NULL;
+    PrivateData->FrameClock       = 0;
+
+    PrivateData->StartingAddr            = Image;
+    PrivateData->AllocationBase          = Image;
+    PrivateData->Extents[0].StartingAddr = Image;
+    PrivateData->Extents[0].Size         = PrivateData->Size;
+    PrivateData->Extents[0].Offset       = 0;
+    PrivateData->Backing                 = RAMDISK_BACKING_EXTENTS;
+
+    for (Node = DevicePath; !IsDevicePathEnd(NextDevicePathNode(Node)); Node = NextDevicePathNode(Node));
+    RamDiskInitDeviceNode(PrivateData, (MEDIA_RAMDISK_DEVICE_PATH *)Node);
+
+    Status = BS->ReinstallProtocolInterface(PrivateData->Handle,
+                                            &gEfiDevicePathProtocolGuid,
+                                            PrivateData->DevicePath,
+                                            DevicePath);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("WARNING: RAMDISK:  Failed to update the device path of ramdisk #%u (%u).",
+                     PrivateData->InstanceNumber, Status);
+        FreePool(DevicePath);
+    } else {
+        FreePool(PrivateData->DevicePath);
+        PrivateData->DevicePath = DevicePath;
+    }
+
+    DPRINTLN("Materialized compressed ramdisk #%u at %p (%u bytes).",
+             PrivateData->InstanceNumber, (VOID *)Image, PrivateData->Size);
+
+    return RamDiskPublishNfit(PrivateData);
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskMaterializeAll(VOID)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    BOOLEAN OwnsBatch = FALSE;
+
+    /* Publish all of the materialized disks with a single ACPI table update. */
+    if (FALSE == RamdiskBatchOpen) {
+        RamDiskBeginBatch();
+        OwnsBatch = TRUE;
+    }
+
+    for (RAMDISK_PRIVATE_DATA *p = RamdiskList; NULL != p; p = p->Next) {
+        if (RAMDISK_BACKING_COMPRESSED != p->Backing) continue;
+
+        Status = RamDiskMaterialize(p);
+        if (EFI_ERROR(Status)) {
+            EFI_DANGERLN("Failed to materialize compressed ramdisk #%u (%u).", p->InstanceNumber, Status);
+            break;
+        }
+    }
+
+    if (TRUE == OwnsBatch) {
+        if (EFI_ERROR(Status)) RamDiskCommitBatch();
+        else Status = RamDiskCommitBatch();
+    }
+
+    return Status;
+}
+
+
+VOID
+EFIAPI
+RamDiskBeginBatch(VOID)
+{
+    RamdiskBatchOpen = TRUE;
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskCommitBatch(VOID)
+{
+    EFI_ACPI_TABLE_PROTOCOL *ACPI = NULL;
+
+    if (FALSE == RamdiskBatchOpen) return EFI_NOT_STARTED;
+
+    RamdiskBatchOpen = FALSE;
+
+    /* Nothing was registered during the batch (or it's already published). */
+    if (
+        NULL == RamdiskNfit
+        || TRUE == RamdiskNfitInstalled
+        || sizeof(EFI_ACPI_SDT_NFIT) == RamdiskNfitLength
+    ) return EFI_SUCCESS;
+
+    ACPI = AcpiGetInstance();
+    if (NULL == ACPI) return EFI_NOT_FOUND;
+
+    return RamDiskInstallNfit(ACPI);
+}
+
+
+/**
+ * Copy out the running I/O counters of the ramdisk behind a statistics protocol instance.
+ *  The counters keep running; see `RamDiskStatsReset` to clear them.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskStatsGet(IN RAMDISK_STATS_PROTOCOL *This,
+                OUT RAMDISK_IO_STATISTICS *Statistics)
+{
+    if (NULL == This || NULL == Statistics) return EFI_INVALID_PARAMETER;
+
+    CopyMem(Statistics, &(RAM_DISK_PRIVATE_FROM_STATS(This)->Stats), sizeof(RAMDISK_IO_STATISTICS));
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskStatsReset(IN RAMDISK_STATS_PROTOCOL *This)
+{
+    if (NULL == This) return EFI_INVALID_PARAMETER;
+
+    SetMem(&(RAM_DISK_PRIVATE_FROM_STATS(This)->Stats), sizeof(RAMDISK_IO_STATISTICS), 0x00);
+
+    return EFI_SUCCESS;
+}
+
+
+VOID
+EFIAPI
+RamDiskDumpStatistics(VOID)
+{
+#if EFI_DEBUG==1
+    /* The heatmap is drawn with one character per slice, scaled to the busiest one. */
+    CHAR16 Heatmap[RAMDISK_STATS_HEATMAP_BUCKETS + 1] = {0};
+
+    for (RAMDISK_PRIVATE_DATA *p = RamdiskList; NULL != p; p = p->Next) {
+        RAMDISK_IO_STATISTICS *Stats = &(p->Stats);
+        UINT64 Busiest = 0;
+        UINT64 Ops = Stats->ReadOps + Stats->WriteOps;
+
+        for (UINTN i = 0; i < RAMDISK_STATS_HEATMAP_BUCKETS; ++i) Busiest = MAX(Busiest, Stats->Heatmap[i]);
+
+        for (UINTN i = 0; i < RAMDISK_STATS_HEATMAP_BUCKETS; ++i) {
+            Heatmap[i] = (0 == Stats->Heatmap[i])
+                ? L'.'
+                : (L'0' + (CHAR16)((Stats->Heatmap[i] * 9) / Busiest));
+        }
+
+        DPRINTLN("Ramdisk #%u: %lu reads (%lu bytes), %lu writes (%lu bytes), %lu cycles/op.",
+                 p->InstanceNumber,
+                 Stats->ReadOps, Stats->BytesRead,
+                 Stats->WriteOps, Stats->BytesWritten,
+                 (0 == Ops) ? 0 : (Stats->TotalCycles / Ops));
+        DPRINTLN("-- Heatmap: [%s]", Heatmap);
+
+        for (UINTN i = 0; i < RAMDISK_STATS_LATENCY_BUCKETS; ++i) {
+            if (0 == Stats->LatencyHistogram[i]) continue;
+
+            DPRINTLN("-- Under 2^%u cycles: %lu ops", (i + RAMDISK_STATS_LATENCY_SHIFT), Stats->LatencyHistogram[i]);
+        }
+    }
+#endif   /* #if EFI_DEBUG==1 */
+}
+
+
+/**
+ * Free all of the memory held by an unregistered ramdisk, including its private data.
+ *
+ * @param[in]  PrivateData  Points to the private data of a ramdisk no longer in use.
+ */
+STATIC
+VOID
+RamDiskReleaseMemory(IN RAMDISK_PRIVATE_DATA *PrivateData)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_PHYSICAL_ADDRESS Image = PrivateData->Extents[0].StartingAddr;
+    EFI_PHYSICAL_ADDRESS ImageEnd = Image + ((UINT64)PrivateData->SparseImagePages * EFI_PAGE_SIZE);
+
+    /* Pages allocated for writes. A sparse disk's kept blocks live in its packed image. */
+    for (UINTN i = 0; i < PrivateData->BlockMapLength; ++i) {
+        EFI_PHYSICAL_ADDRESS Page = PrivateData->BlockMap[i];
+
+        if (0 == Page || (Page >= Image && Page < ImageEnd)) continue;
+
+        BS->FreePages(Page, EFI_SIZE_TO_PAGES(RAMDISK_MAPPED_BLOCK_SIZE));
+    }
+
+    switch (PrivateData->Backing) {
+        case RAMDISK_BACKING_EXTENTS:
+            for (UINTN i = 0; i < PrivateData->ExtentsLength; ++i) {
+                Status = RamDiskFreeRange((0 == i) ? PrivateData->AllocationBase : 0,
+                                          PrivateData->Extents[i].StartingAddr,
+                                          PrivateData->Extents[i].Size);
+                if (EFI_ERROR(Status)) break;
+            }
+            break;
+
+        case RAMDISK_BACKING_SPARSE:
+            Status = RamDiskFreeRange(PrivateData->AllocationBase,
+                                      Image,
+                                      ((UINT64)PrivateData->SparseImagePages * EFI_PAGE_SIZE));
+            break;
+
+        case RAMDISK_BACKING_COMPRESSED:
+            Status = RamDiskFreeRange(PrivateData->AllocationBase, Image, PrivateData->Extents[0].Size);
+            RamDiskFreeFrameCache(PrivateData);
+            FreePool(PrivateData->Compressed);
+            break;
+
+        default:
+            /* An overlay's base image may be shared: it belongs to whoever loaded it. */
+            break;
+    }
+
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("WARNING: RAMDISK:  Failed to free the image of ramdisk #%u (%u).",
+                     PrivateData->InstanceNumber, Status);
+    }
+
+    if (NULL != PrivateData->BlockMap) FreePool(PrivateData->BlockMap);
+
+    FreePool(PrivateData->Extents);
+    FreePool(PrivateData->DevicePath);
+    FreePool(PrivateData);
+}
+
+
+/**
+ * Find the link in the list of registered ramdisks which points to the one with the
+ *  given device path.
+ *
+ * @param[in]  DevicePath  The device path returned when the ramdisk was registered.
+ *
+ * @returns The link to the ramdisk's private data, or NULL if it isn't registered.
+ */
+STATIC
+RAMDISK_PRIVATE_DATA **
+RamDiskFindLink(IN EFI_DEVICE_PATH_PROTOCOL *DevicePath)
+{
+    UINTN Size = DevicePathSize(DevicePath);
+
+    for (RAMDISK_PRIVATE_DATA **Link = &RamdiskList; NULL != *Link; Link = &((*Link)->Next)) {
+        if (
+            Size == DevicePathSize((*Link)->DevicePath)
+            && 0 == CompareMem((*Link)->DevicePath, DevicePath, Size)
+        ) return Link;
+    }
+
+    return NULL;
+}
+
+
+EFI_STATUS
+EFIAPI
+RamDiskAdoptAllocation(IN EFI_DEVICE_PATH_PROTOCOL *DevicePath,
+                       IN EFI_PHYSICAL_ADDRESS AllocationBase)
+{
+    RAMDISK_PRIVATE_DATA **Link = NULL;
+
+    if (NULL == DevicePath || 0 != (AllocationBase & EFI_PAGE_MASK)) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Link = RamDiskFindLink(DevicePath);
+    if (NULL == Link) {
+        return EFI_NOT_FOUND;
+    }
+
+    if (AllocationBase > (*Link)->Extents[0].StartingAddr) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    (*Link)->AllocationBase = AllocationBase;
+
+    return EFI_SUCCESS;
+}
+
+
+/**
+ * Detach a registered ramdisk and free everything it holds. Bound drivers are stopped
+ *  and its protocols uninstalled first; if that fails, they're reconnected and the disk
+ *  stays registered. Only then is it taken out of the list and the NFIT.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskUnregister(IN EFI_DEVICE_PATH_PROTOCOL *DevicePath)
+{
+    EFI_STATUS Status;
+    RAMDISK_PRIVATE_DATA *PrivateData = NULL;
+    RAMDISK_PRIVATE_DATA **Link = NULL;
+
+    if (NULL == DevicePath) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Link = RamDiskFindLink(DevicePath);
+    if (NULL == Link) {
+        return EFI_NOT_FOUND;
+    }
+
+    PrivateData = *Link;
+
+    /* Cached volume and file handles may be on this disk. They'd keep its file system
+        open (and point at freed memory afterwards), so they're all dropped first. */
+    FileCacheFlush();
+
+    /* Stop any drivers (partitions, file systems) still bound to the disk first. */
+    BS->DisconnectController(PrivateData->Handle, NULL, NULL);
+
+    Status = BS->UninstallMultipleProtocolInterfaces(
+        PrivateData->Handle,
+        &gEfiBlockIoProtocolGuid,
+        &PrivateData->BlockIo,
+        &gEfiBlockIo2ProtocolGuid,
+        &PrivateData->BlockIo2,
+        &gEfiDevicePathProtocolGuid,
+        PrivateData->DevicePath,
+        &gRamdiskStatsProtocolGuid,
+        &PrivateData->StatsProtocol,
+        NULL
+    );
+    if (EFI_ERROR(Status)) {
+        BS->ConnectController(PrivateData->Handle, NULL, NULL, TRUE);
+        return Status;
+    }
+
+    *Link = PrivateData->Next;
+
+    Status = RamDiskRemoveNfit(PrivateData);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("WARNING: RAMDISK:  Failed to remove ramdisk #%u from the NFIT (%u).",
+                     PrivateData->InstanceNumber, Status);
+    }
+
+    RamDiskReleaseMemory(PrivateData);
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+RamdiskDriverInit(IN EFI_HANDLE ImageHandle)
 {
     return BS->InstallMultipleProtocolInterfaces(
         &ImageHandle,
@@ -428,40 +1743,41 @@ RamDiskBlkIoReadBlocks(IN EFI_BLOCK_IO_PROTOCOL *This,
                        OUT VOID *Buffer)
 {
     RAMDISK_PRIVATE_DATA *PrivateData;
-    UINTN NumberOfBlocks;
+    EFI_STATUS Status;
+    UINT64 StartTsc = RamDiskReadTsc();
 
     PrivateData = RAM_DISK_PRIVATE_FROM_BLKIO(This);
 
-    if (MediaId != PrivateData->Media.MediaId) {
-        return EFI_MEDIA_CHANGED;
-    }
-
-    if (NULL == Buffer) {
-        return EFI_INVALID_PARAMETER;
-    }
-
-    if (0 == BufferSize) {
+    Status = RamDiskCheckTransfer(PrivateData, MediaId, Lba, BufferSize, Buffer, FALSE);
+    if (EFI_ABORTED == Status) {
         return EFI_SUCCESS;
+    } else if (EFI_ERROR(Status)) {
+        return Status;
     }
 
-    if ((BufferSize % PrivateData->Media.BlockSize) != 0) {
-        return EFI_BAD_BUFFER_SIZE;
-    }
-
-    if (Lba > PrivateData->Media.LastBlock) {
-        return EFI_INVALID_PARAMETER;
+    if (RAMDISK_BACKING_EXTENTS != PrivateData->Backing) {
+        Status = RamDiskCopyMapped(PrivateData,
+                                   MultU64x32(Lba, PrivateData->Media.BlockSize),
+                                   Buffer,
+                                   BufferSize,
+                                   FALSE);
+    } else {
+        RamDiskCopyBlocks(PrivateData,
+                          MultU64x32(Lba, PrivateData->Media.BlockSize),
+                          Buffer,
+                          BufferSize,
+                          FALSE);
     }
 
-    NumberOfBlocks = BufferSize / PrivateData->Media.BlockSize;
-    if ((Lba + NumberOfBlocks - 1) > PrivateData->Media.LastBlock) {
-        return EFI_INVALID_PARAMETER;
+    if (!EFI_ERROR(Status)) {
+        RamDiskRecordTransfer(PrivateData,
+                              MultU64x32(Lba, PrivateData->Media.BlockSize),
+                              BufferSize,
+                              FALSE,
+                              StartTsc);
     }
 
-    CopyMem(Buffer,
-            (VOID *)(UINTN)(PrivateData->StartingAddr + MultU64x32(Lba, PrivateData->Media.BlockSize)),
-            BufferSize);
-
-    return EFI_SUCCESS;
+    return Status;
 }
 
 
@@ -474,44 +1790,41 @@ RamDiskBlkIoWriteBlocks(IN EFI_BLOCK_IO_PROTOCOL *This,
                         IN VOID *Buffer)
 {
     RAMDISK_PRIVATE_DATA *PrivateData;
-    UINTN NumberOfBlocks;
+    EFI_STATUS Status;
+    UINT64 StartTsc = RamDiskReadTsc();
 
     PrivateData = RAM_DISK_PRIVATE_FROM_BLKIO (This);
 
-    if (MediaId != PrivateData->Media.MediaId) {
-        return EFI_MEDIA_CHANGED;
-    }
-
-    if (TRUE == PrivateData->Media.ReadOnly) {
-        return EFI_WRITE_PROTECTED;
-    }
-
-    if (NULL == Buffer) {
-        return EFI_INVALID_PARAMETER;
-    }
-
-    if (0 == BufferSize) {
+    Status = RamDiskCheckTransfer(PrivateData, MediaId, Lba, BufferSize, Buffer, TRUE);
+    if (EFI_ABORTED == Status) {
         return EFI_SUCCESS;
+    } else if (EFI_ERROR(Status)) {
+        return Status;
     }
 
-    if ((BufferSize % PrivateData->Media.BlockSize) != 0) {
-        return EFI_BAD_BUFFER_SIZE;
-    }
-
-    if (Lba > PrivateData->Media.LastBlock) {
-        return EFI_INVALID_PARAMETER;
+    if (RAMDISK_BACKING_EXTENTS != PrivateData->Backing) {
+        Status = RamDiskCopyMapped(PrivateData,
+                                   MultU64x32(Lba, PrivateData->Media.BlockSize),
+                                   Buffer,
+                                   BufferSize,
+                                   TRUE);
+    } else {
+        RamDiskCopyBlocks(PrivateData,
+                          MultU64x32(Lba, PrivateData->Media.BlockSize),
+                          Buffer,
+                          BufferSize,
+                          TRUE);
     }
 
-    NumberOfBlocks = BufferSize / PrivateData->Media.BlockSize;
-    if ((Lba + NumberOfBlocks - 1) > PrivateData->Media.LastBlock) {
-        return EFI_INVALID_PARAMETER;
+    if (!EFI_ERROR(Status)) {
+        RamDiskRecordTransfer(PrivateData,
+                              MultU64x32(Lba, PrivateData->Media.BlockSize),
+                              BufferSize,
+                              TRUE,
+                              StartTsc);
     }
 
-    CopyMem((VOID *)(UINTN)(PrivateData->StartingAddr + MultU64x32(Lba, PrivateData->Media.BlockSize)),
-            Buffer,
-            BufferSize);
-
-    return EFI_SUCCESS;
+    return Status;
 }
 
 
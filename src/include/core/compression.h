@@ -0,0 +1,183 @@
+#ifndef MFTAH_COMPRESSION_H
+#define MFTAH_COMPRESSION_H
+
+#include "../mftah_uefi.h"
+
+
+
+/* Compressed images begin with this 8-byte signature. */
+#define COMPRESSED_IMAGE_SIGNATURE      "MFTAHLZ4"
+#define COMPRESSED_IMAGE_VERSION        1
+
+/* The accepted range of uncompressed bytes per frame. Must be a power of two. */
+#define COMPRESSED_IMAGE_MIN_FRAME_SIZE (1 << 16)
+#define COMPRESSED_IMAGE_MAX_FRAME_SIZE (1 << 20)
+
+/* The most APs a single image is spread across while decompressing it whole. */
+#define COMPRESSED_IMAGE_MAX_WORKERS    32
+
+
+/**
+ * The header of a compressed image. It's immediately followed by an index of
+ *  `FramesCount + 1` UINT64 offsets (from the start of the image): frame `i` spans
+ *  from offset `i` up to offset `i + 1`. Each frame is an independent LZ4 block which
+ *  decompresses to `FrameSize` bytes (the last one can be shorter). A frame whose
+ *  stored length equals its uncompressed length is stored as-is.
+ */
+typedef
+struct {
+    UINT8   Signature[8];
+    UINT32  Version;
+    UINT32  FrameSize;
+    UINT64  UncompressedSize;
+    UINT64  FramesCount;
+} __attribute__((packed)) COMPRESSED_IMAGE_HEADER;
+
+/**
+ * A validated compressed image in memory.
+ */
+typedef
+struct {
+    CONST UINT8     *Base;
+    UINTN           Size;
+    UINTN           FrameSize;
+    UINT64          UncompressedSize;
+    UINTN           FramesCount;
+    CONST UINT64    *FrameOffsets;
+} COMPRESSED_IMAGE;
+
+
+
+/**
+ * Decompress a single raw LZ4 block. Every length and match offset is checked, so a
+ *  malformed block can never read or write outside of the given buffers.
+ *
+ * @param[in]   Source              The compressed block.
+ * @param[in]   SourceLength        The length of the compressed block.
+ * @param[out]  Destination         Where to write the decompressed data.
+ * @param[in]   DestinationLength   The capacity of the destination.
+ * @param[out]  Written             Set to the amount of bytes decompressed.
+ *
+ * @retval  EFI_SUCCESS             The block was decompressed.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL.
+ * @retval  EFI_VOLUME_CORRUPTED    The block is malformed or doesn't fit the destination.
+ */
+EFI_STATUS
+EFIAPI
+Lz4DecompressBlock(
+    IN  CONST VOID  *Source,
+    IN  UINTN       SourceLength,
+    OUT VOID        *Destination,
+    IN  UINTN       DestinationLength,
+    OUT UINTN       *Written
+);
+
+
+/**
+ * Validate the header and frame index of a compressed image.
+ *
+ * @param[in]   Image       The start of the compressed image.
+ * @param[in]   ImageSize   The length of the compressed image.
+ * @param[out]  Parsed      Describes the image on success.
+ *
+ * @retval  EFI_SUCCESS             The image is valid.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL.
+ * @retval  EFI_UNSUPPORTED         The signature, version, or frame size is not supported.
+ * @retval  EFI_VOLUME_CORRUPTED    The frame index is inconsistent or out of bounds.
+ */
+EFI_STATUS
+EFIAPI
+CompressedImageOpen(
+    IN  CONST VOID          *Image,
+    IN  UINTN               ImageSize,
+    OUT COMPRESSED_IMAGE    *Parsed
+);
+
+
+/**
+ * Get the uncompressed length of a frame.
+ *
+ * @param[in]   Image       A validated compressed image.
+ * @param[in]   FrameIndex  The frame to measure.
+ *
+ * @returns The uncompressed length, or 0 if the frame does not exist.
+ */
+UINTN
+EFIAPI
+CompressedImageFrameLength(
+    IN CONST COMPRESSED_IMAGE   *Image,
+    IN UINTN                    FrameIndex
+);
+
+
+/**
+ * Decompress a whole frame of an image.
+ *
+ * @param[in]   Image       A validated compressed image.
+ * @param[in]   FrameIndex  The frame to decompress.
+ * @param[out]  Destination Receives the frame. Must hold `CompressedImageFrameLength` bytes.
+ *
+ * @retval  EFI_SUCCESS             The frame was decompressed.
+ * @retval  EFI_INVALID_PARAMETER   The frame does not exist.
+ * @retval  EFI_VOLUME_CORRUPTED    The frame is malformed or decompressed to the wrong length.
+ */
+EFI_STATUS
+EFIAPI
+CompressedImageReadFrame(
+    IN  CONST COMPRESSED_IMAGE  *Image,
+    IN  UINTN                   FrameIndex,
+    OUT VOID                    *Destination
+);
+
+
+/**
+ * Decompress a run of consecutive frames, spread across APs in the same way as a whole
+ *  image. The frames are written back to back, starting with `FirstFrame` at `Destination`.
+ *
+ * @param[in]   Image           A validated compressed image.
+ * @param[in]   FirstFrame      The index of the first frame of the run.
+ * @param[in]   FramesCount     How many frames the run spans.
+ * @param[out]  Destination     Receives the run. Must hold all of its frames.
+ * @param[in]   ProgressHook    Optionally called by the BSP with the frames done so far.
+ *
+ * @retval  EFI_SUCCESS             The run was decompressed.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL, or the run is empty or out of range.
+ * @retval  EFI_OUT_OF_RESOURCES    The worker contexts could not be allocated.
+ * @retval  EFI_VOLUME_CORRUPTED    A frame is malformed.
+ */
+EFI_STATUS
+EFIAPI
+CompressedImageDecompressFrames(
+    IN  CONST COMPRESSED_IMAGE  *Image,
+    IN  UINTN                   FirstFrame,
+    IN  UINTN                   FramesCount,
+    OUT VOID                    *Destination,
+    IN  PROGRESS_UPDATE_HOOK    ProgressHook    OPTIONAL
+);
+
+
+/**
+ * Decompress a whole image into a single buffer. Each frame is written straight to its
+ *  final place, so no intermediate copies are made. When threading is enabled, runs of
+ *  frames are handed out to APs, and the BSP works on its own run before waiting on them.
+ *
+ * @param[in]   Image           A validated compressed image.
+ * @param[out]  Destination     Receives the image. Must hold `UncompressedSize` bytes.
+ * @param[in]   ProgressHook    Optionally called by the BSP with the frames done so far.
+ *
+ * @retval  EFI_SUCCESS             The image was decompressed.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL.
+ * @retval  EFI_OUT_OF_RESOURCES    The worker contexts could not be allocated.
+ * @retval  EFI_VOLUME_CORRUPTED    A frame is malformed.
+ */
+EFI_STATUS
+EFIAPI
+CompressedImageDecompress(
+    IN  CONST COMPRESSED_IMAGE  *Image,
+    OUT VOID                    *Destination,
+    IN  PROGRESS_UPDATE_HOOK    ProgressHook OPTIONAL
+);
+
+
+
+#endif   /* MFTAH_COMPRESSION_H */
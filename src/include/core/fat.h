@@ -0,0 +1,153 @@
+#ifndef MFTAH_FAT_H
+#define MFTAH_FAT_H
+
+#include "../mftah_uefi.h"
+
+
+
+/* Directory entry attributes. A long name entry sets all of the lowest four. */
+#define FAT_ATTRIBUTE_READ_ONLY         0x01
+#define FAT_ATTRIBUTE_HIDDEN            0x02
+#define FAT_ATTRIBUTE_SYSTEM            0x04
+#define FAT_ATTRIBUTE_VOLUME_ID         0x08
+#define FAT_ATTRIBUTE_DIRECTORY         0x10
+#define FAT_ATTRIBUTE_ARCHIVE           0x20
+#define FAT_ATTRIBUTE_LONG_NAME         0x0F
+#define FAT_ATTRIBUTE_LONG_NAME_MASK    0x3F
+
+/* A long name is spread across at most 20 entries of 13 UCS-2 characters each. */
+#define FAT_LONG_NAME_ENTRY_CHARS       13
+#define FAT_MAX_LONG_NAME_ENTRIES       20
+#define FAT_MAX_LONG_NAME               255
+
+/* Volumes with fewer clusters than these are FAT12 and FAT16 respectively. */
+#define FAT12_MAX_CLUSTERS              4084
+#define FAT16_MAX_CLUSTERS              65524
+
+
+/**
+ * The BIOS Parameter Block at the start of every FAT volume. The fields after
+ *  `TotalSectors32` are only meaningful on FAT32 volumes.
+ */
+typedef
+struct {
+    UINT8   JumpBoot[3];
+    UINT8   OemName[8];
+    UINT16  BytesPerSector;
+    UINT8   SectorsPerCluster;
+    UINT16  ReservedSectors;
+    UINT8   NumberOfFats;
+    UINT16  RootEntries;
+    UINT16  TotalSectors16;
+    UINT8   Media;
+    UINT16  SectorsPerFat16;
+    UINT16  SectorsPerTrack;
+    UINT16  NumberOfHeads;
+    UINT32  HiddenSectors;
+    UINT32  TotalSectors32;
+    UINT32  SectorsPerFat32;
+    UINT16  ExtendedFlags;
+    UINT16  FsVersion;
+    UINT32  RootCluster;
+} __attribute__((packed)) FAT_BOOT_SECTOR;
+
+/**
+ * A short (8.3) directory entry.
+ */
+typedef
+struct {
+    UINT8   Name[11];
+    UINT8   Attributes;
+    UINT8   NtReserved;
+    UINT8   CreateTimeTenths;
+    UINT16  CreateTime;
+    UINT16  CreateDate;
+    UINT16  AccessDate;
+    UINT16  FirstClusterHigh;
+    UINT16  WriteTime;
+    UINT16  WriteDate;
+    UINT16  FirstClusterLow;
+    UINT32  FileSize;
+} __attribute__((packed)) FAT_DIRECTORY_ENTRY;
+
+/**
+ * A long name directory entry. These precede the short entry they name, last part first.
+ */
+typedef
+struct {
+    UINT8   Order;
+    UINT16  Name1[5];
+    UINT8   Attributes;
+    UINT8   Type;
+    UINT8   Checksum;
+    UINT16  Name2[6];
+    UINT16  FirstClusterLow;
+    UINT16  Name3[2];
+} __attribute__((packed)) FAT_LONG_NAME_ENTRY;
+
+/**
+ * A single partition record of a classic MBR.
+ */
+typedef
+struct {
+    UINT8   BootIndicator;
+    UINT8   StartingChs[3];
+    UINT8   OsType;
+    UINT8   EndingChs[3];
+    UINT32  StartingLba;
+    UINT32  SizeInLba;
+} __attribute__((packed)) FAT_MBR_PARTITION;
+
+/**
+ * The fields of a GPT header which are needed to walk its partition entries.
+ */
+typedef
+struct {
+    UINT8   Signature[8];
+    UINT32  Revision;
+    UINT32  HeaderSize;
+    UINT32  HeaderCrc32;
+    UINT32  Reserved;
+    UINT64  MyLba;
+    UINT64  AlternateLba;
+    UINT64  FirstUsableLba;
+    UINT64  LastUsableLba;
+    EFI_GUID DiskGuid;
+    UINT64  PartitionEntryLba;
+    UINT32  NumberOfPartitionEntries;
+    UINT32  SizeOfPartitionEntry;
+} __attribute__((packed)) FAT_GPT_HEADER;
+
+
+
+/**
+ * Find a file inside of an in-memory disk image by walking its FAT16 or FAT32 directories
+ *  and cluster chains directly. The image can be a bare volume, or carry an MBR or GPT, in
+ *  which case every partition is searched in order. Nothing is copied: when the file's
+ *  clusters are contiguous, its address inside of the image is returned.
+ *
+ * @param[in]   Disk        The start of the disk image.
+ * @param[in]   DiskSize    The length of the disk image.
+ * @param[in]   Path        The file's path. Either separator is accepted and names are case-insensitive.
+ * @param[out]  FileBase    Set to the address of the file's contents inside of the image.
+ * @param[out]  FileSize    Set to the length of the file.
+ *
+ * @retval  EFI_SUCCESS             The file was found and is contiguous.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL.
+ * @retval  EFI_UNSUPPORTED         No FAT16/32 volume was found, or the file is empty or fragmented.
+ * @retval  EFI_NOT_FOUND           The path does not name a file on any volume.
+ * @retval  EFI_VOLUME_CORRUPTED    A directory or cluster chain points outside of its volume.
+ */
+EFI_STATUS
+EFIAPI
+FatLocateContiguousFile(
+    IN  CONST VOID              *Disk,
+    IN  UINT64                  DiskSize,
+    IN  CONST CHAR8             *Path,
+    OUT EFI_PHYSICAL_ADDRESS    *FileBase,
+    OUT UINT64                  *FileSize
+);
+
+
+
+#endif   /* MFTAH_FAT_H */
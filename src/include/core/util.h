@@ -88,6 +88,47 @@ ReadFile(
 );
 
 
+/**
+ * Read an exact byte range of a file into an existing buffer. Unlike `ReadFile`, which
+ *  always reads through to the end of the file, this stops after `Length` bytes.
+ *
+ * @param[in]   DeviceHandle    The SFS device handle (NOT a Loaded Image handle) the file resides on.
+ * @param[in]   Filename        A full path to a file on-disk.
+ * @param[in]   Offset          The byte offset within the file to start reading from.
+ * @param[in]   Length          The amount of bytes to read.
+ * @param[out]  Buffer          A caller-allocated destination of at least `Length` bytes.
+ * @param[in]   ProgressHook    An optional function that can report occasional progress details.
+ *
+ * @retval  EFI_SUCCESS             The whole range was read into the buffer.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL.
+ * @retval  EFI_END_OF_FILE         The range extends beyond the end of the file.
+ * @returns Any error from opening or reading the file.
+ */
+EFI_STATUS
+EFIAPI
+ReadFileRange(
+    IN  EFI_HANDLE              DeviceHandle,
+    IN  CONST CHAR16            *Filename,
+    IN  UINTN                   Offset,
+    IN  UINTN                   Length,
+    OUT VOID                    *Buffer,
+    IN  PROGRESS_UPDATE_HOOK    ProgressHook    OPTIONAL
+);
+
+
+/**
+ * Close all volume roots and file handles opened by the file helpers above, and
+ *  forget any cached volume labels and file sizes. Calls to `FileSizeFromPath`,
+ *  `ReadFile`, and `GetFileSystemHandleByVolumeName` keep their handles open so
+ *  that repeated accesses to the same volume or file are cheap.
+ *
+ * @returns Nothing.
+ */
+VOID
+EFIAPI
+FileCacheFlush(VOID);
+
+
 /**
  * Attempt to locate a simple filesystem by its label name.
  * 
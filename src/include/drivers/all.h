@@ -2,6 +2,7 @@
 #include "nfit.h"
 #include "config.h"
 #include "ramdisk.h"
+#include "initrd.h"
 #include "threading.h"
 #include "mftah_adapter.h"
 #include "displays.h"
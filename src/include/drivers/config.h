@@ -12,6 +12,9 @@
 /* Maximum amount of data ramdisks to load per chain. */
 #define MAX_DATA_RAMDISKS_PER_CHAIN     8
 
+/* Maximum amount of extra Multiboot2 modules to load per chain. */
+#define MAX_MODULES_PER_CHAIN           8
+
 
 /* Possible chainload types available with MFTAH. */
 typedef
@@ -24,6 +27,8 @@ enum {
     ELF     = (1 << 3),
     /* A raw binary image to transfer control to directly. */
     BIN     = (1 << 4),
+    /* A unified kernel image: a PE carrying the kernel, its initrd, and its command line. */
+    UKI     = (1 << 5),
 } CHAIN_TYPE;
 
 typedef
@@ -31,10 +36,21 @@ struct {
     BOOLEAN         IsMFTAH;
     BOOLEAN         IsCompressed;
     BOOLEAN         IsRequired;
+    BOOLEAN         IsPersistent;   /* Exposed to the OS as persistent memory (DAX-capable). */
+    BOOLEAN         IsOverlay;   /* A copy-on-write view; identical images share one copy. */
+    BOOLEAN         IsSparse;   /* All-zero blocks are dropped from memory once loaded. */
+    BOOLEAN         IsInitrd;   /* Served to a Linux EFI stub as its initrd, not as a disk. */
     CHAR8           *MFTAHKey;
     CHAR8           *Path;
 } DATA_RAMDISK;
 
+/* An extra file handed to a Multiboot2 kernel as a module, right where it was loaded. */
+typedef
+struct {
+    CHAR8           *Path;
+    CHAR8           *CmdLine;   /* The module's string. Defaults to its path. */
+} CHAIN_MODULE;
+
 /* Options representing a config 'chain' block. */
 typedef
 struct {
@@ -44,6 +60,8 @@ struct {
     CHAR8           *TargetPath;   /* Inner EFI to chainload (for MFTAH_DISK types). */
     CHAR8           *MFTAHKey;   /* Prefilled password (or filled by prompt). */
     CHAR8           *CmdLine;   /* Passed to loaded EFI images during LoadImage or given directly otherwise. */
+    EFI_PHYSICAL_ADDRESS    LoadAddress;   /* Where a BIN payload is placed. 0 runs it wherever it's loaded. */
+    UINT64          EntryOffset;   /* Offset of a BIN payload's entrypoint from its load address. */
     CHAIN_TYPE      Type;
     CHAIN_TYPE      SubType;
     BOOLEAN         IsMFTAH;
@@ -52,6 +70,8 @@ struct {
     BOOLEAN         IsDefault;
     DATA_RAMDISK    *DataRamdisks[MAX_DATA_RAMDISKS_PER_CHAIN];
     UINT8           DataRamdisksLength;
+    CHAIN_MODULE    *Modules[MAX_MODULES_PER_CHAIN];
+    UINT8           ModulesLength;
 } CONFIG_CHAIN_BLOCK;
 
 typedef
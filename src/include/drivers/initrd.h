@@ -0,0 +1,68 @@
+#ifndef MFTAH_INITRD_H
+#define MFTAH_INITRD_H
+
+#include "../mftah_uefi.h"
+
+
+/* The vendor media device path which Linux EFI stub kernels look up to find their initrd. */
+#define LINUX_EFI_INITRD_MEDIA_GUID \
+    { 0x5568e427, 0x68fc, 0x4f3d, { 0xac, 0x74, 0xca, 0x55, 0x52, 0x31, 0xcc, 0x68 } }
+
+#define INITRD_LOAD_FILE2_PROTOCOL_GUID \
+    { 0x4006c0c1, 0xfcb3, 0x403e, { 0x99, 0x6d, 0x4a, 0x6c, 0x87, 0x24, 0xe0, 0x6d } }
+
+
+/* Load File 2 Protocol Declarations & Types */
+typedef
+struct S_INITRD_LOAD_FILE2_PROTOCOL
+INITRD_LOAD_FILE2_PROTOCOL;
+
+typedef
+EFI_STATUS
+(EFIAPI *INITRD_LOAD_FILE2)(
+    IN      INITRD_LOAD_FILE2_PROTOCOL  *This,
+    IN      EFI_DEVICE_PATH_PROTOCOL    *FilePath,
+    IN      BOOLEAN                     BootPolicy,
+    IN OUT  UINTN                       *BufferSize,
+    IN      VOID                        *Buffer     OPTIONAL
+);
+
+struct S_INITRD_LOAD_FILE2_PROTOCOL {
+    INITRD_LOAD_FILE2   LoadFile;
+};
+
+#pragma pack(push, 1)
+typedef
+struct __attribute__((packed)) {
+    VENDOR_DEVICE_PATH          Vendor;
+    EFI_DEVICE_PATH_PROTOCOL    End;
+} INITRD_DEVICE_PATH;
+#pragma pack(pop)
+/*************************************/
+
+
+
+/**
+ * Serve a loaded initrd to a Linux EFI stub kernel. A Load File 2 protocol is installed
+ *  on the initrd media device path, and the stub's single read copies the initrd straight
+ *  from memory to wherever it chooses, with no filesystem in between. The buffer must stay
+ *  valid until the kernel is started.
+ *
+ * @param[in]   Initrd      The initrd's contents.
+ * @param[in]   Length      The length of the initrd.
+ *
+ * @retval  EFI_SUCCESS             The initrd is being served.
+ * @retval  EFI_INVALID_PARAMETER   The initrd is NULL or empty.
+ * @retval  EFI_ALREADY_STARTED     Another initrd is already being served.
+ * @returns Any error from installing the protocol interfaces.
+ */
+EFI_STATUS
+EFIAPI
+InitrdInstall(
+    IN CONST VOID   *Initrd,
+    IN UINTN        Length
+);
+
+
+
+#endif   /* MFTAH_INITRD_H */
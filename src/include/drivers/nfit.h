@@ -25,6 +25,16 @@
 #define NFIT_SPA_FLAG_PROXIMITY_DOMAIN_VALID    (1 << 1)
 #define NFIT_SPA_FLAG_LOCATION_COOKIE_VALID     (1 << 2)
 
+/* Memory mapping attributes of an SPA range, using the UEFI memory attribute bits. */
+#define NFIT_SPA_MAPPING_WB                     0x0000000000000008ULL
+#define NFIT_SPA_MAPPING_NV                     0x0000000000008000ULL
+
+/* Region Mapping NVDIMM state flags. Set bits indicate a problem with the region. */
+#define NFIT_MAPPING_FLAG_SAVE_FAILED           (1 << 0)
+#define NFIT_MAPPING_FLAG_RESTORE_FAILED        (1 << 1)
+#define NFIT_MAPPING_FLAG_FLUSH_FAILED          (1 << 2)
+#define NFIT_MAPPING_FLAG_NOT_ARMED             (1 << 3)
+
 #define NFIT_SPA_GUID_PERSISTENT_MEMORY     \
     { 0x66F0D379, 0xB4F3, 0x4074, { 0xAC, 0x43, 0x0D, 0x33, 0x18, 0xB7, 0x8C, 0xDB } }
 #define NFIT_SPA_GUID_NVD_CONTROL_REGION    \
@@ -62,5 +72,52 @@ struct {
 } __attribute__((packed)) EFI_ACPI_NFIT_SPA_STRUCTURE;
 
 
+/* Describes which NVDIMM (by its NFIT Device Handle) backs which part of an SPA range. */
+typedef
+struct {
+    UINT16      Type;
+    UINT16      Length;
+    UINT32      NfitDeviceHandle;
+    UINT16      NvdimmPhysicalId;
+    UINT16      NvdimmRegionId;
+    UINT16      SpaRangeStructureIndex;
+    UINT16      NvdimmControlRegionStructureIndex;
+    UINT64      NvdimmRegionSize;
+    UINT64      RegionOffset;
+    UINT64      NvdimmPhysicalAddressRegionBase;
+    UINT16      InterleaveStructureIndex;
+    UINT16      InterleaveWays;
+    UINT16      NvdimmStateFlags;
+    UINT16      Reserved;
+} __attribute__((packed)) EFI_ACPI_NFIT_REGION_MAPPING_STRUCTURE;
+
+/* Identifies an NVDIMM. Without block control windows, the trailing fields are all zero. */
+typedef
+struct {
+    UINT16      Type;
+    UINT16      Length;
+    UINT16      NvdimmControlRegionStructureIndex;
+    UINT16      VendorId;
+    UINT16      DeviceId;
+    UINT16      RevisionId;
+    UINT16      SubsystemVendorId;
+    UINT16      SubsystemDeviceId;
+    UINT16      SubsystemRevisionId;
+    UINT8       ValidFields;
+    UINT8       ManufacturingLocation;
+    UINT16      ManufacturingDate;
+    UINT8       Reserved[2];
+    UINT32      SerialNumber;
+    UINT16      RegionFormatInterfaceCode;
+    UINT16      NumberOfBlockControlWindows;
+    UINT64      SizeOfBlockControlWindow;
+    UINT64      CommandRegisterOffsetInBlockControlWindow;
+    UINT64      SizeOfCommandRegisterInBlockControlWindows;
+    UINT64      StatusRegisterOffsetInBlockControlWindow;
+    UINT64      SizeOfStatusRegisterInBlockControlWindows;
+    UINT16      BlockControlWindowFlag;
+    UINT8       Reserved1[6];
+} __attribute__((packed)) EFI_ACPI_NFIT_CONTROL_REGION_STRUCTURE;
+
 
 #endif   /* NFIT_H */
@@ -10,6 +10,8 @@
 
 #include "../mftah_uefi.h"
 
+#include "../core/compression.h"
+
 
 #ifndef RAM_DISK_BLOCK_SIZE
 #   define RAM_DISK_BLOCK_SIZE 512
@@ -17,6 +19,17 @@
 
 #define MEDIA_RAM_DISK_DP 0x09
 
+/* The granularity of block-mapped ramdisks (copy-on-write overlays and sparse disks).
+    The first write to any unmapped block of this size gives it its own page. */
+#define RAMDISK_MAPPED_BLOCK_SIZE   EFI_PAGE_SIZE
+
+/* How many decompressed frames each compressed ramdisk keeps around for reads. */
+#define RAMDISK_FRAME_CACHE_LENGTH  8
+
+/* Copies of at least this many bytes use non-temporal stores. Anything this large would
+    only evict the rest of the cache on its way through. */
+#define RAMDISK_STREAM_COPY_MIN_SIZE    (256 << 10)
+
 /* Taken from UEFI spec: https://uefi.org/specs/UEFI/2.10/13_Protocols_Media_Access.html#ram-disk-protocol */
 #define EFI_RAM_DISK_PROTOCOL_GUID \
     { 0xab38a0df, 0x6873, 0x44a9, \
@@ -38,6 +51,16 @@
     { 0x08018188, 0x42CD, 0xBB48, \
     { 0x10, 0x0F, 0x53, 0x87, 0xD5, 0x3D, 0xED, 0x3D }}
 
+/* The I/O statistics protocol of a ramdisk. */
+#define RAMDISK_STATS_PROTOCOL_GUID \
+    { 0xc3b003f5, 0xc008, 0x4c68, \
+    { 0xa8, 0x33, 0x21, 0x93, 0x67, 0x29, 0x2b, 0xc9 }}
+
+/* Vendor device path node of a ramdisk spread across several extents. */
+#define RAMDISK_EXTENTS_DEVICE_PATH_GUID \
+    { 0x748f75d4, 0xe514, 0x4127, \
+    { 0xba, 0xfa, 0x60, 0x00, 0x72, 0xea, 0x74, 0x66 }}
+
 
 #define RAMDISK_PRIVATE_DATA_SIGNATURE \
     EFI_SIGNATURE_32 ('R', 'D', 'S', 'K')
@@ -46,6 +69,15 @@
     CR(a, RAMDISK_PRIVATE_DATA, BlockIo, RAMDISK_PRIVATE_DATA_SIGNATURE)
 #define RAM_DISK_PRIVATE_FROM_BLKIO2(a) \
     CR(a, RAMDISK_PRIVATE_DATA, BlockIo2, RAMDISK_PRIVATE_DATA_SIGNATURE)
+#define RAM_DISK_PRIVATE_FROM_STATS(a) \
+    CR(a, RAMDISK_PRIVATE_DATA, StatsProtocol, RAMDISK_PRIVATE_DATA_SIGNATURE)
+
+/* I/O statistics kept for each ramdisk. The heatmap splits the disk into equal slices,
+    and latency bucket `i` counts transfers taking fewer than 2^(i + 8) TSC cycles. */
+#define RAMDISK_STATS_PROTOCOL_REVISION 0x00010000
+#define RAMDISK_STATS_HEATMAP_BUCKETS   64
+#define RAMDISK_STATS_LATENCY_BUCKETS   24
+#define RAMDISK_STATS_LATENCY_SHIFT     8
 
 
 typedef
@@ -64,10 +96,61 @@ EFI_STATUS
     IN EFI_DEVICE_PATH_PROTOCOL             *DevicePath
 );
 
+
+/**
+ * One physically-contiguous piece of a ramdisk. `Offset` is the byte offset of the
+ *  extent within the disk itself and is filled in by the driver upon registration.
+ */
+typedef
+struct {
+    UINT64  StartingAddr;
+    UINT64  Size;
+    UINT64  Offset;
+} RAMDISK_EXTENT;
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_RAM_DISK_REGISTER_RAMDISK_EXTENTS) (
+    IN RAMDISK_EXTENT                       *Extents,
+    IN UINTN                                ExtentsLength,
+    IN EFI_GUID                             *RamDiskType,
+    IN EFI_DEVICE_PATH                      *ParentDevicePath OPTIONAL,
+    OUT EFI_DEVICE_PATH_PROTOCOL            **DevicePath
+);
+
+typedef
+VOID
+(EFIAPI *EFI_RAM_DISK_BEGIN_BATCH) (VOID);
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_RAM_DISK_COMMIT_BATCH) (VOID);
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_RAM_DISK_MATERIALIZE_ALL) (VOID);
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_RAM_DISK_ADOPT_ALLOCATION) (
+    IN EFI_DEVICE_PATH_PROTOCOL             *DevicePath,
+    IN EFI_PHYSICAL_ADDRESS                 AllocationBase
+);
+
+/* NOTE: Members after `Unregister` are extensions. The first two members keep the layout
+    of the UEFI specification's protocol, so other consumers of the GUID are unaffected. */
 typedef
 struct {
     EFI_RAM_DISK_REGISTER_RAMDISK           Register;
     EFI_RAM_DISK_UNREGISTER_RAMDISK         Unregister;
+    EFI_RAM_DISK_REGISTER_RAMDISK_EXTENTS   RegisterExtents;
+    EFI_RAM_DISK_BEGIN_BATCH                BeginBatch;
+    EFI_RAM_DISK_COMMIT_BATCH               CommitBatch;
+    EFI_RAM_DISK_REGISTER_RAMDISK_EXTENTS   RegisterOverlay;
+    EFI_RAM_DISK_REGISTER_RAMDISK           RegisterSparse;
+    EFI_RAM_DISK_REGISTER_RAMDISK           RegisterCompressed;
+    EFI_RAM_DISK_MATERIALIZE_ALL            MaterializeAll;
+    EFI_RAM_DISK_ADOPT_ALLOCATION           AdoptAllocation;
 } EFI_RAM_DISK_PROTOCOL;
 
 // TODO! Spread this compliant packing method to other places where it's required.
@@ -81,10 +164,77 @@ struct __attribute__((packed)) {
     EFI_GUID                    TypeGuid;
     UINT16                      Instance;
 } MEDIA_RAMDISK_DEVICE_PATH;
+
+/* A RAM disk node can only describe one contiguous range of memory, so a scattered
+    disk is named by its instance number under a vendor node instead. */
+typedef
+struct __attribute__((packed)) {
+    VENDOR_DEVICE_PATH          Vendor;
+    UINT16                      Instance;
+} RAMDISK_EXTENTS_DEVICE_PATH;
 #pragma pack(pop)
 
+/**
+ * Running I/O counters of a single ramdisk, covering every Block IO and Block IO 2
+ *  transfer since it was registered (or last reset).
+ */
 typedef
 struct {
+    UINT64  ReadOps;
+    UINT64  WriteOps;
+    UINT64  BytesRead;
+    UINT64  BytesWritten;
+    UINT64  Heatmap[RAMDISK_STATS_HEATMAP_BUCKETS];   /* bytes moved in each slice */
+    UINT64  LatencyHistogram[RAMDISK_STATS_LATENCY_BUCKETS];
+    UINT64  TotalCycles;
+} RAMDISK_IO_STATISTICS;
+
+typedef struct _RAMDISK_STATS_PROTOCOL RAMDISK_STATS_PROTOCOL;
+
+typedef
+EFI_STATUS
+(EFIAPI *RAMDISK_STATS_GET) (
+    IN RAMDISK_STATS_PROTOCOL               *This,
+    OUT RAMDISK_IO_STATISTICS               *Statistics
+);
+
+typedef
+EFI_STATUS
+(EFIAPI *RAMDISK_STATS_RESET) (
+    IN RAMDISK_STATS_PROTOCOL               *This
+);
+
+/* Installed under `gRamdiskStatsProtocolGuid` on the handle of each registered ramdisk. */
+struct _RAMDISK_STATS_PROTOCOL {
+    UINT64                                  Revision;
+    RAMDISK_STATS_GET                       GetStatistics;
+    RAMDISK_STATS_RESET                     ResetStatistics;
+};
+
+/* How the blocks of a registered ramdisk are stored. */
+typedef
+enum {
+    /* Directly in the ramdisk's extents. */
+    RAMDISK_BACKING_EXTENTS = 0,
+    /* In the extents, except for blocks which were written (copy-on-write). */
+    RAMDISK_BACKING_OVERLAY,
+    /* Only in the block map. Blocks which aren't mapped read back as zeroes. */
+    RAMDISK_BACKING_SPARSE,
+    /* In the frames of a compressed image, except for blocks which were written. */
+    RAMDISK_BACKING_COMPRESSED,
+} RAMDISK_BACKING;
+
+/* One decompressed frame of a compressed ramdisk. */
+typedef
+struct {
+    UINTN       FrameIndex;
+    UINT8       *Buffer;
+    UINTN       LastUsed;
+    BOOLEAN     IsValid;
+} RAMDISK_FRAME_CACHE_ENTRY;
+
+typedef
+struct _RAMDISK_PRIVATE_DATA {
     UINTN                           Signature;
 
     EFI_HANDLE                      Handle;
@@ -98,6 +248,35 @@ struct {
     UINT64                          Size;
     EFI_GUID                        TypeGuid;
     UINT16                          InstanceNumber;
+
+    RAMDISK_EXTENT                  *Extents;
+    UINTN                           ExtentsLength;
+
+    /* Where the pages holding the first extent were allocated, if the driver was told.
+        An MFTAH header can sit in the pages before the extent itself. */
+    EFI_PHYSICAL_ADDRESS            AllocationBase;
+
+    /* Unused by RAMDISK_BACKING_EXTENTS disks: the page holding each block, or 0. */
+    RAMDISK_BACKING                 Backing;
+    EFI_PHYSICAL_ADDRESS            *BlockMap;
+    UINTN                           BlockMapLength;
+    UINTN                           BlockPagesLength;   /* pages allocated by writes */
+    UINTN                           SparseImagePages;   /* packed image pages still held */
+
+    /* Only used by RAMDISK_BACKING_COMPRESSED disks. The extents hold the compressed image. */
+    COMPRESSED_IMAGE                *Compressed;
+    RAMDISK_FRAME_CACHE_ENTRY       FrameCache[RAMDISK_FRAME_CACHE_LENGTH];
+    UINTN                           FrameClock;
+
+    RAMDISK_STATS_PROTOCOL          StatsProtocol;
+    RAMDISK_IO_STATISTICS           Stats;
+
+    /* Where this disk's structures start in the NFIT, once it's published. */
+    BOOLEAN                         IsPublished;
+    UINT32                          NfitOffset;
+
+    /* The next registered ramdisk. */
+    struct _RAMDISK_PRIVATE_DATA    *Next;
 } RAMDISK_PRIVATE_DATA;
 
 
@@ -106,6 +285,8 @@ EXTERN EFI_GUID gEfiRamdiskVirtualDiskGuid;
 EXTERN EFI_GUID gEfiRamdiskVirtualCdGuid;
 EXTERN EFI_GUID gEfiRamdiskPersistentVirtualDiskGuid;
 EXTERN EFI_GUID gEfiRamdiskPersistentVirtualCdGuid;
+EXTERN EFI_GUID gRamdiskExtentsDevicePathGuid;
+EXTERN EFI_GUID gRamdiskStatsProtocolGuid;
 
 EXTERN EFI_RAM_DISK_PROTOCOL RAMDISK;
 
@@ -167,7 +348,232 @@ RamDiskRegister(
 
 
 /**
- * This functionality is left incomplete because it's not currently used.
+ * Register a ramdisk whose contents are spread across several non-contiguous regions
+ *  of memory. The extents are given in disk order: the first extent holds the start of
+ *  the disk, the next one continues where it ends, and so on. The NFIT gets one SPA
+ *  range for each extent.
+ *
+ * @param[in]  Extents        The set of memory regions backing the disk, in disk order.
+ *                            Only `StartingAddr` and `Size` need to be set. The array
+ *                            is copied; the caller keeps ownership of it.
+ * @param[in]  ExtentsLength  The amount of entries in `Extents`.
+ * @param[in]  RamDiskType    The type of registered RAM disk.
+ * @param[in]  ParentDevicePath
+ *                            Pointer to the parent device path. If there is no
+ *                            parent device path then ParentDevicePath is NULL.
+ * @param[out] DevicePath     On return, points to a pointer to the device path
+ *                            of the RAM disk device. A disk with a single extent
+ *                            gets a RAM disk node; a scattered one gets a vendor
+ *                            node (`RAMDISK_EXTENTS_DEVICE_PATH`) instead, since a
+ *                            RAM disk node can't describe more than one range.
+ *
+ * @retval EFI_SUCCESS             The RAM disk is registered successfully.
+ * @retval EFI_INVALID_PARAMETER   An extent is empty or exceeds 64-bit memory, or
+ *                                 a required parameter is NULL.
+ * @retval EFI_BAD_BUFFER_SIZE     The total size is not a multiple of the block size.
+ * @retval EFI_OUT_OF_RESOURCES    The RAM disk register operation fails due to
+ *                                 resource limitation.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskRegisterExtents(
+    IN RAMDISK_EXTENT               *Extents,
+    IN UINTN                        ExtentsLength,
+    IN EFI_GUID                     *RamDiskType,
+    IN EFI_DEVICE_PATH              *ParentDevicePath OPTIONAL,
+    OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+);
+
+
+/**
+ * Register a copy-on-write ramdisk on top of a read-only base image. The extents are
+ *  never written: the first write to each 4 KiB block copies that block into a private
+ *  overlay page, and later accesses to the block use the overlay. Several overlays can
+ *  share the same base image, and each only uses memory for the blocks written to it.
+ *  Since the OS could only see the base image, overlays are not published in the NFIT.
+ *
+ * @param[in]  Extents        The memory regions of the base image, in disk order.
+ * @param[in]  ExtentsLength  The amount of entries in `Extents`.
+ * @param[in]  RamDiskType    The type of registered RAM disk.
+ * @param[in]  ParentDevicePath
+ *                            Pointer to the parent device path. If there is no
+ *                            parent device path then ParentDevicePath is NULL.
+ * @param[out] DevicePath     On return, points to a pointer to the device path
+ *                            of the RAM disk device.
+ *
+ * @returns The same values as `RamDiskRegisterExtents`.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskRegisterOverlay(
+    IN RAMDISK_EXTENT               *Extents,
+    IN UINTN                        ExtentsLength,
+    IN EFI_GUID                     *RamDiskType,
+    IN EFI_DEVICE_PATH              *ParentDevicePath OPTIONAL,
+    OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+);
+
+
+/**
+ * Register a sparse ramdisk from an image which is already in memory. Every all-zero
+ *  4 KiB block of the image is dropped at registration: the rest are packed to the start
+ *  of the image, and the pages at its end which are no longer needed are freed. Reads
+ *  of a dropped block return zeroes, and the first write to one allocates a page for it.
+ *  The image's pages must have come from AllocatePages, and the driver takes ownership
+ *  of them. Like overlays, sparse disks are not published in the NFIT.
+ *
+ * @param[in]  RamDiskBase    The page-aligned base address of the image.
+ * @param[in]  RamDiskSize    The size of the image.
+ * @param[in]  RamDiskType    The type of registered RAM disk.
+ * @param[in]  ParentDevicePath
+ *                            Pointer to the parent device path. If there is no
+ *                            parent device path then ParentDevicePath is NULL.
+ * @param[out] DevicePath     On return, points to a pointer to the device path
+ *                            of the RAM disk device.
+ *
+ * @retval EFI_INVALID_PARAMETER   The base address is not page-aligned.
+ * @returns Otherwise, the same values as `RamDiskRegisterExtents`.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskRegisterSparse(
+    IN UINT64                       RamDiskBase,
+    IN UINT64                       RamDiskSize,
+    IN EFI_GUID                     *RamDiskType,
+    IN EFI_DEVICE_PATH              *ParentDevicePath OPTIONAL,
+    OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+);
+
+
+/**
+ * Register a ramdisk from a block-compressed image which is already in memory. The image
+ *  is made of independently compressed frames with an index of their offsets (see
+ *  `COMPRESSED_IMAGE_HEADER`), so reads only decompress the frames they touch. The most
+ *  recently used frames are cached, and writes go to their own pages like an overlay's.
+ *  The image's pages must have come from AllocatePages, and the driver takes ownership
+ *  of them. Compressed disks stay firmware-only until `RamDiskMaterializeAll`.
+ *
+ * @param[in]  RamDiskBase    The base address of the compressed image.
+ * @param[in]  RamDiskSize    The size of the compressed image.
+ * @param[in]  RamDiskType    The type of registered RAM disk.
+ * @param[in]  ParentDevicePath
+ *                            Pointer to the parent device path. If there is no
+ *                            parent device path then ParentDevicePath is NULL.
+ * @param[out] DevicePath     On return, points to a pointer to the device path
+ *                            of the RAM disk device.
+ *
+ * @retval EFI_UNSUPPORTED         The image is not in a supported compressed format.
+ * @retval EFI_VOLUME_CORRUPTED    The image's frame index is invalid.
+ * @returns Otherwise, the same values as `RamDiskRegisterExtents`.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskRegisterCompressed(
+    IN UINT64                       RamDiskBase,
+    IN UINT64                       RamDiskSize,
+    IN EFI_GUID                     *RamDiskType,
+    IN EFI_DEVICE_PATH              *ParentDevicePath OPTIONAL,
+    OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+);
+
+
+/**
+ * Fully decompress every compressed ramdisk into reserved memory, merge in the blocks
+ *  written to it, and publish it in the NFIT like any other ramdisk. This must be done
+ *  before handing off to an OS, which can only see plain memory ranges. The compressed
+ *  images and frame caches are freed afterwards.
+ *
+ * @retval EFI_SUCCESS           Every compressed ramdisk was materialized.
+ * @retval EFI_OUT_OF_RESOURCES  There is not enough memory to hold a decompressed disk.
+ * @retval EFI_VOLUME_CORRUPTED  A frame of a compressed image failed to decompress.
+ * @returns Any error from publishing the NFIT.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskMaterializeAll(VOID);
+
+
+/**
+ * Open a registration batch. Ramdisks registered until `RamDiskCommitBatch` is called
+ *  are still attached and usable through Block IO right away, but their NFIT entries
+ *  are only collected. Opening a batch while one is already open has no effect.
+ *
+ * @returns Nothing.
+ */
+VOID
+EFIAPI
+RamDiskBeginBatch(VOID);
+
+
+/**
+ * Close the open registration batch and publish a single NFIT (with one ACPI table
+ *  update) covering every ramdisk registered during it.
+ *
+ * @retval EFI_SUCCESS      The NFIT was published, or nothing needed publishing.
+ * @retval EFI_NOT_STARTED  No batch was open.
+ * @retval EFI_NOT_FOUND    The ACPI table protocol is unavailable.
+ * @returns Any error from installing the table.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskCommitBatch(VOID);
+
+
+/**
+ * Print the I/O statistics of every registered ramdisk. Only has output in debug builds.
+ *
+ * @returns Nothing.
+ */
+VOID
+EFIAPI
+RamDiskDumpStatistics(VOID);
+
+
+/**
+ * Get a copy of a ramdisk's I/O statistics.
+ *
+ * @param[in]  This        The statistics protocol instance of the ramdisk.
+ * @param[out] Statistics  Receives the counters.
+ *
+ * @retval EFI_SUCCESS            The counters were copied.
+ * @retval EFI_INVALID_PARAMETER  A parameter was NULL.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskStatsGet(
+    IN RAMDISK_STATS_PROTOCOL       *This,
+    OUT RAMDISK_IO_STATISTICS       *Statistics
+);
+
+
+/**
+ * Clear all of a ramdisk's I/O statistics.
+ *
+ * @param[in]  This        The statistics protocol instance of the ramdisk.
+ *
+ * @retval EFI_SUCCESS            The counters were reset.
+ * @retval EFI_INVALID_PARAMETER  This is NULL.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskStatsReset(
+    IN RAMDISK_STATS_PROTOCOL       *This
+);
+
+
+/**
+ * Unregister a ramdisk and release everything it holds. Its protocols are uninstalled,
+ *  its structures are removed from the NFIT, and its memory is freed: the pages of its
+ *  extents, packed image, or compressed image, and any pages allocated for writes. The
+ *  base image of an overlay is left alone, since other overlays may still share it.
+ *  Every cached volume and file handle is dropped first, as some may be on this disk.
+ *
+ * @param[in]  DevicePath     The device path returned when the ramdisk was registered.
+ *
+ * @retval EFI_SUCCESS             The RAM disk was unregistered.
+ * @retval EFI_INVALID_PARAMETER   DevicePath is NULL.
+ * @retval EFI_NOT_FOUND           No registered RAM disk has this device path.
+ * @returns Any error from uninstalling the RAM disk's protocols, which stays registered.
  */
 EFI_STATUS
 EFIAPI
@@ -176,6 +582,28 @@ RamDiskUnregister(
 );
 
 
+/**
+ * Tell the driver where the pages holding a registered ramdisk's first extent were
+ *  allocated. When the disk is unregistered, they're freed from that base rather than
+ *  from the first whole page of the extent, so leading pages (an MFTAH header) are
+ *  returned as well. Only for disks whose pages the driver frees: not overlays.
+ *
+ * @param[in]  DevicePath      The device path returned when the ramdisk was registered.
+ * @param[in]  AllocationBase  The base address of the allocation holding the first extent.
+ *
+ * @retval EFI_SUCCESS             The allocation base was recorded.
+ * @retval EFI_INVALID_PARAMETER   DevicePath is NULL, or the base is not page-aligned or
+ *                                 comes after the start of the first extent.
+ * @retval EFI_NOT_FOUND           No registered RAM disk has this device path.
+ */
+EFI_STATUS
+EFIAPI
+RamDiskAdoptAllocation(
+    IN EFI_DEVICE_PATH_PROTOCOL *DevicePath,
+    IN EFI_PHYSICAL_ADDRESS     AllocationBase
+);
+
+
 /**
  * Initialize the BlockIO protocol of a RAM disk device.
  *
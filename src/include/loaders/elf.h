@@ -255,9 +255,65 @@ struct {
     UINTN                       ImagePages;
     VOID                        *HeaderStart;
     VOID                        *ProgramHeaderStart;
+    BOOLEAN                     SegmentsInPlace;
 } LOADED_ELF;   // TODO! Don't really need/use any of this information
 
 
+/* How much of the start of an ELF is read to find its in-place layout. Program
+    header tables which don't fit in here are simply loaded the normal way. */
+#define ELF_IN_PLACE_PROBE_SIZE     EFI_PAGE_SIZE
+
+/* Extra memory map descriptors the MBI makes room for, beyond those in the map when it's
+    sized. Tearing the loader down before handoff splits and merges a few ranges. */
+#define ELF_MBI_MEMORY_MAP_SLACK    32
+
+
+/**
+ * Work out where an ELF's file image would have to sit so that every PT_LOAD segment's
+ *  contents are already at its physical address. Only the BSS tails are left to zero
+ *  after loading the file there, and no segment has to be copied.
+ *
+ * @param[in]   Headers         The start of the ELF file, up to and including its program headers.
+ * @param[in]   HeadersLength   The amount of bytes available at `Headers`.
+ * @param[in]   FileSize        The length of the whole ELF file.
+ * @param[out]  ImageBase       Set to the page-aligned address the file must be loaded at.
+ * @param[out]  ImageLength     Set to the length the placement must span, including BSS past the end of the file.
+ *
+ * @retval  EFI_SUCCESS             Every segment can be loaded in place.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL.
+ * @retval  EFI_UNSUPPORTED         The file is not a 64-bit ELF, or its segments can't all be loaded in place.
+ * @retval  EFI_BUFFER_TOO_SMALL    The program headers extend past `HeadersLength`.
+ */
+EFI_STATUS
+EFIAPI
+ElfGetInPlaceLayout(
+    IN  CONST VOID              *Headers,
+    IN  UINTN                   HeadersLength,
+    IN  UINT64                  FileSize,
+    OUT EFI_PHYSICAL_ADDRESS    *ImageBase,
+    OUT UINT64                  *ImageLength
+);
+
+
+/**
+ * Hand control to a loaded kernel. When its image carries a Multiboot2 header, the full
+ *  MBI is built and passed along; either way, Boot Services are exited (unless the kernel
+ *  asks otherwise) and the entrypoint is called. The loader context is destroyed first.
+ *  Shared by every loader which jumps straight into a kernel (ELF and BIN).
+ *
+ * @param[in]   Context     The loader context. `LoadedImageBase` is searched for the Multiboot2 header.
+ * @param[in]   Entry       The physical address of the kernel's entrypoint.
+ *
+ * @returns Never returns.
+ */
+VOID
+EFIAPI
+ElfEnterKernel(
+    IN LOADER_CONTEXT           *Context,
+    IN EFI_PHYSICAL_ADDRESS     Entry
+);
+
+
 EXTERN EFI_EXECUTABLE_LOADER ElfLoader;
 
 
@@ -2,20 +2,97 @@
 #define MFTAH_LOADER_H
 
 // #include "../core/mftah.h"
-// #include "../core/compression.h"
+#include "../core/compression.h"
 
 #include "../drivers/config.h"
 
+#include "plan.h"
 
 
+
+/* The most staging buffers a chain can leave behind before it's handed off. */
+#define LOADER_MAX_DEAD_BUFFERS     4
+
+
+/* The most Multiboot2 modules a chain can hand over: its data ramdisks and extra modules. */
+#define LOADER_MAX_MODULES          (MAX_DATA_RAMDISKS_PER_CHAIN + MAX_MODULES_PER_CHAIN)
+
+
+/* A single allocation made while loading the chain. `Pages` is 0 for pool allocations. */
+typedef
+struct {
+    EFI_PHYSICAL_ADDRESS    Base;
+    UINTN                   Pages;
+} LOADER_STAGING_BUFFER;
+
+
+/* The read-only image under one or more overlay ramdisks, as the pages it was read into.
+    `Overlays` counts the overlays over it which are still registered. */
 typedef
 struct {
+    LOADER_STAGING_BUFFER   Ranges[LOADER_PLAN_MAX_EXTENTS];
+    UINTN                   RangesLength;
+    UINTN                   Overlays;
+} LOADER_OVERLAY_IMAGE;
+
+/* A loaded file which is handed to a Multiboot2 kernel as a module, in place. */
+typedef
+struct {
+    EFI_PHYSICAL_ADDRESS    Base;
+    UINTN                   Length;
+    CONST CHAR8             *String;
+} LOADER_MODULE;
+
+typedef struct _LOADER_CONTEXT LOADER_CONTEXT;
+
+/* Copies a range of a streamed payload's (plaintext, decompressed) contents to its destination. */
+typedef
+EFI_STATUS
+(EFIAPI *LOADER_READ_PAYLOAD_RANGE)(
+    IN  LOADER_CONTEXT  *Context,
+    IN  UINT64          Offset,
+    IN  UINTN           Length,
+    OUT VOID            *Destination
+);
+
+/* `LoadedImageAllocation` is what backs the loaded image right now, if anything can be
+    freed at all. Buffers the chain is done with are moved to `DeadBuffers`, which are
+    returned to the firmware when the context is destroyed, just before handoff.
+    A streamed payload sets `ReadPayloadRange`: only the start of its contents is loaded,
+    and the loader fetches everything else through it. Plain files are read again from
+    `StreamPath` on `StreamDeviceHandle`; compressed ones are decompressed out of
+    `StreamImage` on demand.
+    A compressed payload is decompressed into `DecompressTarget` when the plan could
+    reserve room for it up front.
+    `FirmwareRamdisks` are the data ramdisks the OS never sees. A loader which exits boot
+    services after destroying the context sets `ExitsBootServices` first, so they're
+    unregistered and their memory is returned. Overlay images are the loader's own, so
+    each one in `OverlayImages` is freed after the last overlay over it is unregistered;
+    `FirmwareRamdiskImages` holds the index of the image under each firmware-only disk,
+    or MAX_DATA_RAMDISKS_PER_CHAIN if it has none to free. */
+struct _LOADER_CONTEXT {
     CONFIG_CHAIN_BLOCK      *Chain;
     EFI_PHYSICAL_ADDRESS    LoadedImageBase;
     UINTN                   LoadedImageSize;
     EFI_DEVICE_PATH         *LoadedImageDevicePath;
     mftah_payload_t         *MftahPayloadWrapper;
-} LOADER_CONTEXT;
+    LOADER_STAGING_BUFFER   LoadedImageAllocation;
+    LOADER_STAGING_BUFFER   DeadBuffers[LOADER_MAX_DEAD_BUFFERS];
+    UINTN                   DeadBuffersLength;
+    LOADER_READ_PAYLOAD_RANGE   ReadPayloadRange;
+    EFI_HANDLE              StreamDeviceHandle;
+    CHAR16                  *StreamPath;
+    COMPRESSED_IMAGE        StreamImage;
+    LOADER_STAGING_BUFFER   DecompressTarget;
+    LOADER_MODULE           Modules[LOADER_MAX_MODULES];
+    UINTN                   ModulesLength;
+    EFI_DEVICE_PATH_PROTOCOL    *FirmwareRamdisks[MAX_DATA_RAMDISKS_PER_CHAIN];
+    UINTN                   FirmwareRamdisksLength;
+    UINTN                   FirmwareRamdiskImages[MAX_DATA_RAMDISKS_PER_CHAIN];
+    LOADER_OVERLAY_IMAGE    OverlayImages[MAX_DATA_RAMDISKS_PER_CHAIN];
+    UINTN                   OverlayImagesLength;
+    BOOLEAN                 ExitsBootServices;
+};
 
 
 
@@ -27,6 +104,12 @@ struct {
 } EFI_EXECUTABLE_LOADER;
 
 
+/* Marks the buffer backing the loaded image as dead once a loader has copied out
+    everything it needs from it (ELF segments, a LoadImage copy, and so on). It's
+    still readable until `LoaderDestroyContext` frees it. */
+VOID
+LoaderRetireLoadedImage(IN LOADER_CONTEXT *Context);
+
 VOID
 LoaderDestroyContext(IN LOADER_CONTEXT *Context);
 
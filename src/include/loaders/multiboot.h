@@ -11,6 +11,13 @@
 #define MULTIBOOT_SEARCH_LIMIT          (1 << 15)   /* 32,768 bytes */
 #define MULTIBOOT_SEARCH_ALIGNMENT      (1 << 3)   /* 8 bytes */
 
+#define MULTIBOOT_MODULE_ADDRESS_LIMIT  (1ULL << 32)   /* module tags only carry 32-bit addresses */
+#define MULTIBOOT_INFO_ADDRESS_LIMIT    (1ULL << 32)   /* the MBI's address is handed over in EBX */
+
+/* Tags are padded out so the next one starts on an 8-byte boundary. */
+#define MULTIBOOT_TAG_ALIGN(x) \
+    (((x) + (MULTIBOOT_SEARCH_ALIGNMENT - 1)) & ~((UINTN)MULTIBOOT_SEARCH_ALIGNMENT - 1))
+
 #define MULTIBOOT_EMPTY_TAG             { 0, 0, 8 }
 #define MULTIBOOT_INFO_EMPTY_TAG        { 0, 8 }
 
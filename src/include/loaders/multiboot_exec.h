@@ -29,6 +29,15 @@ struct {
 } EFI_MULTIBOOT2_CONTEXT;
 
 
+/* A single, pre-sized buffer which the MBI is written into in place. `Header->TotalSize`
+    is how much of it is used so far, and can be wound back to drop the latest tags. */
+typedef
+struct {
+    MultibootInfoHeader     *Header;
+    UINTN                   Capacity;
+} EFI_MULTIBOOT2_INFO_ARENA;
+
+
 typedef
 struct MULTIBOOT2_PROTOCOL
 EFI_MULTIBOOT2_PROTOCOL;
@@ -67,6 +76,37 @@ EFI_STATUS
     OUT     UINTN                   *TagsLoaded
 );
 
+typedef
+EFI_STATUS
+(EFIAPI *EFI_MULTIBOOT2_CREATE_INFO_ARENA)(
+    IN      EFI_MULTIBOOT2_PROTOCOL     *This,
+    IN      UINTN                       Capacity,
+    OUT     EFI_MULTIBOOT2_INFO_ARENA   *Arena
+);
+
+typedef
+VOID *
+(EFIAPI *EFI_MULTIBOOT2_ADD_INFO_TAG)(
+    IN      EFI_MULTIBOOT2_PROTOCOL     *This,
+    IN OUT  EFI_MULTIBOOT2_INFO_ARENA   *Arena,
+    IN      UINT32                      Type,
+    IN      UINTN                       Size
+);
+
+typedef
+VOID
+(EFIAPI *EFI_MULTIBOOT2_FINISH_INFO_ARENA)(
+    IN      EFI_MULTIBOOT2_PROTOCOL     *This,
+    IN OUT  EFI_MULTIBOOT2_INFO_ARENA   *Arena
+);
+
+typedef
+VOID
+(EFIAPI *EFI_MULTIBOOT2_DESTROY_INFO_ARENA)(
+    IN      EFI_MULTIBOOT2_PROTOCOL     *This,
+    IN OUT  EFI_MULTIBOOT2_INFO_ARENA   *Arena
+);
+
 
 INTERFACE_DECL(MULTIBOOT2_PROTOCOL)
 {
@@ -74,6 +114,10 @@ INTERFACE_DECL(MULTIBOOT2_PROTOCOL)
     EFI_MULTIBOOT2_PARSE_HEADER                 Parse;
     EFI_MULTIBOOT2_VALIDATE_CONTEXT             ValidateContext;
     EFI_MULTIBOOT2_BUILD_INFO_HEADER_FROM_TAGS  BuildInfoHeaderFromTags;
+    EFI_MULTIBOOT2_CREATE_INFO_ARENA            CreateInfoArena;
+    EFI_MULTIBOOT2_ADD_INFO_TAG                 AddInfoTag;
+    EFI_MULTIBOOT2_FINISH_INFO_ARENA            FinishInfoArena;
+    EFI_MULTIBOOT2_DESTROY_INFO_ARENA           DestroyInfoArena;
 };
 
 
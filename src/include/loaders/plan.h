@@ -0,0 +1,229 @@
+#ifndef MFTAH_LOADER_PLAN_H
+#define MFTAH_LOADER_PLAN_H
+
+#include "../drivers/config.h"
+#include "../drivers/ramdisk.h"
+
+
+
+/* The most destination buffers a single chain can stage: one per data ramdisk and module, plus the payload. */
+#define LOADER_PLAN_MAX_BUFFERS     (MAX_DATA_RAMDISKS_PER_CHAIN + MAX_MODULES_PER_CHAIN + 1)
+
+/* The most files a single chain can read: each data ramdisk and module, plus up to 10 payload parts. */
+#define LOADER_PLAN_MAX_FILES       (MAX_DATA_RAMDISKS_PER_CHAIN + MAX_MODULES_PER_CHAIN + 10)
+
+/* The most non-contiguous regions a single scattered buffer can be split across. */
+#define LOADER_PLAN_MAX_EXTENTS     16
+
+/* The most fixed ranges a chain can keep the plan away from (a streamed ELF's segments). */
+#define LOADER_PLAN_MAX_CLAIMS      16
+
+
+/**
+ * A single memory destination. One or more files are read consecutively into it.
+ *  Set `NeedsWorkingCopy` when a loader will later need about as much contiguous
+ *  memory as the buffer's contents (ELF segments, a LoadImage copy, and so on).
+ *  Set `HeadSize` to the length of any header which is stripped after loading (the
+ *  MFTAH header); the data following that header is what gets aligned.
+ *  Set `AllowScatter` for a buffer holding a single file which is only ever accessed
+ *  through a ramdisk. If no free region can hold it whole, it is split across several
+ *  regions which are listed in `Extents`, and `Base` is left at 0.
+ *  Set `FixedBase` to ask for the buffer's data (past any `HeadSize` header) to start at
+ *  exactly that page-aligned address (an ELF whose segments are then already in place,
+ *  or a raw binary at its load address). If that memory isn't free, the buffer is placed
+ *  like any other and `FixedBase` is cleared.
+ *  Set `PreferLowMemory` (and clear `PreferHighMemory`) for a buffer which should be
+ *  addressable in 32 bits (a Multiboot2 module). It is placed as high as possible below
+ *  4 GiB, away from where kernels usually load, and only goes above 4 GiB if it must.
+ *  Set `ReserveSize` for a buffer which no file is read into. It only reserves that much
+ *  memory, to be filled in later (a compressed payload's decompressed contents).
+ */
+typedef
+struct {
+    EFI_PHYSICAL_ADDRESS    Base;
+    UINTN                   Size;
+    EFI_PHYSICAL_ADDRESS    AllocationBase;
+    UINTN                   Pages;
+    UINTN                   HeadSize;
+    BOOLEAN                 PreferHighMemory;
+    BOOLEAN                 PreferLowMemory;
+    UINTN                   DataSize;
+    UINTN                   RoundToBlockSize;
+    UINTN                   ExtraEndAllocation;
+    EFI_MEMORY_TYPE         MemoryType;
+    BOOLEAN                 IsRequired;
+    BOOLEAN                 NeedsWorkingCopy;
+    BOOLEAN                 AllowScatter;
+    EFI_PHYSICAL_ADDRESS    FixedBase;
+    UINTN                   ReserveSize;
+    RAMDISK_EXTENT          Extents[LOADER_PLAN_MAX_EXTENTS];
+    UINTN                   ExtentsLength;
+    EFI_STATUS              Status;
+} LOADER_PLAN_BUFFER;
+
+/**
+ * A single on-disk file and where its contents should land.
+ */
+typedef
+struct {
+    EFI_HANDLE  DeviceHandle;
+    CHAR16      *Path;
+    UINTN       FileSize;
+    UINTN       BufferIndex;
+    UINTN       BufferOffset;
+} LOADER_PLAN_FILE;
+
+/**
+ * A fixed range of memory which the loader allocates by itself later on, such as the
+ *  segments of a streamed ELF. No buffer is ever placed over it.
+ */
+typedef
+struct {
+    EFI_PHYSICAL_ADDRESS    Start;
+    UINTN                   Pages;
+} LOADER_PLAN_CLAIM;
+
+/**
+ * The set of all reads a chain must perform before it can be started. Files are
+ *  gathered first, then sized and allocated together, then read device-by-device.
+ */
+typedef
+struct {
+    LOADER_PLAN_BUFFER  Buffers[LOADER_PLAN_MAX_BUFFERS];
+    UINTN               BuffersLength;
+    LOADER_PLAN_FILE    Files[LOADER_PLAN_MAX_FILES];
+    UINTN               FilesLength;
+    LOADER_PLAN_CLAIM   Claims[LOADER_PLAN_MAX_CLAIMS];
+    UINTN               ClaimsLength;
+} LOADER_PLAN;
+
+
+
+/**
+ * Add a new destination buffer to the plan.
+ *
+ * @param[in]   Plan                The plan to modify.
+ * @param[in]   MemoryType          The EFI memory type to use when reserving the buffer.
+ * @param[in]   RoundToBlockSize    Rounds up the size of the buffer to a nearest multiple of this value, if not 0.
+ * @param[in]   ExtraEndAllocation  Any additional allocation to make onto the end of the buffer.
+ * @param[in]   IsRequired          Whether a failure to load this buffer should fail the whole plan.
+ * @param[out]  BufferIndex         Set to the index of the new buffer on success.
+ *
+ * @retval  EFI_SUCCESS             The buffer was added.
+ * @retval  EFI_INVALID_PARAMETER   A required parameter was NULL.
+ * @retval  EFI_OUT_OF_RESOURCES    The plan has no more room for buffers.
+ */
+EFI_STATUS
+EFIAPI
+PlanAddBuffer(
+    IN  LOADER_PLAN     *Plan,
+    IN  EFI_MEMORY_TYPE MemoryType,
+    IN  UINTN           RoundToBlockSize,
+    IN  UINTN           ExtraEndAllocation,
+    IN  BOOLEAN         IsRequired,
+    OUT UINTN           *BufferIndex
+);
+
+
+/**
+ * Append a file to the end of a planned buffer. The plan takes ownership of the path.
+ *
+ * @param[in]   Plan            The plan to modify.
+ * @param[in]   BufferIndex     The buffer which the file's contents are destined for.
+ * @param[in]   DeviceHandle    The SFS device handle (NOT a Loaded Image handle) the file resides on.
+ * @param[in]   Path            A full path to the file on the device. Freed by `PlanDestroy`.
+ *
+ * @retval  EFI_SUCCESS             The file was added.
+ * @retval  EFI_INVALID_PARAMETER   A parameter was NULL or the buffer index is invalid.
+ * @retval  EFI_OUT_OF_RESOURCES    The plan has no more room for files.
+ */
+EFI_STATUS
+EFIAPI
+PlanAddFile(
+    IN LOADER_PLAN  *Plan,
+    IN UINTN        BufferIndex,
+    IN EFI_HANDLE   DeviceHandle,
+    IN CHAR16       *Path
+);
+
+
+/**
+ * Keep every planned buffer away from a fixed range of memory, which the caller will
+ *  allocate by itself. The range is only taken out of the free memory the plan places
+ *  buffers into; nothing is allocated for it.
+ *
+ * @param[in]   Plan    The plan to modify.
+ * @param[in]   Start   The page-aligned start of the range.
+ * @param[in]   Pages   The length of the range, in pages.
+ *
+ * @retval  EFI_SUCCESS             The range was claimed.
+ * @retval  EFI_INVALID_PARAMETER   The plan is NULL, or the range is empty or misaligned.
+ * @retval  EFI_OUT_OF_RESOURCES    The plan has no more room for claims.
+ */
+EFI_STATUS
+EFIAPI
+PlanAddClaim(
+    IN LOADER_PLAN          *Plan,
+    IN EFI_PHYSICAL_ADDRESS Start,
+    IN UINTN                Pages
+);
+
+
+/**
+ * Size every file in the plan and reserve memory for every buffer. Nothing is read yet.
+ *  The whole footprint of the chain is placed against the current memory map before
+ *  anything is allocated, so a chain which cannot fit is rejected immediately. Optional
+ *  buffers which cannot be sized or placed are marked as failed and skipped.
+ *  Large buffers are placed so their data (after `HeadSize`) starts on a 1 GiB or
+ *  2 MiB boundary, preferring memory above 4 GiB when `PreferHighMemory` is set.
+ *  Buffers with `AllowScatter` set are split into extents only when they can't fit whole.
+ *  Claimed ranges are kept clear of every buffer.
+ *
+ * @param[in]   Plan    The plan to prepare.
+ *
+ * @retval  EFI_SUCCESS             All required buffers are sized and allocated.
+ * @retval  EFI_OUT_OF_RESOURCES    The required buffers (and working space) cannot fit in free memory.
+ * @returns Any error from sizing or allocating a required buffer.
+ */
+EFI_STATUS
+EFIAPI
+PlanPrepare(
+    IN LOADER_PLAN  *Plan
+);
+
+
+/**
+ * Issue all planned reads, grouped by device. Each device is read to completion before
+ *  moving onto the next, keeping the files of a device in the order they were added.
+ *
+ * @param[in]   Plan            A plan which was successfully prepared.
+ * @param[in]   ProgressHook    An optional hook reporting progress over the total bytes of all files.
+ *
+ * @retval  EFI_SUCCESS     All required buffers were read.
+ * @returns Any error from reading a required buffer.
+ */
+EFI_STATUS
+EFIAPI
+PlanExecute(
+    IN LOADER_PLAN          *Plan,
+    IN PROGRESS_UPDATE_HOOK ProgressHook    OPTIONAL
+);
+
+
+/**
+ * Free the file paths of the plan. Successfully-loaded buffers are NOT freed, since the
+ *  caller owns them after execution. Buffers of failed optional entries are released.
+ *
+ * @param[in]   Plan    The plan to clean up.
+ *
+ * @returns Nothing.
+ */
+VOID
+EFIAPI
+PlanDestroy(
+    IN LOADER_PLAN  *Plan
+);
+
+
+
+#endif   /* MFTAH_LOADER_PLAN_H */
@@ -0,0 +1,18 @@
+#ifndef MFTAH_UKI_LOADER_H
+#define MFTAH_UKI_LOADER_H
+
+#include "loader.h"
+
+
+
+/* The PE sections of a unified kernel image which the loader cares about. */
+#define UKI_SECTION_LINUX       ".linux"
+#define UKI_SECTION_INITRD      ".initrd"
+#define UKI_SECTION_CMDLINE     ".cmdline"
+
+
+EXTERN EFI_EXECUTABLE_LOADER UkiLoader;
+
+
+
+#endif   /* MFTAH_UKI_LOADER_H */
@@ -1,4 +1,7 @@
 #include "../include/loaders/bin.h"
+#include "../include/loaders/elf.h"
+
+#include "../include/drivers/displays.h"
 
 
 
@@ -8,7 +11,49 @@ VOID
 LoadImage(IN LOADER_CONTEXT *Context)
 {
     EFI_STATUS Status = EFI_SUCCESS;
-    PANIC("Loading BIN");
+    EFI_PHYSICAL_ADDRESS LoadAddress = Context->Chain->LoadAddress;
+
+    /* Without a load address, the binary runs right where it was loaded. */
+    if (0 == LoadAddress) LoadAddress = Context->LoadedImageBase;
+
+    if (Context->Chain->EntryOffset >= Context->LoadedImageSize) {
+        DISPLAY->Panic(DISPLAY,
+                       "The binary's entry offset lies beyond the end of its image.",
+                       EFI_INVALID_PARAMETER,
+                       TRUE,
+                       EFI_SECONDS_TO_MICROSECONDS(10));
+        HALT;
+    }
+
+    /* The payload is normally read, decrypted, or decompressed right at its load address.
+        Only when that memory was taken at the time is the image copied over now. */
+    if (LoadAddress != Context->LoadedImageBase) {
+        EFI_PHYSICAL_ADDRESS Destination = LoadAddress;
+
+        Status = BS->AllocatePages(AllocateAddress,
+                                   EfiReservedMemoryType,
+                                   EFI_SIZE_TO_PAGES(Context->LoadedImageSize),
+                                   &Destination);
+        if (EFI_ERROR(Status)) {
+            DISPLAY->Panic(DISPLAY,
+                           "The binary's load address is not available.",
+                           Status,
+                           TRUE,
+                           EFI_SECONDS_TO_MICROSECONDS(10));
+            HALT;
+        }
+
+        DPRINTLN("Copying the binary from '%p' to its load address '%p'.",
+                 (VOID *)Context->LoadedImageBase, (VOID *)LoadAddress);
+
+        CopyMem((VOID *)LoadAddress, (VOID *)Context->LoadedImageBase, Context->LoadedImageSize);
+
+        LoaderRetireLoadedImage(Context);
+        Context->LoadedImageBase = LoadAddress;
+    }
+
+    /* Bare-metal images may carry a Multiboot2 header too, so the handoff is the ELF one. */
+    ElfEnterKernel(Context, (LoadAddress + Context->Chain->EntryOffset));
 }
 
 
@@ -2,10 +2,12 @@
 #include "../include/loaders/elf.h"
 #include "../include/loaders/exe.h"
 #include "../include/loaders/bin.h"
+#include "../include/loaders/uki.h"
 
 #include "../include/drivers/ramdisk.h"
 #include "../include/drivers/displays.h"
 
+#include "../include/core/fat.h"
 #include "../include/core/util.h"
 
 
@@ -24,7 +26,9 @@ LoadImage(IN LOADER_CONTEXT *Context)
     UINTN HandlesCount = 0;
     EFI_HANDLE *Handles = NULL;
     VOID *NestedChainloadFileBuffer = NULL;
-    UINTN NestedChainloadFileSize = 0;
+    UINTN NestedChainloadFileBufferSize = 0;
+    EFI_PHYSICAL_ADDRESS NestedChainloadFileBase = 0;
+    UINT64 NestedChainloadFileSize = 0;
 
     /* First, set up the ramdisk through the driver. This registers it as an available
         SFS handle (given it contains a FAT filesystem). */
@@ -38,6 +42,11 @@ LoadImage(IN LOADER_CONTEXT *Context)
         PANIC("Could not register the loaded ramdisk through the active protocol.");
     }
 
+    /* This was the last ramdisk of the chain: publish the NFIT for all of them. */
+    if (EFI_ERROR((Status = RAMDISK.CommitBatch()))) {
+        EFI_DANGERLN("WARNING: Failed to publish the NFIT for the chain's ramdisks (%u).", Status);
+    }
+
     Status  = SetEfiVarsHint(L"MFTAH__RAMDISK_BASE", (EFI_PHYSICAL_ADDRESS)&(Context->LoadedImageBase), 0);
     Status |= SetEfiVarsHint(L"MFTAH__RAMDISK_SIZE", (EFI_PHYSICAL_ADDRESS)&(Context->LoadedImageSize), 0);
 
@@ -47,7 +56,42 @@ LoadImage(IN LOADER_CONTEXT *Context)
         PANIC("Failed to set required ramdisk EFI hints.");
     }
 
-    /* Next, find the target image to chainload and load it to another segment of reserved memory. */
+    CHAR16 *TargetPath = AsciiStrToUnicode(Context->Chain->TargetPath);
+    if (NULL == TargetPath) {
+        PANIC("Failed to copy target path information: out of resources.");
+    }
+
+    // TODO: Put this filename sanitization in the chain's validation method.
+    for (CHAR16 *p = TargetPath; *p; ++p) if (L'/' == *p) *p = L'\\';
+
+    /* Most targets can be found by walking the FAT volume in the ramdisk directly. When
+        the file's clusters are contiguous, it's loaded right where it sits in the ramdisk. */
+    Status = FatLocateContiguousFile((VOID *)Context->LoadedImageBase,
+                                     Context->LoadedImageSize,
+                                     Context->Chain->TargetPath,
+                                     &NestedChainloadFileBase,
+                                     &NestedChainloadFileSize);
+    if (!EFI_ERROR(Status)) {
+        DPRINTLN("Found the chain's target in the ramdisk at '%p' (%u bytes).",
+                 (VOID *)NestedChainloadFileBase, NestedChainloadFileSize);
+
+        Context->LoadedImageBase = NestedChainloadFileBase;
+        Context->LoadedImageSize = NestedChainloadFileSize;
+
+        /* The target is part of the ramdisk, which stays with the OS. */
+        SetMem(&(Context->LoadedImageAllocation), sizeof(LOADER_STAGING_BUFFER), 0x00);
+
+        /* Only LoadImage cares where an image came from, so nothing else needs the
+            firmware's view of the volume. */
+        if (EXE != Context->Chain->SubType) {
+            Context->LoadedImageDevicePath = RamdiskDevicePath;
+            goto LoadImage__Chainload;
+        }
+    } else {
+        DPRINTLN("Falling back to the firmware's file system for the chain's target (%u).", Status);
+    }
+
+    /* Next, find the target image's file system through the firmware. */
     Status = BS->LocateDevicePath(&gEfiSimpleFileSystemProtocolGuid,
                                   (VOID **)&RamdiskDevicePath,
                                   &RamdiskDeviceHandle);
@@ -96,19 +140,18 @@ LoadImage(IN LOADER_CONTEXT *Context)
         }
     }
 
-    CHAR16 *TargetPath = AsciiStrToUnicode(Context->Chain->TargetPath);
-    if (NULL == TargetPath) {
-        PANIC("Failed to copy target path information: out of resources.");
+    if (0 != NestedChainloadFileBase) {
+        Context->LoadedImageDevicePath = FileDevicePath(RamdiskDeviceHandle, TargetPath);
+        goto LoadImage__Chainload;
     }
 
-    // TODO: Put this filename sanitization in the chain's validation method.
-    for (CHAR16 *p = TargetPath; *p; ++p) if (L'/' == *p) *p = L'\\';
-
+    /* The target is fragmented (or otherwise unreadable in-place), so it's copied out into
+        another segment of reserved memory. */
     Status = ReadFile(RamdiskDeviceHandle,
                       TargetPath,
                       0,
                       (UINT8 **)&NestedChainloadFileBuffer,
-                      &NestedChainloadFileSize,
+                      &NestedChainloadFileBufferSize,
                       FALSE,
                       EfiReservedMemoryType,
                       0,
@@ -119,9 +162,15 @@ LoadImage(IN LOADER_CONTEXT *Context)
     }
 
     Context->LoadedImageBase = (EFI_PHYSICAL_ADDRESS)NestedChainloadFileBuffer;
-    Context->LoadedImageSize = NestedChainloadFileSize;
+    Context->LoadedImageSize = NestedChainloadFileBufferSize;
     Context->LoadedImageDevicePath = FileDevicePath(RamdiskDeviceHandle, TargetPath);
 
+    /* The ramdisk's own buffer belongs to the OS now and must never be retired. The
+        nested file is a staging buffer like any other payload (pool-allocated). */
+    Context->LoadedImageAllocation.Base  = (EFI_PHYSICAL_ADDRESS)NestedChainloadFileBuffer;
+    Context->LoadedImageAllocation.Pages = 0;
+
+LoadImage__Chainload:
     FreePool(TargetPath);
 
     /* Ramdisks are a bit different: the sub-type loader is now called on the loaded image.
@@ -132,6 +181,7 @@ LoadImage(IN LOADER_CONTEXT *Context)
         case EXE:   ExeLoader.Load(Context);  break;
         case ELF:   ElfLoader.Load(Context);  break;
         case BIN:   BinLoader.Load(Context);  break;
+        case UKI:   UkiLoader.Load(Context);  break;
         default: break;
     }
 }
@@ -59,17 +59,108 @@ ElfStatusToString(IN ELF_STATUS Status)
 }
 
 
+EFI_STATUS
+EFIAPI
+ElfGetInPlaceLayout(IN CONST VOID *Headers,
+                    IN UINTN HeadersLength,
+                    IN UINT64 FileSize,
+                    OUT EFI_PHYSICAL_ADDRESS *ImageBase,
+                    OUT UINT64 *ImageLength)
+{
+    if (NULL == Headers || NULL == ImageBase || NULL == ImageLength) return EFI_INVALID_PARAMETER;
+
+    CONST Elf64Header *Header = (CONST Elf64Header *)Headers;
+    CONST CHAR8 ElfSignature[] = ELF_MAGIC_SIGNATURE;
+    EFI_PHYSICAL_ADDRESS Base = 0;
+    UINT64 Length = FileSize, TableEnd = 0;
+    UINTN Loads = 0;
+
+    if (HeadersLength < sizeof(Elf64Header) || 0 != CompareMem(Headers, ElfSignature, 4)) return EFI_UNSUPPORTED;
+
+    if (
+        EC_64 != Header->Ident.Class
+        || ED_LSB != Header->Ident.Data
+        || 0 == Header->ProgramHeaderCount
+        || Header->ProgramHeaderEntrySizeBytes < sizeof(Elf64ProgramHeader)
+    ) return EFI_UNSUPPORTED;
+
+    TableEnd = Header->ProgramHeaderTableOffset
+        + ((UINT64)Header->ProgramHeaderCount * Header->ProgramHeaderEntrySizeBytes);
+    if (TableEnd < Header->ProgramHeaderTableOffset || TableEnd > FileSize) return EFI_UNSUPPORTED;
+    if (TableEnd > HeadersLength) return EFI_BUFFER_TOO_SMALL;
+
+    CONST UINT8 *Table = (CONST UINT8 *)Headers + Header->ProgramHeaderTableOffset;
+
+    /* Every segment has to agree on a single distance between its file offset and its address. */
+    for (UINTN i = 0; i < Header->ProgramHeaderCount; ++i) {
+        Elf64ProgramHeader PHdr = {0};
+        CopyMem(&PHdr, (Table + (i * Header->ProgramHeaderEntrySizeBytes)), sizeof(Elf64ProgramHeader));
+
+        if (PT_LOAD != PHdr.Type) continue;
+
+        if (
+            PHdr.PhysicalAddress < PHdr.Offset
+            || PHdr.FileSize > PHdr.MemorySize
+            || (PHdr.Offset + PHdr.FileSize) > FileSize
+            || (PHdr.PhysicalAddress + PHdr.MemorySize) < PHdr.PhysicalAddress
+        ) return EFI_UNSUPPORTED;
+
+        if (0 == Loads) Base = (PHdr.PhysicalAddress - PHdr.Offset);
+        else if (Base != (PHdr.PhysicalAddress - PHdr.Offset)) return EFI_UNSUPPORTED;
+
+        Length = MAX(Length, (PHdr.Offset + PHdr.MemorySize));
+        ++Loads;
+    }
+
+    if (0 == Loads || 0 == Base || 0 != (Base & (EFI_PAGE_SIZE - 1))) return EFI_UNSUPPORTED;
+
+    /* Clearing a BSS tail in place must not wipe out anything which is still read after
+        it: the program headers, a Multiboot2 header, or the contents of another segment. */
+    for (UINTN i = 0; i < Header->ProgramHeaderCount; ++i) {
+        Elf64ProgramHeader PHdr = {0};
+        CopyMem(&PHdr, (Table + (i * Header->ProgramHeaderEntrySizeBytes)), sizeof(Elf64ProgramHeader));
+
+        if (PT_LOAD != PHdr.Type || PHdr.MemorySize == PHdr.FileSize) continue;
+
+        UINT64 BssStart = PHdr.Offset + PHdr.FileSize;
+        UINT64 BssEnd = PHdr.Offset + PHdr.MemorySize;
+
+        if (BssStart < MAX(TableEnd, MULTIBOOT_SEARCH_LIMIT)) return EFI_UNSUPPORTED;
+
+        for (UINTN j = 0; j < Header->ProgramHeaderCount; ++j) {
+            Elf64ProgramHeader Other = {0};
+            CopyMem(&Other, (Table + (j * Header->ProgramHeaderEntrySizeBytes)), sizeof(Elf64ProgramHeader));
+
+            if (i == j || PT_LOAD != Other.Type || 0 == Other.FileSize) continue;
+
+            if (BssStart < (Other.Offset + Other.FileSize) && Other.Offset < BssEnd) return EFI_UNSUPPORTED;
+        }
+    }
+
+    *ImageBase = Base;
+    *ImageLength = Length;
+
+    return EFI_SUCCESS;
+}
+
+
+/* Segments which already sit at their physical address inside of the loaded image's
+    own allocation (which ends at `OwnedEnd`) are used where they are. The segments of
+    a streamed payload are read (or decompressed) straight to their final addresses. */
 STATIC
 ELF_STATUS
-VerifyAndLoadElf(IN EFI_PHYSICAL_ADDRESS LoadedElfPhysAddr,
+VerifyAndLoadElf(IN LOADER_CONTEXT *Context,
+                 IN EFI_PHYSICAL_ADDRESS OwnedEnd,
                  OUT LOADED_ELF *Elf)
 {
     if (
-        0 == LoadedElfPhysAddr
+        NULL == Context
+        || 0 == Context->LoadedImageBase
         || NULL == Elf
     ) return ELF_GENERIC_ERROR;
 
     EFI_STATUS Status = EFI_SUCCESS;
+    EFI_PHYSICAL_ADDRESS LoadedElfPhysAddr = Context->LoadedImageBase;
 
     ElfIdent *Ident = (ElfIdent *)LoadedElfPhysAddr;
     Elf64Header *Header = (Elf64Header *)LoadedElfPhysAddr;
@@ -116,6 +207,11 @@ VerifyAndLoadElf(IN EFI_PHYSICAL_ADDRESS LoadedElfPhysAddr,
         ? (((Elf32Header *)Header)->ProgramHeaderCount)
         : (((Elf64Header *)Header)->ProgramHeaderCount);
 
+    /* A streamed payload only has its head in memory, which must hold the whole table. */
+    if ((PHdrBase + (PHdrCount * PHdrEntrySize)) > (LoadedElfPhysAddr + Context->LoadedImageSize)) {
+        return ELF_INVALID_PROGRAM_HEADER_OFFSET;
+    }
+
     for (
         EFI_PHYSICAL_ADDRESS i = 0;
         i < (PHdrCount * PHdrEntrySize);
@@ -156,29 +252,51 @@ VerifyAndLoadElf(IN EFI_PHYSICAL_ADDRESS LoadedElfPhysAddr,
             P_Alignment         = PHdr64.Alignment;
         }
 
-        /* Allocate pages based on the ELF's specification of its PH segments. */
-        Status = BS->AllocatePages(AllocateAddress,
-                                   EfiReservedMemoryType,
-                                   EFI_SIZE_TO_PAGES(P_MemorySize),
-                                   (EFI_PHYSICAL_ADDRESS *)(&P_PhysicalAddress));
-        if (EFI_ERROR(Status)) {
-            DISPLAY->Panic(DISPLAY,
-                           "Error loading program header segment.",
-                           Status,
-                           FALSE,
-                           EFI_SECONDS_TO_MICROSECONDS(3));
-            return ELF_FAILURE_LOAD_SEGMENT;
-        }
+        /* A segment laid out by `ElfGetInPlaceLayout` is already part of the image's pages. */
+        if (
+            (LoadedElfPhysAddr + P_Offset) == P_PhysicalAddress
+            && (P_PhysicalAddress + P_MemorySize) <= OwnedEnd
+        ) {
+            Elf->SegmentsInPlace = TRUE;
+        } else {
+            /* Allocate pages based on the ELF's specification of its PH segments. */
+            Status = BS->AllocatePages(AllocateAddress,
+                                       EfiReservedMemoryType,
+                                       EFI_SIZE_TO_PAGES(P_MemorySize),
+                                       (EFI_PHYSICAL_ADDRESS *)(&P_PhysicalAddress));
+            if (EFI_ERROR(Status)) {
+                DISPLAY->Panic(DISPLAY,
+                               "Error loading program header segment.",
+                               Status,
+                               FALSE,
+                               EFI_SECONDS_TO_MICROSECONDS(3));
+                return ELF_FAILURE_LOAD_SEGMENT;
+            }
 
-        /* Zero out the set of loaded pages. This takes care of zero-loading any difference
-            between FileSize and MemorySize. */
-        SetMem((VOID *)P_PhysicalAddress, EFI_SIZE_TO_PAGES(P_MemorySize), 0x00);
+            /* Copy the segment into memory at the newly-allocated set of pages. */
+            if (P_FileSize > 0 && NULL != Context->ReadPayloadRange) {
+                Status = Context->ReadPayloadRange(Context,
+                                                   P_Offset,
+                                                   (UINTN)P_FileSize,
+                                                   (VOID *)P_PhysicalAddress);
+                if (EFI_ERROR(Status)) {
+                    DISPLAY->Panic(DISPLAY,
+                                   "Error reading program header segment.",
+                                   Status,
+                                   FALSE,
+                                   EFI_SECONDS_TO_MICROSECONDS(3));
+                    return ELF_FAILURE_LOAD_SEGMENT;
+                }
+            } else if (P_FileSize > 0) {
+                CopyMem((VOID *)P_PhysicalAddress,
+                        (VOID *)(LoadedElfPhysAddr + P_Offset),
+                        P_FileSize);
+            }
+        }
 
-        /* Copy the segment into memory at the newly-allocated, zero-init'd set of pages. */
-        if (P_FileSize > 0) {
-            CopyMem((VOID *)P_PhysicalAddress,
-                    (VOID *)(LoadedElfPhysAddr + P_Offset),
-                    P_FileSize);
+        /* Zero out any difference between FileSize and MemorySize (the BSS). */
+        if (P_MemorySize > P_FileSize) {
+            SetMem((VOID *)(P_PhysicalAddress + P_FileSize), (P_MemorySize - P_FileSize), 0x00);
         }
     }
 
@@ -186,39 +304,202 @@ VerifyAndLoadElf(IN EFI_PHYSICAL_ADDRESS LoadedElfPhysAddr,
 }
 
 
+/* Where a GOP channel mask starts and how wide it is, in the terms of a framebuffer tag. */
+STATIC
+VOID
+ElfDescribeMask(IN UINT32 Mask,
+                OUT UINT8 *Position,
+                OUT UINT8 *Size)
+{
+    *Position = 0;
+    *Size = 0;
+
+    if (0 == Mask) return;
+
+    while (0 == (Mask & 1)) {
+        Mask >>= 1;
+        ++(*Position);
+    }
+
+    while (0 != (Mask & 1)) {
+        Mask >>= 1;
+        ++(*Size);
+    }
+}
+
+
+/* Fills out a framebuffer tag straight from the current GOP mode. */
+STATIC
+VOID
+ElfDescribeFramebuffer(IN EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *Mode,
+                       OUT MultibootInfoTagFramebuffer *Framebuffer)
+{
+    EFI_PIXEL_BITMASK *Masks = &(Mode->Info->PixelInformation);
+    UINTN PixelSize = 4;   /* bytes */
+
+    /* The framebuffer pixel size is usually 32 bits. But it's possible for a GOP implementation
+        to use a masking technique. In such a case, the highest bit on the combination of all
+        masks represents the element length (pixel size). */
+    if (PixelBitMask == Mode->Info->PixelFormat) {
+        UINT32 MasksCombined = (Masks->RedMask | Masks->GreenMask | Masks->BlueMask | Masks->ReservedMask);
+        UINTN HighestBit = 0;
+
+        for (UINTN i = 32; i > 0; --i) {
+            if (MasksCombined & (1U << (i - 1))) {
+                HighestBit = i;
+                break;
+            }
+        }
+
+        PixelSize = (HighestBit < 8) ? 4 : ((HighestBit + 7) >> 3);
+    }
+
+    Framebuffer->FramebufferPhysAddr = (UINT64)(Mode->FrameBufferBase);
+    Framebuffer->Pitch = (UINT32)(Mode->Info->PixelsPerScanLine * PixelSize);
+    Framebuffer->Width = (UINT32)(Mode->Info->HorizontalResolution);
+    Framebuffer->Height = (UINT32)(Mode->Info->VerticalResolution);
+    Framebuffer->BitsPerPixel = (UINT8)(PixelSize << 3);
+    Framebuffer->Type = MULTIBOOT_FB_TYPE_RGB;   /* MFTAH-UEFI doesn't provide any other mode at this time */
+    Framebuffer->Reserved = 0x0000;
+
+    switch (Mode->Info->PixelFormat) {
+        case PixelRedGreenBlueReserved8BitPerColor:
+            ElfDescribeMask(0x000000FF, &(Framebuffer->RedFieldPosition), &(Framebuffer->RedMaskSize));
+            ElfDescribeMask(0x0000FF00, &(Framebuffer->GreenFieldPosition), &(Framebuffer->GreenMaskSize));
+            ElfDescribeMask(0x00FF0000, &(Framebuffer->BlueFieldPosition), &(Framebuffer->BlueMaskSize));
+            break;
+        case PixelBlueGreenRedReserved8BitPerColor:
+            ElfDescribeMask(0x00FF0000, &(Framebuffer->RedFieldPosition), &(Framebuffer->RedMaskSize));
+            ElfDescribeMask(0x0000FF00, &(Framebuffer->GreenFieldPosition), &(Framebuffer->GreenMaskSize));
+            ElfDescribeMask(0x000000FF, &(Framebuffer->BlueFieldPosition), &(Framebuffer->BlueMaskSize));
+            break;
+        case PixelBitMask:
+            ElfDescribeMask(Masks->RedMask, &(Framebuffer->RedFieldPosition), &(Framebuffer->RedMaskSize));
+            ElfDescribeMask(Masks->GreenMask, &(Framebuffer->GreenFieldPosition), &(Framebuffer->GreenMaskSize));
+            ElfDescribeMask(Masks->BlueMask, &(Framebuffer->BlueFieldPosition), &(Framebuffer->BlueMaskSize));
+            break;
+        default: break;
+    }
+}
+
+
+/* Memory the OS is free to take is "available" to it. Boot Services memory only counts
+    when Boot Services are actually exited; otherwise the firmware still owns it. */
+STATIC
+UINT32
+ElfMultibootMemoryType(IN UINT32 Type,
+                       IN BOOLEAN ExitsBootServices)
+{
+    switch (Type) {
+        case EfiBootServicesCode:
+        case EfiBootServicesData:
+            return (TRUE == ExitsBootServices) ? MULTIBOOT_MEM_AVAILABLE : MULTIBOOT_MEM_RESERVED;
+        case EfiLoaderCode:
+        case EfiLoaderData:
+        case EfiConventionalMemory:
+            return MULTIBOOT_MEM_AVAILABLE;
+        case EfiACPIReclaimMemory:
+            return MULTIBOOT_MEM_ACPI_RECLAIMABLE;
+        case EfiACPIMemoryNVS:
+            return MULTIBOOT_MEM_NVS;
+        case EfiUnusableMemory:
+            return MULTIBOOT_MEM_BADRAM;
+        default:
+            return MULTIBOOT_MEM_RESERVED;
+    }
+}
+
+
+/* Fetches the EFI memory map straight into the MBI (dropping the tags after `MapsOffset`),
+    then derives the Multiboot2 memory map from it. Nothing is allocated or printed, so
+    the key in `Meta` is still good for ExitBootServices afterwards. */
+STATIC
+EFI_STATUS
+ElfFillMultibootMemoryMaps(IN EFI_MULTIBOOT2_PROTOCOL *Multiboot2,
+                           IN OUT EFI_MULTIBOOT2_INFO_ARENA *Arena,
+                           IN UINT32 MapsOffset,
+                           IN UINTN MaxDescriptors,
+                           IN BOOLEAN ExitsBootServices,
+                           OUT EFI_MEMORY_MAP_META *Meta)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    MultibootInfoTagEfiMemoryMap *EfiMap = NULL;
+    MultibootInfoTagMemoryMap *Map = NULL;
+    MultibootMemoryMapEntry *Entries = NULL;
+    UINTN Count = 0;
+
+    SetMem(Meta, sizeof(EFI_MEMORY_MAP_META), 0x00);
+
+    /* Reserve the worst case first, then give back whatever the map didn't need. */
+    Arena->Header->TotalSize = MapsOffset;
+    Status = BS->GetMemoryMap(&(Meta->MemoryMapSize), NULL, &(Meta->MapKey), &(Meta->DescriptorSize), &(Meta->DescriptorVersion));
+    if (EFI_BUFFER_TOO_SMALL != Status || 0 == Meta->DescriptorSize) return EFI_NOT_FOUND;
+
+    EfiMap = (MultibootInfoTagEfiMemoryMap *)
+        Multiboot2->AddInfoTag(Multiboot2,
+                               Arena,
+                               MBI_EFI_MEMORY_MAP,
+                               (sizeof(MultibootInfoTagEfiMemoryMap) + (MaxDescriptors * Meta->DescriptorSize)));
+    if (NULL == EfiMap) return EFI_BUFFER_TOO_SMALL;
+
+    Meta->BaseDescriptor = (EFI_MEMORY_DESCRIPTOR *)((EFI_PHYSICAL_ADDRESS)EfiMap + sizeof(MultibootInfoTagEfiMemoryMap));
+    Meta->MemoryMapSize = (MaxDescriptors * Meta->DescriptorSize);
+
+    Status = BS->GetMemoryMap(&(Meta->MemoryMapSize),
+                              Meta->BaseDescriptor,
+                              &(Meta->MapKey),
+                              &(Meta->DescriptorSize),
+                              &(Meta->DescriptorVersion));
+    if (EFI_ERROR(Status)) return Status;
+
+    EfiMap->Header.Size = (UINT32)(sizeof(MultibootInfoTagEfiMemoryMap) + Meta->MemoryMapSize);
+    EfiMap->DescriptorSize = (UINT32)Meta->DescriptorSize;
+    EfiMap->DescriptorVersion = Meta->DescriptorVersion;
+    Arena->Header->TotalSize = MapsOffset + MULTIBOOT_TAG_ALIGN(EfiMap->Header.Size);
+
+    Count = (Meta->MemoryMapSize / Meta->DescriptorSize);
+
+    Map = (MultibootInfoTagMemoryMap *)
+        Multiboot2->AddInfoTag(Multiboot2,
+                               Arena,
+                               MBI_MEMORY_MAP,
+                               (sizeof(MultibootInfoTagMemoryMap) + (Count * sizeof(MultibootMemoryMapEntry))));
+    if (NULL == Map) return EFI_BUFFER_TOO_SMALL;
+
+    Map->EntrySize = sizeof(MultibootMemoryMapEntry);
+    Map->EntryVersion = 0;   /* stays Zero; see spec */
+
+    Entries = (MultibootMemoryMapEntry *)((EFI_PHYSICAL_ADDRESS)Map + sizeof(MultibootInfoTagMemoryMap));
+    for (UINTN i = 0; i < Count; ++i) {
+        EFI_MEMORY_DESCRIPTOR *d = (EFI_MEMORY_DESCRIPTOR *)
+            ((EFI_PHYSICAL_ADDRESS)(Meta->BaseDescriptor) + (i * Meta->DescriptorSize));
+
+        Entries[i].Base = d->PhysicalStart;
+        Entries[i].Length = (d->NumberOfPages * EFI_PAGE_SIZE);
+        Entries[i].Type = ElfMultibootMemoryType(d->Type, ExitsBootServices);
+    }
+
+    Multiboot2->FinishInfoArena(Multiboot2, Arena);
+    return EFI_SUCCESS;
+}
+
+
 typedef
 void volatile
 (__attribute__((sysv_abi, optnone)) *ELF_ENTRYPOINT)(VOID);
 
 
-STATIC
-EFIAPI
 VOID
-LoadImage(IN LOADER_CONTEXT *Context)
+EFIAPI
+ElfEnterKernel(IN LOADER_CONTEXT *Context,
+               IN EFI_PHYSICAL_ADDRESS Entry)
 {
     EFI_STATUS Status = EFI_SUCCESS;
-    ELF_STATUS ElfLoadStatus = ELF_SUCCESS;
-    LOADED_ELF LoadedElf = {0};
     EFI_MULTIBOOT2_PROTOCOL *Multiboot2;
     EFI_MULTIBOOT2_CONTEXT *MultibootContext;
     EFI_PHYSICAL_ADDRESS MultibootHeaderAddress;
     EFI_MEMORY_MAP_META Meta = {0};
 
-    /* Set and track a few ELF-related variables while we can. */
-    LoadedElf.ImageBegin = Context->LoadedImageBase;
-    LoadedElf.ImageEnd = (Context->LoadedImageBase + Context->LoadedImageSize);
-    LoadedElf.ImagePages = EFI_SIZE_TO_PAGES(Context->LoadedImageSize);
-
-    ElfLoadStatus = VerifyAndLoadElf(Context->LoadedImageBase, &LoadedElf);
-    if (ELF_ERROR((ElfLoadStatus))) {
-        DISPLAY->Panic(DISPLAY,
-                       ElfStatusToString(ElfLoadStatus),
-                       EFI_LOAD_ERROR,
-                       TRUE,
-                       EFI_SECONDS_TO_MICROSECONDS(10));
-    }
-
-    // TODO: Move all of this into a utility function? Because BIN will need it too.
     // TODO: Finish all MB2 tags from this section as well.
     Multiboot2 = GetMultiboot2ProtocolInstance();
 
@@ -236,53 +517,21 @@ LoadImage(IN LOADER_CONTEXT *Context)
         goto ElfEntrySkipMultiboot;
     }
 
-    /* We always provide every single piece of Multiboot2 info we can. */
-    VOID *InfoTagSet[32] = {0};
-
-    /* Command line. */
-    UINTN CmdLineLength =
-        sizeof(MultibootInfoTagHeader) + (
-            (NULL == Context->Chain->CmdLine) ? 0 : AsciiStrLen(Context->Chain->CmdLine)
-        ) + 1;
-    InfoTagSet[0] = AllocateZeroPool(CmdLineLength);
-    ((MultibootInfoTagHeader *)(InfoTagSet[0]))->Type = MBI_CMD_LINE;
-    ((MultibootInfoTagHeader *)(InfoTagSet[0]))->Size = CmdLineLength;
-    if (NULL != Context->Chain->CmdLine) {
-        CopyMem(
-            (VOID *)((EFI_PHYSICAL_ADDRESS)(InfoTagSet[0]) + sizeof(MultibootInfoTagHeader)),
-            Context->Chain->CmdLine,
-            AsciiStrLen(Context->Chain->CmdLine)
-        );
-    }
-
-    /* Boot loader name. */
+    /* We always provide every single piece of Multiboot2 info we can. The whole MBI is
+        written in place into one arena, sized up front: the memory maps get room for every
+        descriptor in the map right now, plus some slack for what changes until handoff. */
     CONST CHAR8 *LoaderName = "MFTAH Chainloader";
-    UINTN LoaderNameSize = sizeof(MultibootInfoTagHeader) + AsciiStrLen(LoaderName) + 1;
-    InfoTagSet[1] = AllocateZeroPool(LoaderNameSize);
-    ((MultibootInfoTagHeader *)(InfoTagSet[1]))->Type = MBI_LOADER_NAME;
-    ((MultibootInfoTagHeader *)(InfoTagSet[1]))->Size = LoaderNameSize;
-    CopyMem(
-        &(((MultibootInfoTagLoaderName *)(InfoTagSet[1]))->BootLoaderNameStringData),
-        LoaderName,
-        AsciiStrLen(LoaderName)
-    );
-
-    /* EFI SystemTable (64-bit) Pointer. */
-    InfoTagSet[4] = AllocateZeroPool(sizeof(MultibootInfoTagPointer64));
-    ((MultibootInfoTagHeader *)(InfoTagSet[4]))->Type = MBI_EFI_ST_64;
-    ((MultibootInfoTagHeader *)(InfoTagSet[4]))->Size = sizeof(MultibootInfoTagPointer64);
-    ((MultibootInfoTagPointer64 *)(InfoTagSet[4]))->PhysicalAddress = (EFI_PHYSICAL_ADDRESS)ST;
-
-    /* Framebuffer. We use GOP here, even if the current DISPLAY object is not in GRAPHICAL Mode.
-        NOTE: We also ignore Framebuffer tags from the OS kernel MB2 signature at this time.
-        Also NOTE: We need to do this BEFORE the memory map. */
-    InfoTagSet[5] = AllocateZeroPool(sizeof(MultibootInfoTagFramebuffer));
-    ((MultibootInfoTagHeader *)(InfoTagSet[5]))->Type = MBI_FRAMEBUFFER;
-    ((MultibootInfoTagHeader *)(InfoTagSet[5]))->Size = sizeof(MultibootInfoTagFramebuffer);
-    Status = DisplaysSetMode(GRAPHICAL, TRUE);
-    if (EFI_ERROR(Status)) {
+    CONST CHAR8 *CmdLine = (NULL == Context->Chain->CmdLine) ? "" : Context->Chain->CmdLine;
+    EFI_MULTIBOOT2_INFO_ARENA Arena = {0};
+    UINTN MapSize = 0, MapKey = 0, DescriptorSize = 0, MaxDescriptors = 0, ArenaSize = 0;
+    UINT32 DescriptorVersion = 0, MapsOffset = 0;
+    BOOLEAN ShouldExitBootServices = (NULL == MultibootContext->TagDoNotExitBootServices);
+    VOID *Tag = NULL;
+
+    Status = BS->GetMemoryMap(&MapSize, NULL, &MapKey, &DescriptorSize, &DescriptorVersion);
+    if (EFI_BUFFER_TOO_SMALL != Status || 0 == DescriptorSize) {
         DISPLAY->Panic(DISPLAY,
-                       "Failed to change to a Graphical display mode. Trying anyway.",
+                       "Failed to size the memory map for Multiboot2. Trying anyway.",
                        Status,
                        FALSE,
                        EFI_SECONDS_TO_MICROSECONDS(3));
@@ -290,25 +539,25 @@ LoadImage(IN LOADER_CONTEXT *Context)
         goto ElfEntrySkipMultiboot;
     }
 
-    Status = DISPLAY->Initialize(DISPLAY, CONFIG);
-    if (EFI_ERROR(Status)) {
-        DISPLAY->Panic(DISPLAY,
-                       "Failed to initialize Graphical display mode. Trying anyway.",
-                       Status,
-                       FALSE,
-                       EFI_SECONDS_TO_MICROSECONDS(3));
+    MaxDescriptors = (MapSize / DescriptorSize) + ELF_MBI_MEMORY_MAP_SLACK;
 
-        goto ElfEntrySkipMultiboot;
+    ArenaSize = sizeof(MultibootInfoHeader)
+        + MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagHeader) + AsciiStrLen(CmdLine) + 1)
+        + MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagHeader) + AsciiStrLen(LoaderName) + 1)
+        + MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagPointer64))
+        + MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagFramebuffer))
+        + MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagEfiMemoryMap) + (MaxDescriptors * DescriptorSize))
+        + MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagMemoryMap) + (MaxDescriptors * sizeof(MultibootMemoryMapEntry)))
+        + sizeof(MultibootInfoTagHeader);
+
+    for (UINTN i = 0; i < Context->ModulesLength; ++i) {
+        ArenaSize += MULTIBOOT_TAG_ALIGN(sizeof(MultibootInfoTagModule) + AsciiStrLen(Context->Modules[i].String) + 1);
     }
 
-    /* Upon success, 'gop_hnd->Mode' will contain everything this section of code needs... */
-    EFI_GRAPHICS_OUTPUT_PROTOCOL *gop_hnd = NULL;
-    Status = BS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid,
-                                NULL,
-                                (VOID **)&gop_hnd);
-    if (EFI_ERROR(Status) || NULL == gop_hnd || NULL == gop_hnd->Mode) {
+    Status = Multiboot2->CreateInfoArena(Multiboot2, ArenaSize, &Arena);
+    if (EFI_ERROR(Status)) {
         DISPLAY->Panic(DISPLAY,
-                       "Failed to locate Graphical display mode handle. Trying anyway.",
+                       "Failed to allocate the Multiboot2 information. Trying anyway.",
                        Status,
                        FALSE,
                        EFI_SECONDS_TO_MICROSECONDS(3));
@@ -316,150 +565,73 @@ LoadImage(IN LOADER_CONTEXT *Context)
         goto ElfEntrySkipMultiboot;
     }
 
-    if (PixelFormatMax <= gop_hnd->Mode->Info->PixelFormat || PixelBltOnly == gop_hnd->Mode->Info->PixelFormat) {
-        DISPLAY->Panic(DISPLAY,
-                       "The GOP driver does not indicate support of a physical framebuffer (BLT only). Trying anyway.",
-                       EFI_LOAD_ERROR,
-                       FALSE,
-                       EFI_SECONDS_TO_MICROSECONDS(3));
-
-        goto ElfEntrySkipMultiboot;
-    }
+    /* Command line. */
+    Tag = Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_CMD_LINE, (sizeof(MultibootInfoTagHeader) + AsciiStrLen(CmdLine) + 1));
+    if (NULL == Tag) goto ElfMultibootArenaFull;
+    CopyMem(((MultibootInfoTagCmdLine *)Tag)->CmdLineStringData, CmdLine, AsciiStrLen(CmdLine));
 
-    /* The framebuffer pixel size is usually 32 bits. But it's possible for a GOP implementation
-        to use a masking technique. In such a case, the highest bit on the combination of all
-        masks represents the element length (pixel size). */
-    UINTN pixel_size = 4;   /* bytes */
-    if (PixelBitMask == gop_hnd->Mode->Info->PixelFormat) {
-        UINT32 masks_combined = (
-            gop_hnd->Mode->Info->PixelInformation.RedMask
-            || gop_hnd->Mode->Info->PixelInformation.GreenMask
-            || gop_hnd->Mode->Info->PixelInformation.BlueMask
-            || gop_hnd->Mode->Info->PixelInformation.ReservedMask
-        );
-
-        UINTN highest_bit = 0;
-        for (int i = 32; i > 0; ++i) {
-            if (masks_combined & (1 << (i - 1))) {
-                highest_bit = i;
-                break;
-            }
-        }
+    /* Boot loader name. */
+    Tag = Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_LOADER_NAME, (sizeof(MultibootInfoTagHeader) + AsciiStrLen(LoaderName) + 1));
+    if (NULL == Tag) goto ElfMultibootArenaFull;
+    CopyMem((VOID *)((EFI_PHYSICAL_ADDRESS)Tag + sizeof(MultibootInfoTagHeader)), LoaderName, AsciiStrLen(LoaderName));
 
-        pixel_size = !highest_bit ? 4 : (highest_bit >> 3);
-    }
+    /* EFI SystemTable (64-bit) Pointer. */
+    Tag = Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_EFI_ST_64, sizeof(MultibootInfoTagPointer64));
+    if (NULL == Tag) goto ElfMultibootArenaFull;
+    ((MultibootInfoTagPointer64 *)Tag)->PhysicalAddress = (EFI_PHYSICAL_ADDRESS)ST;
+
+    /* Framebuffer. This is read straight from the current GOP mode, even if the DISPLAY is
+        not in GRAPHICAL mode. NOTE: Framebuffer tags from the kernel's MB2 header are ignored
+        at this time. Without a linear framebuffer, the tag is simply left out. */
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop = NULL;
+    Status = BS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid, NULL, (VOID **)&Gop);
+    if (
+        EFI_ERROR(Status)
+        || NULL == Gop
+        || NULL == Gop->Mode
+        || NULL == Gop->Mode->Info
+        || PixelFormatMax <= Gop->Mode->Info->PixelFormat
+        || PixelBltOnly == Gop->Mode->Info->PixelFormat
+    ) {
+        DPRINTLN("No linear GOP framebuffer to describe to the kernel.");
+    } else {
+        Tag = Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_FRAMEBUFFER, sizeof(MultibootInfoTagFramebuffer));
+        if (NULL == Tag) goto ElfMultibootArenaFull;
 
-    MultibootInfoTagFramebuffer *tag_fb = (MultibootInfoTagFramebuffer *)(InfoTagSet[5]);
-    tag_fb->FramebufferPhysAddr = (UINT64)(gop_hnd->Mode->FrameBufferBase); 
-    tag_fb->Pitch = (UINT32)(gop_hnd->Mode->Info->PixelsPerScanLine * pixel_size);
-    tag_fb->Width = (UINT32)(gop_hnd->Mode->Info->HorizontalResolution);
-    tag_fb->Height = (UINT32)(gop_hnd->Mode->Info->VerticalResolution);
-    tag_fb->BitsPerPixel = (UINT8)(pixel_size << 3);
-    tag_fb->Type = 1;   /* MFTAH-UEFI doesn't provide any other mode at this time */
-    tag_fb->Reserved = 0x0000;
-    tag_fb->RedMaskSize = 8;
-    tag_fb->GreenMaskSize = 8;
-    tag_fb->BlueMaskSize = 8;
-
-    /* Positions are calculated as (([color_value] & (1 << [masksize]) - 1) << ([position] - [masksize]). Simple, right? */
-    switch (gop_hnd->Mode->Info->PixelFormat) {
-        case PixelRedGreenBlueReserved8BitPerColor:
-            tag_fb->RedFieldPosition = 32;
-            tag_fb->GreenFieldPosition = 24;
-            tag_fb->BlueFieldPosition = 16;
-            break;
-        case PixelBlueGreenRedReserved8BitPerColor:
-            tag_fb->RedFieldPosition = 16;
-            tag_fb->GreenFieldPosition = 24;
-            tag_fb->BlueFieldPosition = 32;
-            break;
-        case PixelBitMask:
-            // TODO: Add support for this :/
-            break;
-        default: break;
+        ElfDescribeFramebuffer(Gop->Mode, (MultibootInfoTagFramebuffer *)Tag);
     }
 
-    /* Memory maps (both for EFI and the ordinary type). */
-    /* Get the system's current memory mapping. */
-    EFI_MEMORY_MAP_META Mb2MemMap = {0};
-    Status = GetMemoryMap(&Mb2MemMap);
-    if (EFI_ERROR(Status)) {
-        EFI_WARNINGLN("WARNING: Failed to get the current memory map for MBI tagging.");
-        goto MultibootSkipMemoryMap;
-    } else {
-        EFI_WARNINGLN(
-            "Got a recent memory map (%u bytes / %u entry size = %u entries).",
-            Mb2MemMap.MemoryMapSize, Mb2MemMap.DescriptorSize, (Mb2MemMap.MemoryMapSize / Mb2MemMap.DescriptorSize)
-        );
-    }
+    /* Modules. Each is handed over right where the loader put it, so nothing is copied. */
+    for (UINTN i = 0; i < Context->ModulesLength; ++i) {
+        LOADER_MODULE *Module = &(Context->Modules[i]);
 
-    UINTN MemMapTagSize = (sizeof(MultibootInfoTagMemoryMap) +
-        (sizeof(MultibootMemoryMapEntry) * (Mb2MemMap.MemoryMapSize / Mb2MemMap.DescriptorSize)));
-    InfoTagSet[2] = AllocateZeroPool(MemMapTagSize);   /* outdates the memory map LOL */
-    EFI_WARNINGLN("MB2 MEMORY MAP STRUCTURE BASE: %p (%u bytes)", InfoTagSet[2], MemMapTagSize);
-    ((MultibootInfoTagHeader *)(InfoTagSet[2]))->Type = MBI_MEMORY_MAP;
-    ((MultibootInfoTagHeader *)(InfoTagSet[2]))->Size = MemMapTagSize;
-    ((MultibootInfoTagMemoryMap *)(InfoTagSet[2]))->EntrySize = sizeof(MultibootMemoryMapEntry);
-    ((MultibootInfoTagMemoryMap *)(InfoTagSet[2]))->EntryVersion = 0;   /* stays Zero; see spec */
-    for (UINTN i = 0; i < (Mb2MemMap.MemoryMapSize / Mb2MemMap.DescriptorSize); ++i) {
-        // TODO: Testing...
-        EFI_MEMORY_DESCRIPTOR *d = ((EFI_MEMORY_DESCRIPTOR *)
-            ((EFI_PHYSICAL_ADDRESS)(Mb2MemMap.BaseDescriptor) + (i * Mb2MemMap.DescriptorSize)));
-        EFI_WARNINGLN(
-            "    Base %p -- Length 0x%08x -- Type %d",
-            d->PhysicalStart, (EFI_PAGE_SIZE * d->NumberOfPages), d->Type
-        );
-
-        MultibootMemoryMapEntry *entry = (MultibootMemoryMapEntry *)
-            (
-                ((EFI_PHYSICAL_ADDRESS)(InfoTagSet[2]) + sizeof(MultibootInfoTagMemoryMap))
-                + (i * sizeof(MultibootMemoryMapEntry))
-            );
-
-        /* Populate the map entry. */
-        EFI_WARNINGLN("        (insert record at %p)", entry);
-        entry->Base = d->PhysicalStart;
-        entry->Length = (d->NumberOfPages * EFI_PAGE_SIZE);
-        entry->Type = d->Type;
-    }
+        if ((Module->Base + Module->Length) > MULTIBOOT_MODULE_ADDRESS_LIMIT) {
+            EFI_WARNINGLN("WARNING: Module '%a' at %p is out of reach for a Multiboot2 tag.",
+                          Module->String, (VOID *)Module->Base);
+            continue;
+        }
 
-    UINTN EfiMemMapTagSize = (sizeof(MultibootInfoTagEfiMemoryMap) + Mb2MemMap.MemoryMapSize);
-    InfoTagSet[3] = AllocateZeroPool(EfiMemMapTagSize);
-    ((MultibootInfoTagHeader *)(InfoTagSet[3]))->Type = MBI_EFI_MEMORY_MAP;
-    ((MultibootInfoTagHeader *)(InfoTagSet[3]))->Size = EfiMemMapTagSize;
-    ((MultibootInfoTagEfiMemoryMap *)(InfoTagSet[3]))->DescriptorSize = Mb2MemMap.DescriptorSize;
-    ((MultibootInfoTagEfiMemoryMap *)(InfoTagSet[3]))->DescriptorVersion = Mb2MemMap.DescriptorVersion;
-    CopyMem((VOID *)((EFI_PHYSICAL_ADDRESS)(InfoTagSet[3]) + sizeof(MultibootInfoTagEfiMemoryMap)),
-            Mb2MemMap.BaseDescriptor,
-            Mb2MemMap.MemoryMapSize);
-MultibootSkipMemoryMap:
-
-    /* Finally, create the tags structure to pass to the loaded OS kernel. */
-    MultibootInfoHeader *ResultantMb2Header = NULL;
-    UINTN TagsLoadedCount = 0;
-    Status = Multiboot2->BuildInfoHeaderFromTags(Multiboot2, InfoTagSet, 6, &ResultantMb2Header, &TagsLoadedCount);
-    if (EFI_ERROR(Status)) {
-        DISPLAY->Panic(DISPLAY,
-                       "Failed to aggregate Multiboot2 tags. Trying anyway.",
-                       Status,
-                       FALSE,
-                       EFI_SECONDS_TO_MICROSECONDS(3));
+        Tag = Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_MODULES, (sizeof(MultibootInfoTagModule) + AsciiStrLen(Module->String) + 1));
+        if (NULL == Tag) goto ElfMultibootArenaFull;
 
-        goto ElfEntrySkipMultiboot;
+        ((MultibootInfoTagModule *)Tag)->ModulePhysAddrStart = (UINT32)Module->Base;
+        ((MultibootInfoTagModule *)Tag)->ModulePhysAddrEnd = (UINT32)(Module->Base + Module->Length);
+        CopyMem(((MultibootInfoTagModule *)Tag)->ModuleStringData, Module->String, AsciiStrLen(Module->String));
     }
-    else if (6 != TagsLoadedCount) {
-        DISPLAY->Panic(DISPLAY,
-                       "Some Multiboot2 tags were invalid or failed to load. Trying anyway.",
-                       Status,
-                       FALSE,
-                       EFI_SECONDS_TO_MICROSECONDS(3));
 
-        goto ElfEntrySkipMultiboot;
-    }
+    /* The memory maps come last. For now they're empty placeholders, so the MBI can be
+        validated; they're filled in right before handoff. */
+    MapsOffset = Arena.Header->TotalSize;
 
-    MultibootContext->LoadedInfoHeader = ResultantMb2Header;
+    if (
+        NULL == Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_EFI_MEMORY_MAP, sizeof(MultibootInfoTagEfiMemoryMap))
+        || NULL == Multiboot2->AddInfoTag(Multiboot2, &Arena, MBI_MEMORY_MAP, sizeof(MultibootInfoTagMemoryMap))
+    ) goto ElfMultibootArenaFull;
+
+    Multiboot2->FinishInfoArena(Multiboot2, &Arena);
+    MultibootContext->LoadedInfoHeader = Arena.Header;
 
-/* Validate the Multiboot2 header details (on both sides) before calling the ELF. */
+/* Validate the Multiboot2 header details (on both sides) before calling the kernel. */
     Status = Multiboot2->ValidateContext(Multiboot2, MultibootContext);
     if (EFI_ERROR(Status)) {
         DISPLAY->Panic(DISPLAY,
@@ -468,43 +640,60 @@ MultibootSkipMemoryMap:
                         FALSE,
                         EFI_SECONDS_TO_MICROSECONDS(3));
 
+        Multiboot2->DestroyInfoArena(Multiboot2, &Arena);
         goto ElfEntrySkipMultiboot;
     }
 
     /* De-init the loader before leaving forever. */
+    Context->ExitsBootServices = ShouldExitBootServices;
     LoaderDestroyContext(Context);
-    EFI_WARNINGLN("BOOTING ELF (Multiboot2) entry at %p...", (VOID *)(LoadedElf.LoadedImageEntry));
+    EFI_WARNINGLN("BOOTING (Multiboot2) entry at %p...", (VOID *)(Entry));
 
-    /* Exit Boot Services, as long as the loaded OS doesn't specifically say not to. */
-    if (NULL == MultibootContext->TagDoNotExitBootServices) {
-        /* Always exit Boot Services when no multiboot exists or could be configured. */
-        Status = GetMemoryMap(&Meta);
-        if (EFI_ERROR(Status)) {
-            PANIC("Failed to call `GetMemoryMap`.");
-        }
+    /* IMPORTANT NOTE: NOTHING MAY ALLOCATE OR PRINT BETWEEN FILLING THE MAPS AND EXITING BOOT SERVICES.
+        The memory map is fetched straight into the MBI, and its key is used to exit. */
+    Status = ElfFillMultibootMemoryMaps(Multiboot2, &Arena, MapsOffset, MaxDescriptors, ShouldExitBootServices, &Meta);
+    if (EFI_ERROR(Status)) {
+        PANIC("Failed to fill the Multiboot2 memory maps.");
+    }
 
-        /* IMPORTANT NOTE: DO NOT DO ANYTHING BETWEEN GETTING THE MAP AND EXITING BOOT SERVICES. */
+    /* Exit Boot Services, as long as the loaded OS doesn't specifically say not to. A stale
+        map key only calls for the map to be fetched again, once. */
+    if (TRUE == ShouldExitBootServices) {
         Status = BS->ExitBootServices(ENTRY_HANDLE, Meta.MapKey);
+        if (EFI_INVALID_PARAMETER == Status) {
+            Status = ElfFillMultibootMemoryMaps(Multiboot2, &Arena, MapsOffset, MaxDescriptors, ShouldExitBootServices, &Meta);
+            if (!EFI_ERROR(Status)) Status = BS->ExitBootServices(ENTRY_HANDLE, Meta.MapKey);
+        }
         if (EFI_ERROR(Status)) {
             PANIC("Failed to call `ExitBootServices` properly.");
         }
 
         FinalizeExitBootServices(&Meta);
     }
-    // End TODO
 
     /* Set raw register values according to the Multiboot2 specification. */
-    asm ("" :  : "a"(MULTIBOOT_INFO_MAGIC), "b"(MultibootContext->LoadedInfoHeader));
+    asm ("" :  : "a"(MULTIBOOT_INFO_MAGIC), "b"(Arena.Header));
 
     goto ElfEntryWithMultiboot;
 
 
+ElfMultibootArenaFull:
+    DISPLAY->Panic(DISPLAY,
+                   "Ran out of room for Multiboot2 tags. Trying anyway.",
+                   EFI_BUFFER_TOO_SMALL,
+                   FALSE,
+                   EFI_SECONDS_TO_MICROSECONDS(3));
+
+    Multiboot2->DestroyInfoArena(Multiboot2, &Arena);
+
+
 ElfEntrySkipMultiboot:
     /* Always exit Boot Services when no multiboot exists or could be configured. */
 
     /* De-init the loader before leaving forever. */
+    Context->ExitsBootServices = TRUE;
     LoaderDestroyContext(Context);
-    EFI_WARNINGLN("BOOTING ELF (normal) entry at %p...", (VOID *)(LoadedElf.LoadedImageEntry));
+    EFI_WARNINGLN("BOOTING (normal) entry at %p...", (VOID *)(Entry));
 
     Status = GetMemoryMap(&Meta);
     if (EFI_ERROR(Status)) {
@@ -521,8 +710,8 @@ ElfEntrySkipMultiboot:
 
 
 ElfEntryWithMultiboot:
-    /* Call the ELF entrypoint. Do NOT expect a return value or to come back from it. */
-    ((ELF_ENTRYPOINT)(LoadedElf.LoadedImageEntry))();
+    /* Call the entrypoint. Do NOT expect a return value or to come back from it. */
+    ((ELF_ENTRYPOINT)(Entry))();
 
     /* Hang indefinitely. Since we've finalized Boot Services here, it's not
         very feasible to try displaying anything to indicate the loaded OS returned. */
@@ -530,4 +719,40 @@ ElfEntryWithMultiboot:
 }
 
 
+STATIC
+EFIAPI
+VOID
+LoadImage(IN LOADER_CONTEXT *Context)
+{
+    ELF_STATUS ElfLoadStatus = ELF_SUCCESS;
+    LOADED_ELF LoadedElf = {0};
+
+    /* Set and track a few ELF-related variables while we can. */
+    LoadedElf.ImageBegin = Context->LoadedImageBase;
+    LoadedElf.ImageEnd = (Context->LoadedImageBase + Context->LoadedImageSize);
+    LoadedElf.ImagePages = EFI_SIZE_TO_PAGES(Context->LoadedImageSize);
+
+    /* Only pages the loaded image owns can hold its segments in place. */
+    EFI_PHYSICAL_ADDRESS OwnedEnd = (0 == Context->LoadedImageAllocation.Pages)
+        ? 0
+        : (Context->LoadedImageAllocation.Base + (Context->LoadedImageAllocation.Pages * EFI_PAGE_SIZE));
+
+    ElfLoadStatus = VerifyAndLoadElf(Context, OwnedEnd, &LoadedElf);
+    if (ELF_ERROR((ElfLoadStatus))) {
+        DISPLAY->Panic(DISPLAY,
+                       ElfStatusToString(ElfLoadStatus),
+                       EFI_LOAD_ERROR,
+                       TRUE,
+                       EFI_SECONDS_TO_MICROSECONDS(10));
+    }
+
+    /* Unless segments were used in place, every segment has its own pages now. The file
+        image is still searched for a Multiboot2 header below, so it's only freed when the
+        context is destroyed. */
+    if (FALSE == LoadedElf.SegmentsInPlace) LoaderRetireLoadedImage(Context);
+
+    ElfEnterKernel(Context, LoadedElf.LoadedImageEntry);
+}
+
+
 EFI_EXECUTABLE_LOADER ElfLoader = { .Load = LoadImage };
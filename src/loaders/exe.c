@@ -14,12 +14,14 @@ LoadImage(IN LOADER_CONTEXT *Context)
     EFI_LOADED_IMAGE_PROTOCOL *LIP = NULL;
 
     /* This is relatively easy, just run the memory location in the context
-        through LoadImage and StartImage Boot Services methods. */
+        through LoadImage and StartImage Boot Services methods. When nothing was
+        loaded, the device path names the file itself, and the firmware reads it
+        straight into the image it relocates. */
     Status = BS->LoadImage(FALSE,
                            ENTRY_HANDLE,
                            Context->LoadedImageDevicePath,
-                           (VOID *)Context->LoadedImageBase,
-                           Context->LoadedImageSize,
+                           (0 == Context->LoadedImageBase) ? NULL : (VOID *)Context->LoadedImageBase,
+                           (0 == Context->LoadedImageBase) ? 0 : Context->LoadedImageSize,
                            &LoadedImageHandle);
     if (EFI_ERROR(Status) || NULL == LoadedImageHandle) {
         // TODO: More granular panics here so the user knows wth is going on.
@@ -27,24 +29,31 @@ LoadImage(IN LOADER_CONTEXT *Context)
         PANIC("LoadImage: Critical exception encountered while readying the in-memory image.");
     }
 
+    /* The firmware made its own copy of the image, so the payload buffer is dead. It's
+        returned to the firmware before the image starts. */
+    LoaderRetireLoadedImage(Context);
+
     /* Skip over the below, no errors.
         Never-nesting goes HARD when you know what you're doin. */
-    if (NULL == Context->Chain->CmdLine) goto LoadImage__NoCmdLine;
+    if (NULL == Context->Chain->CmdLine) goto LoadImage__Start;
 
     Status = BS->HandleProtocol(LoadedImageHandle, &gEfiLoadedImageProtocolGuid, &LIP);
-    if (!EFI_ERROR(Status) && NULL != LIP) goto LoadImage__ErrorNoCmdLine;
+    if (EFI_ERROR(Status) || NULL == LIP) goto LoadImage__ErrorNoCmdLine;
 
-    /* First, reserve a copy of the cmdline data as a Reserved region. */
-    CHAR8 *CmdCopy = NULL;
+    /* First, reserve a copy of the cmdline data as a Reserved region. EFI applications
+        (the Linux EFI stub included) read their load options as UCS-2. */
+    CHAR16 *CmdCopy = NULL;
     UINTN CmdLen = AsciiStrLen(Context->Chain->CmdLine);
 
-    BS->AllocatePool(EfiReservedMemoryType, CmdLen + 1, &CmdCopy);
+    BS->AllocatePool(EfiReservedMemoryType, (CmdLen + 1) * sizeof(CHAR16), (VOID **)&CmdCopy);
     if (NULL == CmdCopy) goto LoadImage__ErrorNoCmdLine;
-    CopyMem(CmdCopy, Context->Chain->CmdLine, CmdLen);
+    for (UINTN i = 0; i <= CmdLen; ++i) CmdCopy[i] = (CHAR16)Context->Chain->CmdLine[i];
 
     /* Set the load option to the reserved command line. */
     LIP->LoadOptions = (VOID *)CmdCopy;
-    LIP->LoadOptionsSize = CmdLen + 1;
+    LIP->LoadOptionsSize = (UINT32)((CmdLen + 1) * sizeof(CHAR16));
+
+    goto LoadImage__Start;
 
 LoadImage__ErrorNoCmdLine:
     DISPLAY->Panic(DISPLAY,
@@ -54,7 +63,7 @@ LoadImage__ErrorNoCmdLine:
                    EFI_SECONDS_TO_MICROSECONDS(10));
     HALT;
 
-LoadImage__NoCmdLine:
+LoadImage__Start:
     /* Clean up as many resources as we can think of. */
     // TODO: Trace all this. Tidy up.
     LoaderDestroyContext(Context);
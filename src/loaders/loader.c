@@ -4,8 +4,12 @@
 #include "../include/loaders/exe.h"
 #include "../include/loaders/elf.h"
 #include "../include/loaders/bin.h"
+#include "../include/loaders/uki.h"
+#include "../include/loaders/multiboot.h"
+#include "../include/loaders/plan.h"
 
 #include "../include/drivers/displays.h"
+#include "../include/drivers/initrd.h"
 #include "../include/drivers/mftah_adapter.h"
 #include "../include/drivers/ramdisk.h"
 #include "../include/drivers/threading.h"
@@ -136,202 +140,632 @@ MftahDecryptionSpin(IN UINT64 *QueuedBytes)
 }
 
 
+/* Resolves a configured path (with an optional 'VOLUME:' prefix) to the device handle
+    it resides on and a newly-allocated, backslash-separated file path on that device. */
 STATIC
 EFI_STATUS
-LoaderReadImageParts(IN LOADER_CONTEXT *Context,
-                     IN EFI_HANDLE TargetHandle,
-                     IN CHAR16 *PayloadPath)
+LoaderResolvePath(IN CONST CHAR8 *ConfigPath,
+                  OUT EFI_HANDLE *DeviceHandle,
+                  OUT CHAR16 **FilePath)
 {
     if (
-        NULL == Context
-        || NULL == TargetHandle
-        || NULL == PayloadPath
-        || 0 == StrLen(PayloadPath)
+        NULL == ConfigPath
+        || '\0' == *ConfigPath
+        || NULL == DeviceHandle
+        || NULL == FilePath
     ) return EFI_INVALID_PARAMETER;
 
     EFI_STATUS Status = EFI_SUCCESS;
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    CONST CHAR8 *s = ConfigPath;
 
-    UINTN CurrentPart = 0;
-    UINTN DiscoveredParts = 0;
+    for (CONST CHAR8 *p = ConfigPath; *p; ++p) {
+        if (':' == *p) {
+            s = p;
+            break;
+        }
+    }
 
-    UINTN ImagePartSizes[10] = {0};
-    UINTN TotalImageSize = 0;
+    if (s != ConfigPath) {
+        if ('\0' == *(s + 1)) return EFI_LOAD_ERROR;
 
-    UINTN PayloadPathLength = StrLen(PayloadPath);
+        /* Copy out the volume name rather than terminating the configured string in-place. */
+        CHAR8 *VolumeName8 = (CHAR8 *)AllocateZeroPool(sizeof(CHAR8) * ((s - ConfigPath) + 1));
+        if (NULL == VolumeName8) return EFI_OUT_OF_RESOURCES;
 
-    /* Walk the payload fragments from .0 through and including .9. This breaks out wherever the
-        chain of fragments end (the first one not found). If the .0 fragment is not found, exits
-        with an EFI_NOT_FOUND error. */
-    do {
-        *((CHAR8 *)&(PayloadPath[PayloadPathLength - 1])) = ('0' + CurrentPart);
+        CopyMem(VolumeName8, ConfigPath, (s - ConfigPath));
 
-        Status = FileSizeFromPath(PayloadPath,
-                                  TargetHandle,
-                                  (TargetHandle == ENTRY_HANDLE),
-                                  &(ImagePartSizes[CurrentPart]));
-        if (EFI_NOT_FOUND == Status) {
-            if (0 == CurrentPart) return EFI_NOT_FOUND;
-            else break;
-        } else if (EFI_ERROR(Status) || 0 == ImagePartSizes[CurrentPart]) return Status;
+        /* Get the unicode version of the volume name string. */
+        CHAR16 *VolumeName = AsciiStrToUnicode(VolumeName8);
+        FreePool(VolumeName8);
+
+        if (NULL == VolumeName) return EFI_OUT_OF_RESOURCES;
+
+        Status = GetFileSystemHandleByVolumeName(VolumeName, DeviceHandle);
+        FreePool(VolumeName);
+
+        if (EFI_ERROR(Status)) return Status;
+
+        ++s;   /* increment by one to set it to the filename */
+    } else {
+        /* Use the drive of this application as the relative filesystem to load from. */
+        ERRCHECK(
+            BS->HandleProtocol(ENTRY_HANDLE,
+                               &gEfiLoadedImageProtocolGuid,
+                               (VOID **)&LoadedImage)
+        );
+
+        *DeviceHandle = LoadedImage->DeviceHandle;
+    }
+
+    *FilePath = AsciiStrToUnicode((CHAR8 *)s);
+    if (NULL == *FilePath) return EFI_OUT_OF_RESOURCES;
+
+    /* Convert the path separators to the m$ version ('\'). Not doing this
+        will cause `ReadFile` to return errors. */
+    // TODO Move to the chain validation method from `config.c`
+    for (CHAR16 *c = *FilePath; *c; ++c) if (L'/' == *c) *c = L'\\';
+
+    return EFI_SUCCESS;
+}
+
+
+/* Plain ELF payloads are read straight to wherever their segments belong. Returns
+    EFI_UNSUPPORTED when the layout doesn't allow it, leaving the ELF to be streamed. */
+STATIC
+EFI_STATUS
+LoaderProbeElfPayload(IN EFI_HANDLE DeviceHandle,
+                      IN CHAR16 *PayloadPath,
+                      OUT EFI_PHYSICAL_ADDRESS *ImageBase,
+                      OUT UINTN *ExtraEndAllocation)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN FileSize = 0, ProbeLength = 0;
+    UINT8 *Probe = NULL;
+    UINT64 ImageLength = 0;
+
+    ERRCHECK(FileSizeFromPath(PayloadPath, DeviceHandle, FALSE, &FileSize));
+    if (0 == FileSize) return EFI_END_OF_FILE;
 
-        TotalImageSize += ImagePartSizes[CurrentPart];
-    } while (++CurrentPart < 10);
+    ProbeLength = MIN(FileSize, ELF_IN_PLACE_PROBE_SIZE);
 
-    /* At this point, we've discovered up to (not including) `CurrentPart` parts. */
-    DiscoveredParts = CurrentPart;
+    Probe = (UINT8 *)AllocateZeroPool(ProbeLength);
+    if (NULL == Probe) return EFI_OUT_OF_RESOURCES;
 
-    /* Reserve the total size. */
-    Context->LoadedImageSize = TotalImageSize;
+    Status = ReadFileRange(DeviceHandle, PayloadPath, 0, ProbeLength, Probe, NULL);
+    if (!EFI_ERROR(Status)) {
+        Status = ElfGetInPlaceLayout(Probe, ProbeLength, FileSize, ImageBase, &ImageLength);
+        if (EFI_BUFFER_TOO_SMALL == Status) Status = EFI_UNSUPPORTED;
+    }
 
-    Status = BS->AllocatePool(EfiReservedMemoryType, TotalImageSize, (VOID **)&(Context->LoadedImageBase));
+    FreePool(Probe);
     if (EFI_ERROR(Status)) return Status;
-    else if ((EFI_PHYSICAL_ADDRESS)NULL == Context->LoadedImageBase) return EFI_OUT_OF_RESOURCES;
-
-    /* Iterate the set of parts and load them into a consecutive block of memory. */
-    UINT8 *LoadAddress = (UINT8 *)Context->LoadedImageBase;
-
-    for (CurrentPart = 0; CurrentPart < DiscoveredParts; ++CurrentPart) {
-        *((CHAR8 *)&(PayloadPath[PayloadPathLength - 1])) = ('0' + CurrentPart);
-
-        CHAR8 *CurrentPath = (CHAR8 *)AllocateZeroPool(sizeof(CHAR8) * (128 + 1));
-        if (NULL == CurrentPath) return EFI_OUT_OF_RESOURCES;
-
-        AsciiSPrint(CurrentPath, 128, "Reading Part %u...", (CurrentPart + 1));
-        ProgressStatusMessage = CurrentPath;
-
-        Status = ReadFile(TargetHandle,
-                          PayloadPath,
-                          0U,
-                          &LoadAddress,
-                          &(ImagePartSizes[CurrentPart]),
-                          (TargetHandle == ENTRY_HANDLE),
-                          EfiReservedMemoryType,
-                          0,
-                          0,
-                          ProgressWrapper);
-        if (EFI_ERROR(Status)) return Status;
 
-        LoadAddress = (UINT8 *)((EFI_PHYSICAL_ADDRESS)LoadAddress + ImagePartSizes[CurrentPart]);
+    DPRINTLN("ELF payload can be loaded in place at %p (%u bytes).", (VOID *)*ImageBase, ImageLength);
 
-        FreePool(CurrentPath);
-        ProgressStatusMessage = NULL;
+    /* BSS past the end of the file is covered by the same allocation. */
+    *ExtraEndAllocation = (UINTN)(ImageLength - FileSize);
+    return EFI_SUCCESS;
+}
+
+
+/* Claims the PT_LOAD ranges listed in an ELF's program header table. */
+STATIC
+VOID
+LoaderClaimElfProgramHeaders(IN LOADER_PLAN *Plan,
+                             IN CONST Elf64Header *Header,
+                             IN CONST UINT8 *Table)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    for (UINTN i = 0; i < Header->ProgramHeaderCount; ++i) {
+        Elf64ProgramHeader PHdr = {0};
+        CopyMem(&PHdr, (Table + (i * Header->ProgramHeaderEntrySizeBytes)), sizeof(Elf64ProgramHeader));
+
+        if (PT_LOAD != PHdr.Type || 0 == PHdr.MemorySize) continue;
+
+        EFI_PHYSICAL_ADDRESS Start = PHdr.PhysicalAddress & ~((EFI_PHYSICAL_ADDRESS)EFI_PAGE_MASK);
+        EFI_PHYSICAL_ADDRESS End = PHdr.PhysicalAddress + PHdr.MemorySize;
+
+        if (End < PHdr.PhysicalAddress) continue;
+
+        Status = PlanAddClaim(Plan, Start, EFI_SIZE_TO_PAGES(End - Start));
+        if (EFI_ERROR(Status)) {
+            DPRINTLN("Too many ELF segments to claim them all (%u).", Status);
+            break;
+        }
     }
+}
+
 
+/* A streamed ELF's segments are allocated at their physical addresses by the ELF loader,
+    long after the plan has placed everything else. Those ranges are claimed up front, so
+    no data ramdisk or module is put where a segment must go. */
+STATIC
+EFI_STATUS
+LoaderClaimElfSegments(IN LOADER_PLAN *Plan,
+                       IN EFI_HANDLE DeviceHandle,
+                       IN CHAR16 *PayloadPath)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    Elf64Header Header = {0};
+    UINT8 *Table = NULL;
+    UINTN TableLength = 0;
+
+    /* Anything which isn't a 64-bit ELF is reported by the ELF loader itself. */
+    Status = ReadFileRange(DeviceHandle, PayloadPath, 0, sizeof(Elf64Header), &Header, NULL);
+    if (
+        EFI_ERROR(Status)
+        || EC_64 != Header.Ident.Class
+        || Header.ProgramHeaderEntrySizeBytes < sizeof(Elf64ProgramHeader)
+    ) return EFI_SUCCESS;
+
+    TableLength = (UINTN)Header.ProgramHeaderCount * Header.ProgramHeaderEntrySizeBytes;
+    if (0 == TableLength) return EFI_SUCCESS;
+
+    Table = (UINT8 *)AllocatePool(TableLength);
+    if (NULL == Table) return EFI_OUT_OF_RESOURCES;
+
+    Status = ReadFileRange(DeviceHandle,
+                           PayloadPath,
+                           (UINTN)Header.ProgramHeaderTableOffset,
+                           TableLength,
+                           Table,
+                           NULL);
+    if (!EFI_ERROR(Status)) LoaderClaimElfProgramHeaders(Plan, &Header, Table);
+
+    FreePool(Table);
     return EFI_SUCCESS;
 }
 
 
+/* A compressed ELF is decompressed to where its segments belong, or streamed there, once
+    the plan is done, so its ranges are claimed just the same. Only the image's index and
+    first frame are read for that: the program headers have to be in the first frame. */
 STATIC
 EFI_STATUS
-LoaderReadImage(IN LOADER_CONTEXT *Context)
+LoaderClaimCompressedElfSegments(IN LOADER_PLAN *Plan,
+                                 IN EFI_HANDLE DeviceHandle,
+                                 IN CHAR16 *PayloadPath)
 {
     EFI_STATUS Status = EFI_SUCCESS;
-    UINTN at = 0, total = 100;
+    COMPRESSED_IMAGE_HEADER Header = {0};
+    COMPRESSED_IMAGE Image = {0};
+    UINT64 IndexEnd = 0, ProbeLength = 0, FrameOffsets[2] = {0};
+    UINTN FileSize = 0, FrameLength = 0;
+    UINT8 *Probe = NULL, *Frame = NULL;
+    Elf64Header *Elf = NULL;
+    UINT64 TableEnd = 0;
+
+    /* Bad images are reported once the payload is opened for decompression. */
+    ERRCHECK(FileSizeFromPath(PayloadPath, DeviceHandle, FALSE, &FileSize));
+
+    Status = ReadFileRange(DeviceHandle, PayloadPath, 0, sizeof(COMPRESSED_IMAGE_HEADER), &Header, NULL);
+    if (EFI_ERROR(Status) || 0 == Header.FramesCount || Header.FramesCount >= (FileSize / sizeof(UINT64))) {
+        return EFI_SUCCESS;
+    }
 
-    if (NULL == Context) return EFI_INVALID_PARAMETER;
+    Status = ReadFileRange(DeviceHandle,
+                           PayloadPath,
+                           sizeof(COMPRESSED_IMAGE_HEADER),
+                           sizeof(FrameOffsets),
+                           FrameOffsets,
+                           NULL);
+    if (EFI_ERROR(Status)) return EFI_SUCCESS;
+
+    IndexEnd = sizeof(COMPRESSED_IMAGE_HEADER) + ((Header.FramesCount + 1) * sizeof(UINT64));
+    ProbeLength = MAX(IndexEnd, FrameOffsets[1]);
+    if (ProbeLength > FileSize) return EFI_SUCCESS;
+
+    Probe = (UINT8 *)AllocatePool((UINTN)ProbeLength);
+    if (NULL == Probe) return EFI_OUT_OF_RESOURCES;
+
+    /* The probe is opened with the size of the whole file, so the index validates as it
+        would later on. Nothing past the first frame is ever read from it. */
+    Status = ReadFileRange(DeviceHandle, PayloadPath, 0, (UINTN)ProbeLength, Probe, NULL);
+    if (!EFI_ERROR(Status)) Status = CompressedImageOpen(Probe, FileSize, &Image);
+    if (EFI_ERROR(Status)) goto LoaderClaimCompressedElfSegments__Exit;
+
+    FrameLength = CompressedImageFrameLength(&Image, 0);
+
+    Frame = (UINT8 *)AllocatePool(FrameLength);
+    if (NULL == Frame) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto LoaderClaimCompressedElfSegments__Exit;
+    }
 
-    ProgressStatusMessage = "Locating File...";
+    Status = CompressedImageReadFrame(&Image, 0, Frame);
+    if (EFI_ERROR(Status) || FrameLength < sizeof(Elf64Header)) goto LoaderClaimCompressedElfSegments__Exit;
 
-    /* Render the initial progress details and the stall art */
-    DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
-    if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 500);
+    /* Anything which isn't a 64-bit ELF is reported by the ELF loader itself. */
+    Elf = (Elf64Header *)Frame;
+    TableEnd = Elf->ProgramHeaderTableOffset
+        + ((UINT64)Elf->ProgramHeaderCount * Elf->ProgramHeaderEntrySizeBytes);
 
-    if (NULL == Context->Chain->PayloadPath || '\0' == *(Context->Chain->PayloadPath)) {
-        return EFI_LOAD_ERROR;   /* bad/null filename */
+    if (
+        EC_64 != Elf->Ident.Class
+        || Elf->ProgramHeaderEntrySizeBytes < sizeof(Elf64ProgramHeader)
+        || Elf->ProgramHeaderTableOffset > FrameLength
+    ) goto LoaderClaimCompressedElfSegments__Exit;
+
+    if (TableEnd > FrameLength) {
+        DPRINTLN("Compressed ELF program headers end past its first frame; nothing is claimed.");
+        goto LoaderClaimCompressedElfSegments__Exit;
     }
 
-    /* Use the base image handle as the relative filesystem to load from. If a path
-        is prefixed by a volume name, try to get that volume's handle instead. */
-    EFI_HANDLE TargetHandle = ENTRY_HANDLE;
+    LoaderClaimElfProgramHeaders(Plan, Elf, (Frame + Elf->ProgramHeaderTableOffset));
 
-    CHAR8 *p = Context->Chain->PayloadPath;
-    CHAR8 *s = p;
+LoaderClaimCompressedElfSegments__Exit:
+    if (NULL != Frame) FreePool(Frame);
+    FreePool(Probe);
 
-    for (; *p; ++p) {
-        if (':' == *p) {
-            s = p;
-            break;
+    return (EFI_OUT_OF_RESOURCES == Status) ? Status : EFI_SUCCESS;
+}
+
+
+/* Streams a range of a plain payload straight out of its file. */
+STATIC
+EFI_STATUS
+EFIAPI
+LoaderReadFileRange(IN LOADER_CONTEXT *Context,
+                    IN UINT64 Offset,
+                    IN UINTN Length,
+                    OUT VOID *Destination)
+{
+    return ReadFileRange(Context->StreamDeviceHandle,
+                         Context->StreamPath,
+                         (UINTN)Offset,
+                         Length,
+                         Destination,
+                         NULL);
+}
+
+
+/* Decompresses a range of a compressed payload straight to its destination. Runs of whole
+    frames are written in place (in parallel); only the frames cut by either end of the
+    range go through a scratch frame first. */
+STATIC
+EFI_STATUS
+EFIAPI
+LoaderReadCompressedRange(IN LOADER_CONTEXT *Context,
+                          IN UINT64 Offset,
+                          IN UINTN Length,
+                          OUT VOID *Destination)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    CONST COMPRESSED_IMAGE *Image = &(Context->StreamImage);
+    UINT64 At = Offset, End = Offset + Length;
+    UINT8 *Scratch = NULL;
+
+    if (End < Offset || End > Image->UncompressedSize) return EFI_END_OF_FILE;
+
+    while (At < End) {
+        UINTN Frame = (UINTN)(At / Image->FrameSize), Whole = 0;
+        UINT64 FrameStart = (UINT64)Frame * Image->FrameSize;
+        UINT8 *To = (UINT8 *)Destination + (At - Offset);
+
+        if (At == FrameStart) {
+            while (
+                (Frame + Whole) < Image->FramesCount
+                && (FrameStart + ((UINT64)Whole * Image->FrameSize)
+                    + CompressedImageFrameLength(Image, (Frame + Whole))) <= End
+            ) ++Whole;
+        }
+
+        if (0 != Whole) {
+            Status = CompressedImageDecompressFrames(Image, Frame, Whole, To, NULL);
+            if (EFI_ERROR(Status)) break;
+
+            At = MIN((FrameStart + ((UINT64)Whole * Image->FrameSize)), Image->UncompressedSize);
+            continue;
+        }
+
+        if (NULL == Scratch) {
+            Scratch = (UINT8 *)AllocatePool(Image->FrameSize);
+            if (NULL == Scratch) {
+                Status = EFI_OUT_OF_RESOURCES;
+                break;
+            }
         }
+
+        Status = CompressedImageReadFrame(Image, Frame, Scratch);
+        if (EFI_ERROR(Status)) break;
+
+        UINT64 Take = MIN(End, (FrameStart + CompressedImageFrameLength(Image, Frame))) - At;
+        CopyMem(To, (Scratch + (At - FrameStart)), (UINTN)Take);
+
+        At += Take;
     }
 
-    if (s != Context->Chain->PayloadPath) {
-        *s = '\0';   /* terminate the string here */
-        ++s;   /* increment by one to set it to the filename */
-        if ('\0' == *s) return EFI_LOAD_ERROR;
+    if (NULL != Scratch) FreePool(Scratch);
+    return Status;
+}
 
-        /* Get the unicode version of the volume name string. */
-        CHAR16 *VolumeName = AsciiStrToUnicode(Context->Chain->PayloadPath);
 
-        ProgressStatusMessage = "Opening Volume...";
-        at = 50; DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
-        if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 500);
+/* A streamed ELF only keeps the start of its contents in memory: enough for the ELF loader
+    to find its program headers and any Multiboot2 header. */
+STATIC
+EFI_STATUS
+LoaderReadStreamHead(IN LOADER_CONTEXT *Context,
+                     IN UINT64 PayloadSize)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN HeadLength = 0;
+    UINT8 *Head = NULL;
+    UINT64 TableEnd = 0;
 
-        Status = GetFileSystemHandleByVolumeName(VolumeName, &TargetHandle);
-        FreePool(VolumeName);
+    HeadLength = (UINTN)MIN(PayloadSize, MULTIBOOT_SEARCH_LIMIT);
 
-        if (EFI_ERROR(Status)) return Status;
+    /* The second pass only happens when the program headers sit past the search window. */
+    for (UINTN Pass = 0; Pass < 2; ++Pass) {
+        Head = (UINT8 *)AllocatePool(HeadLength);
+        if (NULL == Head) return EFI_OUT_OF_RESOURCES;
+
+        Status = Context->ReadPayloadRange(Context, 0, HeadLength, Head);
+        if (EFI_ERROR(Status)) {
+            FreePool(Head);
+            return Status;
+        }
+
+        if (HeadLength < sizeof(Elf64Header)) break;
+
+        TableEnd = ((Elf64Header *)Head)->ProgramHeaderTableOffset
+            + ((UINT64)((Elf64Header *)Head)->ProgramHeaderCount
+                * ((Elf64Header *)Head)->ProgramHeaderEntrySizeBytes);
+
+        if (TableEnd <= HeadLength || TableEnd > PayloadSize) break;
+
+        FreePool(Head);
+        HeadLength = (UINTN)TableEnd;
+    }
+
+    Context->LoadedImageBase = (EFI_PHYSICAL_ADDRESS)Head;
+    Context->LoadedImageSize = HeadLength;
+
+    Context->LoadedImageAllocation.Base  = (EFI_PHYSICAL_ADDRESS)Head;
+    Context->LoadedImageAllocation.Pages = 0;
+
+    return EFI_SUCCESS;
+}
+
+
+/* Compressed payloads are decompressed into room the plan reserves along with everything
+    else, sized from the image's header. An MFTAH payload's header is still encrypted at
+    this point, and an ELF is decompressed to where its segments belong (or streamed), so
+    those are left for `LoaderDecompress` to place. */
+STATIC
+EFI_STATUS
+LoaderPlanDecompression(IN LOADER_CONTEXT *Context,
+                        IN LOADER_PLAN *Plan,
+                        IN EFI_HANDLE DeviceHandle,
+                        IN CHAR16 *PayloadPath,
+                        IN UINTN PayloadBuffer,
+                        OUT UINTN *BufferIndex)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    COMPRESSED_IMAGE_HEADER Header = {0};
+
+    *BufferIndex = LOADER_PLAN_MAX_BUFFERS;
+
+    if (
+        FALSE == Context->Chain->IsCompressed
+        || TRUE == Context->Chain->IsMFTAH
+        || ELF == Context->Chain->Type
+    ) return EFI_SUCCESS;
+
+    /* A bad header is reported once the payload is opened for decompression. */
+    Status = ReadFileRange(DeviceHandle, PayloadPath, 0, sizeof(COMPRESSED_IMAGE_HEADER), &Header, NULL);
+    if (
+        EFI_ERROR(Status)
+        || 0 != CompareMem(Header.Signature, COMPRESSED_IMAGE_SIGNATURE, sizeof(Header.Signature))
+        || 0 == Header.UncompressedSize
+    ) {
+        DPRINTLN("Could not size the compressed payload up front (%u).", Status);
+        return EFI_SUCCESS;
     }
 
+    ERRCHECK(PlanAddBuffer(Plan, Plan->Buffers[PayloadBuffer].MemoryType, 0, 0, TRUE, BufferIndex));
+
+    Plan->Buffers[*BufferIndex].ReserveSize = (UINTN)Header.UncompressedSize;
+    Plan->Buffers[*BufferIndex].NeedsWorkingCopy = Plan->Buffers[PayloadBuffer].NeedsWorkingCopy;
+
+    /* A raw binary is decompressed straight to its load address, when that's free. */
+    if (BIN == Context->Chain->Type) {
+        Plan->Buffers[*BufferIndex].FixedBase = Context->Chain->LoadAddress;
+    }
+
+    /* The compressed image is only ever decompressed from, into the reserved room. */
+    Plan->Buffers[PayloadBuffer].NeedsWorkingCopy = FALSE;
+
+    return EFI_SUCCESS;
+}
+
+
+STATIC
+EFI_STATUS
+LoaderPlanPayload(IN LOADER_CONTEXT *Context,
+                  IN LOADER_PLAN *Plan,
+                  OUT UINTN *BufferIndex,
+                  OUT UINTN *DecompressBuffer)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_HANDLE DeviceHandle = NULL;
+    CHAR16 *PayloadPath = NULL;
+    UINTN PayloadPathLength = 0;
+    UINTN PartSize = 0;
+
+    *DecompressBuffer = LOADER_PLAN_MAX_BUFFERS;
+
+    if (NULL == Context->Chain->PayloadPath || '\0' == *(Context->Chain->PayloadPath)) {
+        return EFI_LOAD_ERROR;   /* bad/null filename */
+    }
+
+    ERRCHECK(LoaderResolvePath(Context->Chain->PayloadPath, &DeviceHandle, &PayloadPath));
+
     /* Set the context's device handle for chainloaded images,
             in case we're loading another EFI application. */
-    Context->LoadedImageDevicePath = DevicePathFromHandle(TargetHandle);
+    Context->LoadedImageDevicePath = DevicePathFromHandle(DeviceHandle);
+
+    if (FALSE == Context->Chain->PayloadParts) {
+        EFI_PHYSICAL_ADDRESS FixedBase = 0;
+        UINTN ExtraEndAllocation = 0;
+
+        /* Plain ELF payloads which can't be read in place are streamed segment-by-segment
+            by the ELF loader instead, so they never take up a staging buffer. */
+        if (
+            ELF == Context->Chain->Type
+            && FALSE == Context->Chain->IsMFTAH
+            && FALSE == Context->Chain->IsCompressed
+        ) {
+            Status = LoaderProbeElfPayload(DeviceHandle, PayloadPath, &FixedBase, &ExtraEndAllocation);
+
+            if (EFI_UNSUPPORTED == Status) {
+                Status = LoaderClaimElfSegments(Plan, DeviceHandle, PayloadPath);
+                if (EFI_ERROR(Status)) {
+                    FreePool(PayloadPath);
+                    return Status;
+                }
 
-    /* Do stuff with slight stalls between progress messages. */
-    ProgressStatusMessage = "Reading Payload...";
-    at = 0; DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
-    if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 500);
+                Context->ReadPayloadRange = LoaderReadFileRange;
+                Context->StreamDeviceHandle = DeviceHandle;
+                Context->StreamPath = PayloadPath;
 
-    /* Set to FALSE by threads (if enabled) to stop the asynchronous loading animation. */
-    BOOLEAN VOLATILE StillLoading = TRUE;
+                *BufferIndex = LOADER_PLAN_MAX_BUFFERS;
+                return EFI_SUCCESS;
+            } else if (EFI_ERROR(Status)) {
+                FreePool(PayloadPath);
+                return Status;
+            }
+        }
 
-    /* If threading is enabled, we can keep the animation going during load
-        operations, since the speed is limited by the media and not the CPU. */
-    if (IsThreadingEnabled()) StartLoadingAnimation(&StillLoading);
+        /* Compressed ELF payloads are decompressed (or streamed) to their segments after
+            the plan is done, so those ranges are claimed now. */
+        if (
+            ELF == Context->Chain->Type
+            && FALSE == Context->Chain->IsMFTAH
+            && TRUE == Context->Chain->IsCompressed
+        ) {
+            Status = LoaderClaimCompressedElfSegments(Plan, DeviceHandle, PayloadPath);
+            if (EFI_ERROR(Status)) {
+                FreePool(PayloadPath);
+                return Status;
+            }
+        }
 
-    /* NOTE: Use the 's' starting point here because it's always set to the full file path. */
-    CHAR16 *PayloadPath = AsciiStrToUnicode(s);
-    if (NULL == PayloadPath) return EFI_OUT_OF_RESOURCES;
+        /* A raw binary is read (and decrypted in place) straight to its load address. A
+            compressed one is decompressed there instead. */
+        if (
+            BIN == Context->Chain->Type
+            && FALSE == Context->Chain->IsCompressed
+            && 0 != Context->Chain->LoadAddress
+        ) FixedBase = Context->Chain->LoadAddress;
+
+        /* Plain EXE payloads are left for the firmware's LoadImage to read from the file
+            itself, straight into the image it relocates. No staging copy is ever made. */
+        if (
+            EXE == Context->Chain->Type
+            && FALSE == Context->Chain->IsMFTAH
+            && FALSE == Context->Chain->IsCompressed
+        ) {
+            Context->LoadedImageDevicePath = FileDevicePath(DeviceHandle, PayloadPath);
+            FreePool(PayloadPath);
+
+            if (NULL == Context->LoadedImageDevicePath) return EFI_OUT_OF_RESOURCES;
+
+            *BufferIndex = LOADER_PLAN_MAX_BUFFERS;
+            return EFI_SUCCESS;
+        }
 
-    /* Convert the path separators to the m$ version ('\'). Not doing this
-        will cause `ReadFile` to return errors. */
-    // TODO Move to the chain validation method from `config.c`
-    for (CHAR16 *s = PayloadPath; *s; ++s) if (L'/' == *s) *s = L'\\';
+        /* A UKI's initrd is served from inside the payload buffer, which therefore outlives
+            the handoff. The stub copies the initrd out, so the OS may reclaim it afterwards. */
+        Status = PlanAddBuffer(Plan,
+                               (UKI == Context->Chain->Type ? EfiLoaderData : EfiReservedMemoryType),
+                               RAM_DISK_BLOCK_SIZE,
+                               (Context->Chain->IsMFTAH ? sizeof(mftah_payload_header_t) : 0),
+                               TRUE,
+                               BufferIndex);
+        if (!EFI_ERROR(Status)) {
+            /* Everything but DISK chains copies the payload out again (ELF segments, LoadImage,
+                and so on), so that much contiguous memory must still be free afterwards. */
+            Plan->Buffers[*BufferIndex].NeedsWorkingCopy = (DISK != Context->Chain->Type);
+            Plan->Buffers[*BufferIndex].HeadSize =
+                (Context->Chain->IsMFTAH ? sizeof(mftah_payload_header_t) : 0);
+
+            Plan->Buffers[*BufferIndex].FixedBase = FixedBase;
+            Plan->Buffers[*BufferIndex].ExtraEndAllocation = ExtraEndAllocation;
+
+            Status = PlanAddFile(Plan, *BufferIndex, DeviceHandle, PayloadPath);
+        }
 
-    if (TRUE == Context->Chain->PayloadParts) {
-        ERRCHECK(LoaderReadImageParts(Context, TargetHandle, PayloadPath));
-    } else {
-        Context->LoadedImageBase = 0;   /* set addr hint to NULL (so a new buffer is allocated) */
-        ERRCHECK(ReadFile(TargetHandle,
-                          PayloadPath,
-                          0U,
-                          (UINT8 **)&(Context->LoadedImageBase),
-                          &(Context->LoadedImageSize),
-                          (TargetHandle == ENTRY_HANDLE),
-                          EfiReservedMemoryType,   /* always mark payload as reserved in e820/memmap */
-                          RAM_DISK_BLOCK_SIZE,
-                          (Context->Chain->IsMFTAH ? sizeof(mftah_payload_header_t) : 0),
-                          ProgressWrapper));
+        if (EFI_ERROR(Status)) {
+            FreePool(PayloadPath);
+            return Status;
+        }
+
+        /* The plan owns the path now, and only frees it once the chain is read. */
+        return LoaderPlanDecompression(Context, Plan, DeviceHandle, PayloadPath, *BufferIndex, DecompressBuffer);
     }
 
-    FreePool(PayloadPath);
+    Status = PlanAddBuffer(Plan,
+                           (UKI == Context->Chain->Type ? EfiLoaderData : EfiReservedMemoryType),
+                           0,
+                           0,
+                           TRUE,
+                           BufferIndex);
+    if (EFI_ERROR(Status)) goto LoaderPlanPayload__Exit;
 
-    /* Close out with a completed progress detail and a small stall. */
-    StillLoading = FALSE;
-    ProgressStatusMessage = "Success!";
-    at = total;
-    DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
-    if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 1500);
+    Plan->Buffers[*BufferIndex].NeedsWorkingCopy = (DISK != Context->Chain->Type);
+    Plan->Buffers[*BufferIndex].HeadSize =
+        (Context->Chain->IsMFTAH ? sizeof(mftah_payload_header_t) : 0);
 
-    return EFI_SUCCESS;
+    if (BIN == Context->Chain->Type && FALSE == Context->Chain->IsCompressed) {
+        Plan->Buffers[*BufferIndex].FixedBase = Context->Chain->LoadAddress;
+    }
+
+    /* Walk the payload fragments from .0 through and including .9. This breaks out wherever the
+        chain of fragments end (the first one not found). If the .0 fragment is not found, exits
+        with an EFI_NOT_FOUND error. Each part is appended to the same planned buffer. */
+    PayloadPathLength = StrLen(PayloadPath);
+
+    for (UINTN CurrentPart = 0; CurrentPart < 10; ++CurrentPart) {
+        PayloadPath[PayloadPathLength - 1] = (L'0' + CurrentPart);
+
+        Status = FileSizeFromPath(PayloadPath, DeviceHandle, FALSE, &PartSize);
+        if (EFI_NOT_FOUND == Status) {
+            Status = (0 == CurrentPart) ? EFI_NOT_FOUND : EFI_SUCCESS;
+            break;
+        } else if (EFI_ERROR(Status)) break;
+
+        CHAR16 *PartPath = StrDuplicate(PayloadPath);
+        if (NULL == PartPath) {
+            Status = EFI_OUT_OF_RESOURCES;
+            break;
+        }
+
+        Status = PlanAddFile(Plan, *BufferIndex, DeviceHandle, PartPath);
+        if (EFI_ERROR(Status)) {
+            FreePool(PartPath);
+            break;
+        }
+    }
+
+    /* A compressed image's header is at the start of its first part. */
+    if (!EFI_ERROR(Status)) {
+        PayloadPath[PayloadPathLength - 1] = L'0';
+        Status = LoaderPlanDecompression(Context, Plan, DeviceHandle, PayloadPath, *BufferIndex, DecompressBuffer);
+    }
+
+LoaderPlanPayload__Exit:
+    FreePool(PayloadPath);
+    return Status;
 }
 
 
-/* NOTE: This is almost a carbon copy of the above method. */
 STATIC
-EFIAPI
 EFI_STATUS
-LoaderReadDataRamdisk(IN DATA_RAMDISK *Ramdisk,
-                      IN LOADER_CONTEXT *Context)
+LoaderPlanDataRamdisk(IN DATA_RAMDISK *Ramdisk,
+                      IN LOADER_PLAN *Plan,
+                      OUT UINTN *BufferIndex)
 {
     if (
         NULL == Ramdisk
@@ -340,51 +774,231 @@ LoaderReadDataRamdisk(IN DATA_RAMDISK *Ramdisk,
     ) return EFI_INVALID_PARAMETER;
 
     EFI_STATUS Status = EFI_SUCCESS;
-    // TODO Move MFTAH out to a decorator... Starting to get real messy
-    mftah_status_t MftahStatus = MFTAH_SUCCESS;
-    mftah_protocol_t *MftahProtocol = NULL;
+    EFI_HANDLE DeviceHandle = NULL;
+    CHAR16 *RamdiskPath = NULL;
+
+    ERRCHECK(LoaderResolvePath(Ramdisk->Path, &DeviceHandle, &RamdiskPath));
+
+    /* An initrd is copied out by the kernel's stub before it exits boot services, so it's
+        only loader data, and it isn't padded out to whole disk blocks. */
+    Status = PlanAddBuffer(Plan,
+                           (Ramdisk->IsInitrd ? EfiLoaderData : EfiReservedMemoryType),
+                           (Ramdisk->IsInitrd ? 0 : RAM_DISK_BLOCK_SIZE),
+                           (Ramdisk->IsMFTAH ? sizeof(mftah_payload_header_t) : 0),
+                           Ramdisk->IsRequired,
+                           BufferIndex);
+    if (!EFI_ERROR(Status)) {
+        /* Keep the decrypted disk contents (not the MFTAH header) on a large-page boundary. */
+        Plan->Buffers[*BufferIndex].HeadSize = (Ramdisk->IsMFTAH ? sizeof(mftah_payload_header_t) : 0);
+
+        /* Plain ramdisks are never touched outside of the ramdisk driver, so they can be
+            split across fragmented memory. MFTAH ones must be contiguous to be decrypted,
+            sparse ones to be packed in place, compressed ones to be indexed, initrds to be
+            served from one buffer, and persistent ones to show up as a single pmem device. */
+        Plan->Buffers[*BufferIndex].AllowScatter =
+            !(
+                Ramdisk->IsMFTAH
+                || Ramdisk->IsSparse
+                || Ramdisk->IsCompressed
+                || Ramdisk->IsInitrd
+                || Ramdisk->IsPersistent
+            );
+
+        Status = PlanAddFile(Plan, *BufferIndex, DeviceHandle, RamdiskPath);
+    }
+
+    if (EFI_ERROR(Status)) FreePool(RamdiskPath);
+    return Status;
+}
+
+
+/* Modules are read as-is into their own buffers, which are never moved or freed, so the
+    kernel can use them right where they are. */
+STATIC
+EFI_STATUS
+LoaderPlanModule(IN CHAIN_MODULE *Module,
+                 IN LOADER_PLAN *Plan,
+                 OUT UINTN *BufferIndex)
+{
+    if (
+        NULL == Module
+        || NULL == Module->Path
+        || 0 == AsciiStrLen(Module->Path)
+    ) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_HANDLE DeviceHandle = NULL;
+    CHAR16 *ModulePath = NULL;
+
+    ERRCHECK(LoaderResolvePath(Module->Path, &DeviceHandle, &ModulePath));
+
+    Status = PlanAddBuffer(Plan,
+                           EfiReservedMemoryType,   /* the kernel owns these from here on */
+                           0,
+                           0,
+                           TRUE,
+                           BufferIndex);
+    if (!EFI_ERROR(Status)) {
+        /* Module tags only carry 32-bit addresses. */
+        Plan->Buffers[*BufferIndex].PreferHighMemory = FALSE;
+        Plan->Buffers[*BufferIndex].PreferLowMemory = TRUE;
+
+        Status = PlanAddFile(Plan, *BufferIndex, DeviceHandle, ModulePath);
+    }
+
+    if (EFI_ERROR(Status)) FreePool(ModulePath);
+    return Status;
+}
+
+
+/* Records a loaded range for the Multiboot2 loader to hand over as a module. */
+STATIC
+VOID
+LoaderAddModule(IN LOADER_CONTEXT *Context,
+                IN EFI_PHYSICAL_ADDRESS Base,
+                IN UINTN Length,
+                IN CONST CHAR8 *String)
+{
+    if (Context->ModulesLength >= LOADER_MAX_MODULES) return;
+
+    Context->Modules[Context->ModulesLength].Base   = Base;
+    Context->Modules[Context->ModulesLength].Length = Length;
+    Context->Modules[Context->ModulesLength].String = String;
+    ++Context->ModulesLength;
+}
+
+
+/* ELF kernels and bare-metal images both enter through the ELF handoff, which is the
+    only one that builds Multiboot2 information. */
+STATIC
+BOOLEAN
+LoaderChainUsesMultiboot(IN CONFIG_CHAIN_BLOCK *Chain)
+{
+    return (ELF == Chain->Type || BIN == Chain->Type);
+}
+
+
+/* Overlay data ramdisks of the same image share a single read-only copy of it. If an
+    earlier overlay in the chain matches the one at `Index`, its planned buffer is reused.
+    Compressed images are released by the ramdisk driver, so they're never shared. */
+STATIC
+BOOLEAN
+LoaderFindSharedDataRamdisk(IN CONFIG_CHAIN_BLOCK *Chain,
+                            IN UINTN Index,
+                            IN OUT UINTN *DataRamdiskBuffers)
+{
+    DATA_RAMDISK *r = Chain->DataRamdisks[Index];
+
+    if (FALSE == r->IsOverlay || TRUE == r->IsCompressed || TRUE == r->IsInitrd) return FALSE;
+
+    for (UINTN i = 0; i < Index; ++i) {
+        DATA_RAMDISK *Other = Chain->DataRamdisks[i];
+
+        if (
+            FALSE == Other->IsOverlay
+            || TRUE == Other->IsCompressed
+            || TRUE == Other->IsInitrd
+            || LOADER_PLAN_MAX_BUFFERS == DataRamdiskBuffers[i]
+            || r->IsMFTAH != Other->IsMFTAH
+            || 0 != AsciiStrCmp(r->Path, Other->Path)
+        ) continue;
+
+        /* An encrypted image is decrypted once, so both must agree on the key. */
+        if (
+            TRUE == r->IsMFTAH
+            && (
+                NULL == r->MFTAHKey
+                || NULL == Other->MFTAHKey
+                || 0 != AsciiStrCmp(r->MFTAHKey, Other->MFTAHKey)
+            )
+        ) continue;
+
+        DataRamdiskBuffers[Index] = DataRamdiskBuffers[i];
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/* Gathers every file the chain needs (data ramdisks, modules, and the payload), then
+    sizes, reserves, and reads all of them at once. The indices of each data ramdisk's
+    planned buffer are returned in `DataRamdiskBuffers`; data ramdisks which are not
+    required and could not be located are set to LOADER_PLAN_MAX_BUFFERS. The same goes
+    for `ModuleBuffers`, which are only planned for chains that boot through Multiboot2. */
+STATIC
+EFI_STATUS
+LoaderReadChain(IN LOADER_CONTEXT *Context,
+                IN LOADER_PLAN *Plan,
+                OUT UINTN *DataRamdiskBuffers,
+                OUT UINTN *ModuleBuffers)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
     UINTN at = 0, total = 100;
-    VOID *LoadedRamdiskBase = NULL;
-    UINTN LoadedRamdiskSize = 0;
-    EFI_DEVICE_PATH_PROTOCOL *RamdiskDevicePath = NULL;
+    UINTN PayloadBuffer = 0;
+    UINTN DecompressBuffer = LOADER_PLAN_MAX_BUFFERS;
+    CONFIG_CHAIN_BLOCK *chain = NULL;
 
-    ProgressStatusMessage = "Locating Ramdisk...";
+    if (
+        NULL == Context
+        || NULL == Plan
+        || NULL == DataRamdiskBuffers
+        || NULL == ModuleBuffers
+    ) return EFI_INVALID_PARAMETER;
+
+    chain = Context->Chain;
+
+    ProgressStatusMessage = "Locating Files...";
+
+    /* Render the initial progress details and the stall art */
     DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
     if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 500);
 
-    EFI_HANDLE TargetHandle = ENTRY_HANDLE;
+    /* NOTE: Failure to locate data ramdisks is not fatal unless otherwise specified. */
+    for (UINTN i = 0; i < chain->DataRamdisksLength; ++i) {
+        if (TRUE == LoaderFindSharedDataRamdisk(chain, i, DataRamdiskBuffers)) {
+            /* A shared image is required if any of the overlays using it are. */
+            if (TRUE == chain->DataRamdisks[i]->IsRequired) {
+                Plan->Buffers[DataRamdiskBuffers[i]].IsRequired = TRUE;
+            }
+
+            continue;
+        }
 
-    // TODO abstract to function. Keep it DRY
-    CHAR8 *p = Ramdisk->Path;
-    CHAR8 *s = p;
+        Status = LoaderPlanDataRamdisk(chain->DataRamdisks[i], Plan, &(DataRamdiskBuffers[i]));
+        if (EFI_ERROR(Status)) {
+            if (TRUE == chain->DataRamdisks[i]->IsRequired) return Status;
 
-    for (; *p; ++p) {
-        if (':' == *p) {
-            s = p;
-            break;
+            DataRamdiskBuffers[i] = LOADER_PLAN_MAX_BUFFERS;
+        } else if (TRUE == LoaderChainUsesMultiboot(chain)) {
+            /* Kept below 4 GiB where possible, so each one can also be handed over as a module. */
+            Plan->Buffers[DataRamdiskBuffers[i]].PreferHighMemory = FALSE;
+            Plan->Buffers[DataRamdiskBuffers[i]].PreferLowMemory = TRUE;
         }
     }
 
-    if (s != Ramdisk->Path) {
-        *s = '\0';   /* terminate the string here */
-        ++s;   /* increment by one to set it to the filename */
-        if ('\0' == *s) return EFI_LOAD_ERROR;
+    /* Only the ELF handoff (used by ELF and BIN chains) builds Multiboot2 information,
+        so nothing else needs modules. */
+    for (UINTN i = 0; i < chain->ModulesLength; ++i) {
+        ModuleBuffers[i] = LOADER_PLAN_MAX_BUFFERS;
 
-        /* Get the unicode version of the volume name string. */
-        CHAR16 *VolumeName = AsciiStrToUnicode(Ramdisk->Path);
+        if (FALSE == LoaderChainUsesMultiboot(chain)) {
+            DPRINTLN("Ignoring module '%a' on a chain which doesn't use Multiboot2.", chain->Modules[i]->Path);
+            continue;
+        }
 
-        ProgressStatusMessage = "Opening Volume...";
-        at = 50; DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
-        if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 500);
+        ERRCHECK(LoaderPlanModule(chain->Modules[i], Plan, &(ModuleBuffers[i])));
+    }
 
-        Status = GetFileSystemHandleByVolumeName(VolumeName, &TargetHandle);
-        FreePool(VolumeName);
+    ERRCHECK(LoaderPlanPayload(Context, Plan, &PayloadBuffer, &DecompressBuffer));
 
-        if (EFI_ERROR(Status)) return Status;
-    }
+    ProgressStatusMessage = "Reserving Memory...";
+    at = 50; DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
+
+    ERRCHECK(PlanPrepare(Plan));
 
     /* Do stuff with slight stalls between progress messages. */
-    ProgressStatusMessage = "Reading Ramdisk...";
+    ProgressStatusMessage = "Reading Files...";
     at = 0; DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
     if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 500);
 
@@ -395,32 +1009,137 @@ LoaderReadDataRamdisk(IN DATA_RAMDISK *Ramdisk,
         operations, since the speed is limited by the media and not the CPU. */
     if (IsThreadingEnabled()) StartLoadingAnimation(&StillLoading);
 
-    /* NOTE: Use the 's' starting point here because it's always set to the full file path. */
-    CHAR16 *PayloadPath = AsciiStrToUnicode(s);
-    if (NULL == PayloadPath) return EFI_OUT_OF_RESOURCES;
-
-    /* Convert the path separators to the m$ version ('\'). Not doing this
-        will cause `ReadFile` to return errors. */
-    for (CHAR16 *s = PayloadPath; *s; ++s) if (L'/' == *s) *s = L'\\';
-
-    ERRCHECK(ReadFile(TargetHandle,
-                      PayloadPath,
-                      0U,
-                      (UINT8 **)&LoadedRamdiskBase,
-                      &LoadedRamdiskSize,
-                      (TargetHandle == ENTRY_HANDLE),
-                      EfiReservedMemoryType,   /* always mark payload as reserved in e820/memmap */
-                      RAM_DISK_BLOCK_SIZE,
-                      (Ramdisk->IsMFTAH ? sizeof(mftah_payload_header_t) : 0),
-                      ProgressWrapper));
-    FreePool(PayloadPath);
+    Status = PlanExecute(Plan, ProgressWrapper);
 
     StillLoading = FALSE;
-    DISPLAY->ClearScreen(DISPLAY, CONFIG->Colors.Background);
+    if (EFI_ERROR(Status)) return Status;
+
+    if (NULL != Context->StreamPath) {
+        UINTN FileSize = 0;
+
+        ERRCHECK(FileSizeFromPath(Context->StreamPath, Context->StreamDeviceHandle, FALSE, &FileSize));
+        ERRCHECK(LoaderReadStreamHead(Context, FileSize));
+    } else if (LOADER_PLAN_MAX_BUFFERS != PayloadBuffer) {
+        Context->LoadedImageBase = Plan->Buffers[PayloadBuffer].Base;
+        Context->LoadedImageSize = Plan->Buffers[PayloadBuffer].Size;
+
+        Context->LoadedImageAllocation.Base  = Plan->Buffers[PayloadBuffer].AllocationBase;
+        Context->LoadedImageAllocation.Pages = Plan->Buffers[PayloadBuffer].Pages;
+    }
+
+    if (LOADER_PLAN_MAX_BUFFERS != DecompressBuffer) {
+        Context->DecompressTarget.Base  = Plan->Buffers[DecompressBuffer].AllocationBase;
+        Context->DecompressTarget.Pages = Plan->Buffers[DecompressBuffer].Pages;
+    }
+
+    /* Close out with a completed progress detail and a small stall. */
+    ProgressStatusMessage = "Success!";
+    at = total;
+    DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
+    if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 1500);
+
+    return EFI_SUCCESS;
+}
+
+
+/* Persistent ramdisks are published to the OS as pmem, so it can map their contents
+    in place (DAX) rather than copying every block into its page cache. */
+STATIC
+EFI_GUID *
+LoaderDataRamdiskType(IN DATA_RAMDISK *Ramdisk)
+{
+    return (TRUE == Ramdisk->IsPersistent)
+        ? &gEfiRamdiskPersistentVirtualDiskGuid
+        : &gEfiRamdiskVirtualDiskGuid;
+}
+
+
+/* Hands a decrypted data ramdisk to the Linux EFI stub as its initrd. A compressed one is
+    decompressed once here, so the stub's read is a single copy out of plain memory. */
+STATIC
+EFI_STATUS
+LoaderServeInitrd(IN DATA_RAMDISK *Ramdisk,
+                  IN EFI_PHYSICAL_ADDRESS Base,
+                  IN UINTN Size)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    COMPRESSED_IMAGE Image = {0};
+    EFI_PHYSICAL_ADDRESS Decompressed = 0;
+    UINTN Pages = 0;
+
+    if (FALSE == Ramdisk->IsCompressed) {
+        ERRCHECK(InitrdInstall((VOID *)Base, Size));
+        return EFI_SUCCESS;
+    }
+
+    Status = CompressedImageOpen((VOID *)Base, Size, &Image);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("The initrd is not a valid compressed image. Code '%u'.", Status);
+        return Status;
+    }
+
+    Pages = EFI_SIZE_TO_PAGES(Image.UncompressedSize);
+
+    Status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, Pages, &Decompressed);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("Not enough memory to decompress the initrd (%u bytes).", Image.UncompressedSize);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = CompressedImageDecompress(&Image, (VOID *)Decompressed, ProgressWrapper);
+    if (!EFI_ERROR(Status)) {
+        Status = InitrdInstall((VOID *)Decompressed, (UINTN)Image.UncompressedSize);
+    }
+
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("Failed to serve the compressed initrd. Code '%u'.", Status);
+        BS->FreePages(Decompressed, Pages);
+        return Status;
+    }
+
+    /* The compressed copy is loader data too; the OS reclaims it along with this one. */
+    return EFI_SUCCESS;
+}
+
+
+/* Decrypts (if needed) and registers a data ramdisk which was already read into memory.
+    `IsDecrypted` is set when the buffer is shared with an overlay which was already
+    decrypted in place, in which case the MFTAH header is skipped without decrypting
+    again. It's set here as soon as the decryption succeeds, even if registration fails.
+    `DevicePath` receives the registered disk's device path, or NULL for an initrd. */
+STATIC
+EFIAPI
+EFI_STATUS
+LoaderRegisterDataRamdisk(IN DATA_RAMDISK *Ramdisk,
+                          IN EFI_PHYSICAL_ADDRESS LoadedRamdiskBase,
+                          IN UINTN LoadedRamdiskSize,
+                          IN OUT BOOLEAN *IsDecrypted,
+                          OUT EFI_DEVICE_PATH_PROTOCOL **DevicePath)
+{
+    if (
+        NULL == Ramdisk
+        || 0 == LoadedRamdiskBase
+        || 0 == LoadedRamdiskSize
+        || NULL == IsDecrypted
+        || NULL == DevicePath
+    ) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    // TODO Move MFTAH out to a decorator... Starting to get real messy
+    mftah_status_t MftahStatus = MFTAH_SUCCESS;
+    mftah_protocol_t *MftahProtocol = NULL;
+    UINTN at = 0, total = 100;
+    EFI_DEVICE_PATH_PROTOCOL *RamdiskDevicePath = NULL;
+
+    ProgressStatusMessage = "Registering Ramdisk...";
+    DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
 
     // TODO: MFTAH decrypt & decompression -- these types of decorators need to be moved to a more generic function/place
     // TODO This whole thing is sloppy and rushed for my own testing enjoyment.
-    if (TRUE == Ramdisk->IsMFTAH) {
+    if (TRUE == Ramdisk->IsMFTAH && TRUE == *IsDecrypted) {
+        LoadedRamdiskBase += sizeof(mftah_payload_header_t);
+        LoadedRamdiskSize -= sizeof(mftah_payload_header_t);
+    } else if (TRUE == Ramdisk->IsMFTAH) {
         if (NULL == Ramdisk->MFTAHKey || 0 == AsciiStrLen(Ramdisk->MFTAHKey)) {
             // TODO get key
             return EFI_INVALID_PASSWORD;
@@ -476,6 +1195,10 @@ LoaderReadDataRamdisk(IN DATA_RAMDISK *Ramdisk,
             return EFI_LOAD_ERROR;
         }
 
+        /* The buffer now holds plaintext. Whatever happens next, it must never be
+            decrypted a second time. */
+        *IsDecrypted = TRUE;
+
         /* Now that the payload is decrypted, lop off the initial 128-byte header and adjust. */
         LoadedRamdiskBase += sizeof(mftah_payload_header_t);
         LoadedRamdiskSize -= sizeof(mftah_payload_header_t);
@@ -486,13 +1209,46 @@ LoaderReadDataRamdisk(IN DATA_RAMDISK *Ramdisk,
         SecureWipe(Ramdisk->MFTAHKey, AsciiStrLen(Ramdisk->MFTAHKey));
     }
 
-    ERRCHECK(
-        RAMDISK.Register((UINT64)LoadedRamdiskBase,
-                         (UINT64)LoadedRamdiskSize,
-                         &gEfiRamdiskVirtualDiskGuid,
-                         NULL,
-                         &RamdiskDevicePath)
-    );
+    /* NOTE: An initrd is served to the kernel's stub instead of being registered as a disk.
+        A compressed disk already keeps its writes apart from the image, like an overlay
+        does. An overlay's image can be shared with other overlays, so it's never made sparse. */
+    if (TRUE == Ramdisk->IsInitrd) {
+        ERRCHECK(LoaderServeInitrd(Ramdisk, LoadedRamdiskBase, LoadedRamdiskSize));
+    } else if (TRUE == Ramdisk->IsCompressed) {
+        ERRCHECK(
+            RAMDISK.RegisterCompressed((UINT64)LoadedRamdiskBase,
+                                       (UINT64)LoadedRamdiskSize,
+                                       LoaderDataRamdiskType(Ramdisk),
+                                       NULL,
+                                       &RamdiskDevicePath)
+        );
+    } else if (TRUE == Ramdisk->IsOverlay) {
+        RAMDISK_EXTENT Extent = { (UINT64)LoadedRamdiskBase, (UINT64)LoadedRamdiskSize, 0 };
+
+        ERRCHECK(
+            RAMDISK.RegisterOverlay(&Extent,
+                                    1,
+                                    LoaderDataRamdiskType(Ramdisk),
+                                    NULL,
+                                    &RamdiskDevicePath)
+        );
+    } else if (TRUE == Ramdisk->IsSparse) {
+        ERRCHECK(
+            RAMDISK.RegisterSparse((UINT64)LoadedRamdiskBase,
+                                   (UINT64)LoadedRamdiskSize,
+                                   LoaderDataRamdiskType(Ramdisk),
+                                   NULL,
+                                   &RamdiskDevicePath)
+        );
+    } else {
+        ERRCHECK(
+            RAMDISK.Register((UINT64)LoadedRamdiskBase,
+                             (UINT64)LoadedRamdiskSize,
+                             LoaderDataRamdiskType(Ramdisk),
+                             NULL,
+                             &RamdiskDevicePath)
+        );
+    }
 
     /* Close out with a completed progress detail and a small stall. */
     ProgressStatusMessage = "Loaded!";
@@ -500,10 +1256,98 @@ LoaderReadDataRamdisk(IN DATA_RAMDISK *Ramdisk,
     DISPLAY->Progress(DISPLAY, ProgressStatusMessage, at, total);
     if (FALSE == CONFIG->Quick) DISPLAY->Stall(DISPLAY, 1500);
 
+    *DevicePath = RamdiskDevicePath;
     return EFI_SUCCESS;
 }
 
 
+/* Counts one more overlay over the image in `Buffer`, tracking the image if it's new.
+    Returns the image's index in `OverlayImages`, or MAX_DATA_RAMDISKS_PER_CHAIN when it
+    must be kept: a Multiboot2 kernel gets an image in one piece as a module. */
+STATIC
+UINTN
+LoaderTrackOverlayImage(IN LOADER_CONTEXT *Context,
+                        IN LOADER_PLAN_BUFFER *Buffer)
+{
+    LOADER_OVERLAY_IMAGE *Image = NULL;
+    EFI_PHYSICAL_ADDRESS First =
+        (0 == Buffer->ExtentsLength) ? Buffer->AllocationBase : Buffer->Extents[0].StartingAddr;
+
+    if (0 == Buffer->ExtentsLength && TRUE == LoaderChainUsesMultiboot(Context->Chain)) {
+        return MAX_DATA_RAMDISKS_PER_CHAIN;
+    }
+
+    /* Overlays sharing an image share its planned buffer, so they start at the same page. */
+    for (UINTN i = 0; i < Context->OverlayImagesLength; ++i) {
+        if (First == Context->OverlayImages[i].Ranges[0].Base) {
+            ++Context->OverlayImages[i].Overlays;
+            return i;
+        }
+    }
+
+    if (0 == First || Context->OverlayImagesLength >= MAX_DATA_RAMDISKS_PER_CHAIN) {
+        return MAX_DATA_RAMDISKS_PER_CHAIN;
+    }
+
+    Image = &(Context->OverlayImages[Context->OverlayImagesLength]);
+
+    if (0 == Buffer->ExtentsLength) {
+        Image->Ranges[0].Base = Buffer->AllocationBase;
+        Image->Ranges[0].Pages = Buffer->Pages;
+        Image->RangesLength = 1;
+    } else {
+        for (UINTN i = 0; i < Buffer->ExtentsLength; ++i) {
+            Image->Ranges[i].Base = Buffer->Extents[i].StartingAddr;
+            Image->Ranges[i].Pages = EFI_SIZE_TO_PAGES(Buffer->Extents[i].Size);
+        }
+        Image->RangesLength = Buffer->ExtentsLength;
+    }
+
+    Image->Overlays = 1;
+    return (Context->OverlayImagesLength)++;
+}
+
+
+/* Keeps track of a registered data ramdisk. The driver is told where the pages of a disk
+    it frees were allocated, so an MFTAH header before the disk goes with it. Disks which
+    are never published to the OS are recorded, to be unregistered before a handoff which
+    exits boot services: nothing could read them anymore, so their memory is returned.
+    The driver never frees an overlay's image, so the loader keeps track of those itself. */
+STATIC
+VOID
+LoaderTrackDataRamdisk(IN LOADER_CONTEXT *Context,
+                       IN DATA_RAMDISK *Ramdisk,
+                       IN LOADER_PLAN_BUFFER *Buffer,
+                       IN EFI_DEVICE_PATH_PROTOCOL *DevicePath)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    if (NULL == DevicePath) return;
+
+    /* An overlay's base image belongs to the loader, and may be shared. */
+    if (
+        0 == Buffer->ExtentsLength
+        && (FALSE == Ramdisk->IsOverlay || TRUE == Ramdisk->IsCompressed)
+    ) {
+        Status = RAMDISK.AdoptAllocation(DevicePath, Buffer->AllocationBase);
+        if (EFI_ERROR(Status)) DPRINTLN("Could not hand data ramdisk '%a' pages over (%u).", Ramdisk->Path, Status);
+    }
+
+    if (
+        FALSE == Ramdisk->IsCompressed
+        && (TRUE == Ramdisk->IsOverlay || TRUE == Ramdisk->IsSparse)
+        && Context->FirmwareRamdisksLength < MAX_DATA_RAMDISKS_PER_CHAIN
+    ) {
+        Context->FirmwareRamdisks[Context->FirmwareRamdisksLength] = DevicePath;
+        Context->FirmwareRamdiskImages[Context->FirmwareRamdisksLength] =
+            (TRUE == Ramdisk->IsOverlay)
+                ? LoaderTrackOverlayImage(Context, Buffer)
+                : MAX_DATA_RAMDISKS_PER_CHAIN;
+        ++Context->FirmwareRamdisksLength;
+    }
+}
+
+
 STATIC
 EFIAPI
 EFI_STATUS
@@ -701,26 +1545,255 @@ LoaderMftahDecrypt(IN LOADER_CONTEXT *Context)
 }
 
 
+/* Peeks at the ELF headers in the first frame of a compressed payload, and reserves the
+    exact range the decompressed image must occupy for its segments to be in place. */
+STATIC
+VOID
+LoaderPlaceDecompressedElf(IN CONST COMPRESSED_IMAGE *Image,
+                           OUT EFI_PHYSICAL_ADDRESS *Decompressed,
+                           OUT UINTN *Pages)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN FrameLength = CompressedImageFrameLength(Image, 0);
+    EFI_PHYSICAL_ADDRESS ImageBase = 0;
+    UINT64 ImageLength = 0;
+
+    VOID *Frame = AllocatePool(FrameLength);
+    if (NULL == Frame) return;
+
+    Status = CompressedImageReadFrame(Image, 0, Frame);
+    if (!EFI_ERROR(Status)) {
+        Status = ElfGetInPlaceLayout(Frame,
+                                     MIN(FrameLength, ELF_IN_PLACE_PROBE_SIZE),
+                                     Image->UncompressedSize,
+                                     &ImageBase,
+                                     &ImageLength);
+    }
+
+    FreePool(Frame);
+    if (EFI_ERROR(Status)) return;
+
+    Status = BS->AllocatePages(AllocateAddress,
+                               EfiReservedMemoryType,
+                               EFI_SIZE_TO_PAGES(ImageLength),
+                               &ImageBase);
+    if (EFI_ERROR(Status)) {
+        DPRINTLN("The ELF payload's in-place range at %p is not free (%u).", (VOID *)ImageBase, Status);
+        return;
+    }
+
+    *Decompressed = ImageBase;
+    *Pages = EFI_SIZE_TO_PAGES(ImageLength);
+}
+
+
 STATIC
 EFIAPI
 EFI_STATUS
 LoaderDecompress(IN LOADER_CONTEXT *Context)
 {
-    // TODO
+    EFI_STATUS Status = EFI_SUCCESS;
+    COMPRESSED_IMAGE Image = {0};
+    EFI_PHYSICAL_ADDRESS Decompressed = 0;
+    UINTN Pages = 0;
+
+    if (0 == Context->LoadedImageBase || 0 == Context->LoadedImageSize) {
+        EFI_DANGERLN("Invalid payload or base image parameters in context.");
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    Status = CompressedImageOpen((VOID *)Context->LoadedImageBase, Context->LoadedImageSize, &Image);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("The payload is not a valid compressed image. Code '%u'.", Status);
+        return Status;
+    }
+
+    /* The frame index gives the exact decompressed size up front, so the frames can be
+        decompressed in parallel straight into the payload's final buffer. An ELF is
+        decompressed to wherever its segments belong, when its layout allows it. */
+    if (ELF == Context->Chain->Type) {
+        LoaderPlaceDecompressedElf(&Image, &Decompressed, &Pages);
+
+        /* Otherwise, only its head is decompressed here. The ELF loader decompresses each
+            segment straight to its destination, so the whole image never exists at once.
+            The compressed image stays readable until the context is destroyed. */
+        if (0 == Decompressed) {
+            LoaderRetireLoadedImage(Context);
+
+            Context->StreamImage = Image;
+            Context->ReadPayloadRange = LoaderReadCompressedRange;
+
+            Status = LoaderReadStreamHead(Context, Image.UncompressedSize);
+            if (EFI_ERROR(Status)) {
+                EFI_DANGERLN("Failed to decompress the payload's headers. Code '%u'.", Status);
+                return Status;
+            }
+
+            return EFI_SUCCESS;
+        }
+    }
+
+    /* The room planned for the decompressed payload, if any, was reserved with the rest of
+        the chain (at a raw binary's load address, when that was free). */
+    if (0 != Context->DecompressTarget.Base) {
+        Decompressed = Context->DecompressTarget.Base;
+        Pages = Context->DecompressTarget.Pages;
+
+        SetMem(&(Context->DecompressTarget), sizeof(LOADER_STAGING_BUFFER), 0x00);
+
+        /* Only if the payload changed since it was planned. */
+        if (Pages < EFI_SIZE_TO_PAGES(Image.UncompressedSize)) {
+            BS->FreePages(Decompressed, Pages);
+            Decompressed = 0;
+        }
+    }
+
+    /* A raw binary is decompressed straight to its load address, when that's free. */
+    if (0 == Decompressed && BIN == Context->Chain->Type && 0 != Context->Chain->LoadAddress) {
+        Decompressed = Context->Chain->LoadAddress;
+        Pages = EFI_SIZE_TO_PAGES(Image.UncompressedSize);
+
+        Status = BS->AllocatePages(AllocateAddress, EfiReservedMemoryType, Pages, &Decompressed);
+        if (EFI_ERROR(Status)) {
+            DPRINTLN("The binary's load address %p is not free (%u).",
+                     (VOID *)Context->Chain->LoadAddress, Status);
+            Decompressed = 0;
+        }
+    }
+
+    if (0 == Decompressed) {
+        Pages = EFI_SIZE_TO_PAGES(Image.UncompressedSize);
+
+        Status = BS->AllocatePages(AllocateAnyPages,
+                                   EfiReservedMemoryType,   /* always mark payload as reserved in e820/memmap */
+                                   Pages,
+                                   &Decompressed);
+    }
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("Not enough memory to decompress the payload (%u bytes).", Image.UncompressedSize);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = CompressedImageDecompress(&Image, (VOID *)Decompressed, ProgressWrapper);
+    if (EFI_ERROR(Status)) {
+        EFI_DANGERLN("Failed to decompress the payload. Code '%u'.", Status);
+        BS->FreePages(Decompressed, Pages);
+        return Status;
+    }
+
+    /* Nothing reads the compressed image again. */
+    LoaderRetireLoadedImage(Context);
+
+    Context->LoadedImageBase = Decompressed;
+    Context->LoadedImageSize = (UINTN)Image.UncompressedSize;
+
+    Context->LoadedImageAllocation.Base  = Decompressed;
+    Context->LoadedImageAllocation.Pages = Pages;
+
     return EFI_SUCCESS;
 }
 
 
+VOID
+LoaderRetireLoadedImage(IN LOADER_CONTEXT *Context)
+{
+    if (NULL == Context || 0 == Context->LoadedImageAllocation.Base) return;
+
+    if (Context->DeadBuffersLength >= LOADER_MAX_DEAD_BUFFERS) {
+        DPRINTLN("No room to track a dead staging buffer at '%p'; it stays reserved.",
+                 (VOID *)Context->LoadedImageAllocation.Base);
+    } else {
+        Context->DeadBuffers[Context->DeadBuffersLength] = Context->LoadedImageAllocation;
+        ++Context->DeadBuffersLength;
+    }
+
+    SetMem(&(Context->LoadedImageAllocation), sizeof(LOADER_STAGING_BUFFER), 0x00);
+}
+
+
+/* Staging buffers are reserved memory, so anything left allocated here would be
+    kept from the OS forever. */
+STATIC
+VOID
+LoaderFreeDeadBuffers(IN LOADER_CONTEXT *Context)
+{
+    for (UINTN i = 0; i < Context->DeadBuffersLength; ++i) {
+        LOADER_STAGING_BUFFER *b = &(Context->DeadBuffers[i]);
+
+        DPRINTLN("Freeing dead staging buffer at '%p' (%u pages).", (VOID *)b->Base, b->Pages);
+
+        if (0 == b->Pages) BS->FreePool((VOID *)b->Base);
+        else BS->FreePages(b->Base, b->Pages);
+    }
+
+    Context->DeadBuffersLength = 0;
+}
+
+
+/* The driver leaves an overlay's image to the loader, which read it. Once no overlay is
+    left over an image, it's only keeping reserved memory from the OS. */
+STATIC
+VOID
+LoaderFreeOverlayImages(IN LOADER_CONTEXT *Context)
+{
+    for (UINTN i = 0; i < Context->OverlayImagesLength; ++i) {
+        LOADER_OVERLAY_IMAGE *Image = &(Context->OverlayImages[i]);
+
+        if (0 != Image->Overlays) continue;
+
+        for (UINTN j = 0; j < Image->RangesLength; ++j) {
+            BS->FreePages(Image->Ranges[j].Base, Image->Ranges[j].Pages);
+        }
+
+        Image->RangesLength = 0;
+    }
+}
+
+
 VOID
 LoaderDestroyContext(IN LOADER_CONTEXT *Context)
 {
     /* One of the final methods called by this program. Therefore, it should also
         destroy the current framebuffer/display handle. NOTE that we don't destroy
         the Context->Chain item directly, because it's included in ConfigDestroy. We
-        also don't destroy the loaded device path or ramdisk (obviously). */
+        also don't destroy the loaded device path or ramdisks the OS can use (obviously). */
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    /* Show which parts of each ramdisk were touched before handoff (debug builds only). */
+    RamDiskDumpStatistics();
+
+    /* Give back the staging buffers first, leaving more room to materialize into. */
+    LoaderFreeDeadBuffers(Context);
+
+    /* The OS can only use plain ramdisks, so compressed ones are fully decompressed now. */
+    if (EFI_ERROR((Status = RAMDISK.MaterializeAll()))) {
+        EFI_DANGERLN("WARNING: Not every compressed ramdisk could be materialized (%u).", Status);
+    }
+
+    /* Copy-on-write and sparse disks are never shown to the OS. Once boot services are
+        gone, nothing can read them, so they're unregistered and their memory released. */
+    if (TRUE == Context->ExitsBootServices) {
+        for (UINTN i = 0; i < Context->FirmwareRamdisksLength; ++i) {
+            UINTN Image = Context->FirmwareRamdiskImages[i];
+
+            if (EFI_ERROR((Status = RAMDISK.Unregister(Context->FirmwareRamdisks[i])))) {
+                EFI_DANGERLN("WARNING: A firmware-only ramdisk could not be unregistered (%u).", Status);
+                continue;
+            }
+
+            if (Image < Context->OverlayImagesLength) --(Context->OverlayImages[Image].Overlays);
+        }
+
+        LoaderFreeOverlayImages(Context);
+    }
+
     FreePool(Context->MftahPayloadWrapper);
+    if (NULL != Context->StreamPath) FreePool(Context->StreamPath);
     FreePool(Context);
 
+    /* Release any volume and file handles still held open by file operations. */
+    FileCacheFlush();
+
     /* Destroy the MFTAH loader protocol instance. */
     MftahDestroy();
 
@@ -761,12 +1834,85 @@ LoaderEnterChain(IN UINTN SelectedChainIndex)
     /* Clear the screen. */
     DISPLAY->ClearScreen(DISPLAY, CONFIG->Colors.Background);
 
-    /* Load any data ramdisks that were specified in the chain.
+    /* Every file the chain needs is planned up-front, then read in a single pass. */
+    LOADER_PLAN *Plan = (LOADER_PLAN *)AllocateZeroPool(sizeof(LOADER_PLAN));
+    UINTN DataRamdiskBuffers[MAX_DATA_RAMDISKS_PER_CHAIN] = {0};
+    UINTN ModuleBuffers[MAX_MODULES_PER_CHAIN] = {0};
+    BOOLEAN BufferRegistered[LOADER_PLAN_MAX_BUFFERS] = {0};
+    BOOLEAN BufferDecrypted[LOADER_PLAN_MAX_BUFFERS] = {0};
+
+    if (NULL == Plan) {
+        DISPLAY->Panic(DISPLAY,
+                       "Failed to allocate the chain's read plan.",
+                       EFI_OUT_OF_RESOURCES,
+                       TRUE,
+                       EFI_SECONDS_TO_MICROSECONDS(10));
+    }
+
+    /* Read the payload file and data ramdisks from block storage. */
+    if (EFI_ERROR((Status = LoaderReadChain(Context, Plan, DataRamdiskBuffers, ModuleBuffers)))) {
+        DISPLAY->Panic(DISPLAY,
+                       "Failed to read the target payload or a required data ramdisk.",
+                       Status,
+                       TRUE,
+                       EFI_SECONDS_TO_MICROSECONDS(10));
+    }
+
+    /* Clear the screen. */
+    DISPLAY->ClearScreen(DISPLAY, CONFIG->Colors.Background);
+
+    /* The NFIT for every ramdisk of the chain is published all at once. Disk chains
+        commit the batch after registering their main disk, in the disk loader. */
+    RAMDISK.BeginBatch();
+
+    /* Register any data ramdisks that were specified in the chain.
         NOTE: Failure to load these is not fatal unless otherwise specified. */
     for (UINTN i = 0; i < chain->DataRamdisksLength; ++i) {
         DATA_RAMDISK *r = chain->DataRamdisks[i];
+        UINTN b = DataRamdiskBuffers[i];
+        EFI_DEVICE_PATH_PROTOCOL *RamdiskDevicePath = NULL;
+
+        if (b >= Plan->BuffersLength || EFI_ERROR(Plan->Buffers[b].Status)) continue;
+
+        if (0 != Plan->Buffers[b].ExtentsLength) {
+            EFI_RAM_DISK_REGISTER_RAMDISK_EXTENTS Register =
+                (TRUE == r->IsOverlay) ? RAMDISK.RegisterOverlay : RAMDISK.RegisterExtents;
+
+            Status = Register(Plan->Buffers[b].Extents,
+                              Plan->Buffers[b].ExtentsLength,
+                              LoaderDataRamdiskType(r),
+                              NULL,
+                              &RamdiskDevicePath);
+        } else {
+            Status = LoaderRegisterDataRamdisk(r,
+                                               Plan->Buffers[b].Base,
+                                               Plan->Buffers[b].Size,
+                                               &BufferDecrypted[b],
+                                               &RamdiskDevicePath);
+        }
+
+        if (!EFI_ERROR(Status)) LoaderTrackDataRamdisk(Context, r, &(Plan->Buffers[b]), RamdiskDevicePath);
+
+        /* The disk's contents are also a module, when they sit unaltered in one piece.
+            Overlays sharing an image hand it over once. An initrd is only loader data,
+            which the kernel would be told is free memory, so it's never a module. */
+        if (
+            !EFI_ERROR(Status)
+            && FALSE == BufferRegistered[b]
+            && 0 == Plan->Buffers[b].ExtentsLength
+            && FALSE == r->IsCompressed
+            && FALSE == r->IsSparse
+            && FALSE == r->IsInitrd
+        ) {
+            UINTN Skip = (TRUE == r->IsMFTAH) ? sizeof(mftah_payload_header_t) : 0;
+
+            LoaderAddModule(Context,
+                            (Plan->Buffers[b].Base + Skip),
+                            (Plan->Buffers[b].Size - Skip),
+                            r->Path);
+        }
 
-        Status = LoaderReadDataRamdisk(r, Context);
+        if (!EFI_ERROR(Status)) BufferRegistered[b] = TRUE;
 
         if (EFI_ERROR(Status) && TRUE == r->IsRequired) {
             DISPLAY->Panic(DISPLAY,
@@ -777,16 +1923,19 @@ LoaderEnterChain(IN UINTN SelectedChainIndex)
         }
     }
 
-    /* Clear the screen. */
-    DISPLAY->ClearScreen(DISPLAY, CONFIG->Colors.Background);
+    for (UINTN i = 0; i < chain->ModulesLength; ++i) {
+        UINTN b = ModuleBuffers[i];
 
-    /* Read the payload file from block storage. */
-    if (EFI_ERROR((Status = LoaderReadImage(Context)))) {
-        DISPLAY->Panic(DISPLAY,
-                       "Failed to read the target payload.",
-                       Status,
-                       TRUE,
-                       EFI_SECONDS_TO_MICROSECONDS(10));
+        if (b >= Plan->BuffersLength || EFI_ERROR(Plan->Buffers[b].Status)) continue;
+
+        LoaderAddModule(Context, Plan->Buffers[b].Base, Plan->Buffers[b].Size, chain->Modules[i]->CmdLine);
+    }
+
+    PlanDestroy(Plan);
+    FreePool(Plan);
+
+    if (DISK != chain->Type && EFI_ERROR((Status = RAMDISK.CommitBatch()))) {
+        EFI_DANGERLN("WARNING: Failed to publish the NFIT for the chain's data ramdisks (%u).", Status);
     }
 
     /* Check the chain's properties. This occurs in a certain order. For example,
@@ -821,7 +1970,6 @@ LoaderEnterChain(IN UINTN SelectedChainIndex)
     }
 
     if (TRUE == chain->IsCompressed) {
-        // TODO: Compression compatibility.
         /* Clear the screen. */
         DISPLAY->ClearScreen(DISPLAY, CONFIG->Colors.Background);
         ProgressStatusMessage = "Decompressing...";
@@ -843,6 +1991,7 @@ LoaderEnterChain(IN UINTN SelectedChainIndex)
         case EXE:   ExeLoader  .Load(Context); break;
         case ELF:   ElfLoader  .Load(Context); break;
         case BIN:   BinLoader  .Load(Context); break;
+        case UKI:   UkiLoader  .Load(Context); break;
         default: break;
     }
 
@@ -159,7 +159,7 @@ RepeatValidationForAlt:
                 break;
             }
 
-            p += ((MultibootInfoTagHeader *)p)->Size;
+            p += MULTIBOOT_TAG_ALIGN(((MultibootInfoTagHeader *)p)->Size);
         }
 
         if (FALSE == TagFound) return EFI_NOT_FOUND;
@@ -208,7 +208,8 @@ BuildInfoHeader(IN EFI_MULTIBOOT2_PROTOCOL *This,
         /* Skip empty tags. */
         if (0 == StartOfTag->Size) continue;
 
-        TotalSize += StartOfTag->Size;
+        /* Every tag starts on an 8-byte boundary, whatever the length of the one before it. */
+        TotalSize += MULTIBOOT_TAG_ALIGN(StartOfTag->Size);
 
         if (i != (TagsCount - 1)) continue;
 
@@ -240,7 +241,7 @@ BuildInfoHeader(IN EFI_MULTIBOOT2_PROTOCOL *This,
         CopyMem(StoreTo, TagsPointers[i], StartOfTag->Size);
         ++LoadedCount;
 
-        StoreTo = (VOID *)(((EFI_PHYSICAL_ADDRESS)StoreTo) + StartOfTag->Size);
+        StoreTo = (VOID *)(((EFI_PHYSICAL_ADDRESS)StoreTo) + MULTIBOOT_TAG_ALIGN(StartOfTag->Size));
     }
 
     /* Tie everything off. */
@@ -256,12 +257,115 @@ BuildInfoHeader(IN EFI_MULTIBOOT2_PROTOCOL *This,
 
 
 
+/* The arena lives below 4 GiB, since only the low half of its address reaches the kernel.
+    It's allocated as reserved memory so the memory map handed over with it never offers
+    the MBI itself to the kernel as free RAM. */
+STATIC
+EFI_STATUS
+EFIAPI
+CreateInfoArena(IN EFI_MULTIBOOT2_PROTOCOL *This,
+                IN UINTN Capacity,
+                OUT EFI_MULTIBOOT2_INFO_ARENA *Arena)
+{
+    if (
+        NULL == This
+        || NULL == Arena
+        || Capacity < (sizeof(MultibootInfoHeader) + sizeof(MultibootInfoTagHeader))
+    ) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_PHYSICAL_ADDRESS Base = (MULTIBOOT_INFO_ADDRESS_LIMIT - 1);
+
+    Status = BS->AllocatePages(AllocateMaxAddress,
+                               EfiReservedMemoryType,
+                               EFI_SIZE_TO_PAGES(Capacity),
+                               &Base);
+    if (EFI_ERROR(Status)) return Status;
+
+    Arena->Header = (MultibootInfoHeader *)Base;
+    Arena->Capacity = (EFI_SIZE_TO_PAGES(Capacity) * EFI_PAGE_SIZE);
+
+    Arena->Header->TotalSize = sizeof(MultibootInfoHeader);
+    Arena->Header->Reserved = 0;
+
+    return EFI_SUCCESS;
+}
+
+
+/* Tags are zeroed and returned in place. Room for the terminating tag is always kept. */
+STATIC
+VOID *
+EFIAPI
+AddInfoTag(IN EFI_MULTIBOOT2_PROTOCOL *This,
+           IN OUT EFI_MULTIBOOT2_INFO_ARENA *Arena,
+           IN UINT32 Type,
+           IN UINTN Size)
+{
+    if (
+        NULL == This
+        || NULL == Arena
+        || NULL == Arena->Header
+        || Size < sizeof(MultibootInfoTagHeader)
+    ) return NULL;
+
+    UINTN Used = Arena->Header->TotalSize;
+
+    if ((Used + MULTIBOOT_TAG_ALIGN(Size) + sizeof(MultibootInfoTagHeader)) > Arena->Capacity) return NULL;
+
+    MultibootInfoTagHeader *Tag = (MultibootInfoTagHeader *)((EFI_PHYSICAL_ADDRESS)(Arena->Header) + Used);
+    SetMem(Tag, MULTIBOOT_TAG_ALIGN(Size), 0x00);
+
+    Tag->Type = Type;
+    Tag->Size = (UINT32)Size;
+
+    Arena->Header->TotalSize = (UINT32)(Used + MULTIBOOT_TAG_ALIGN(Size));
+    return (VOID *)Tag;
+}
+
+
+STATIC
+VOID
+EFIAPI
+FinishInfoArena(IN EFI_MULTIBOOT2_PROTOCOL *This,
+                IN OUT EFI_MULTIBOOT2_INFO_ARENA *Arena)
+{
+    if (NULL == This || NULL == Arena || NULL == Arena->Header) return;
+
+    MultibootInfoTagHeader *End =
+        (MultibootInfoTagHeader *)((EFI_PHYSICAL_ADDRESS)(Arena->Header) + Arena->Header->TotalSize);
+
+    End->Type = MBI_END;
+    End->Size = sizeof(MultibootInfoTagHeader);
+
+    Arena->Header->TotalSize += sizeof(MultibootInfoTagHeader);
+}
+
+
+STATIC
+VOID
+EFIAPI
+DestroyInfoArena(IN EFI_MULTIBOOT2_PROTOCOL *This,
+                 IN OUT EFI_MULTIBOOT2_INFO_ARENA *Arena)
+{
+    if (NULL == This || NULL == Arena || NULL == Arena->Header) return;
+
+    BS->FreePages((EFI_PHYSICAL_ADDRESS)(Arena->Header), EFI_SIZE_TO_PAGES(Arena->Capacity));
+
+    Arena->Header = NULL;
+    Arena->Capacity = 0;
+}
+
+
 STATIC
 CONST EFI_MULTIBOOT2_PROTOCOL Protocol = {
     .SeekHeader                 = SeekHeader,
     .Parse                      = ParseHeader,
     .ValidateContext            = ValidateContext,
     .BuildInfoHeaderFromTags    = BuildInfoHeader,
+    .CreateInfoArena            = CreateInfoArena,
+    .AddInfoTag                 = AddInfoTag,
+    .FinishInfoArena            = FinishInfoArena,
+    .DestroyInfoArena           = DestroyInfoArena,
 };
 
 CONST EFI_MULTIBOOT2_PROTOCOL *
@@ -0,0 +1,843 @@
+#include "../include/loaders/plan.h"
+
+#include "../include/core/util.h"
+
+
+
+/* Planned buffers are never placed below this address. Low memory is left alone for
+    firmware and for the trampolines and real-mode structures of the next stage. */
+#define PLAN_LOW_MEMORY_LIMIT   (1 << 20)
+
+/* Where "high" memory begins, for buffers which prefer to stay out of the 32-bit space. */
+#define PLAN_HIGH_MEMORY_START  (1ULL << 32)
+
+/* Large-page boundaries which buffer data is aligned to, so the next stage can map
+    it with huge pages directly. Buffers smaller than a boundary are not aligned to it. */
+#define PLAN_ALIGN_1G           (1ULL << 30)
+#define PLAN_ALIGN_2M           (1ULL << 21)
+
+#define PLAN_ALIGN_UP(x, a) \
+    (((x) + ((a) - 1)) & ~((UINT64)(a) - 1))
+
+
+/* A range of conventional memory which a planned buffer may be placed into. */
+typedef
+struct {
+    EFI_PHYSICAL_ADDRESS    Start;
+    UINT64                  Pages;
+} PLAN_FREE_REGION;
+
+
+/* Progress of `PlanExecute` is reported over all files rather than per-file. Since
+    `ReadFile` only knows about the file it's reading, these offset its reports. */
+STATIC PROGRESS_UPDATE_HOOK mPlanProgressHook = NULL;
+STATIC UINTN mPlanProgressBase = 0;
+STATIC UINTN mPlanProgressTotal = 0;
+
+
+
+/* NOTE: This needs to maintain this function signature to comply
+    with the explicit MFTAH progress hook type. */
+STATIC
+VOID
+PlanProgressWrapper(IN CONST UINTN *Current,
+                    IN CONST UINTN *OutOfTotal,
+                    IN VOID *Extra)
+{
+    UINTN Overall = mPlanProgressBase + *Current;
+
+    if (NULL == mPlanProgressHook) return;
+
+    mPlanProgressHook(&Overall, &mPlanProgressTotal, Extra);
+}
+
+
+STATIC
+VOID
+PlanFailBuffer(IN LOADER_PLAN_BUFFER *Buffer,
+               IN EFI_STATUS Reason)
+{
+    Buffer->Status = Reason;
+
+    for (UINTN i = 0; i < Buffer->ExtentsLength; ++i) {
+        BS->FreePages(Buffer->Extents[i].StartingAddr, EFI_SIZE_TO_PAGES(Buffer->Extents[i].Size));
+    }
+    Buffer->ExtentsLength = 0;
+
+    if (0 != Buffer->AllocationBase) {
+        BS->FreePages(Buffer->AllocationBase, Buffer->Pages);
+        Buffer->AllocationBase = 0;
+        Buffer->Base = 0;
+    }
+}
+
+
+/* Gives back every buffer reserved before `Count`, when a later required one can't be. */
+STATIC
+VOID
+PlanReleaseBuffers(IN LOADER_PLAN *Plan,
+                   IN UINTN Count,
+                   IN EFI_STATUS Reason)
+{
+    for (UINTN i = 0; i < Count; ++i) {
+        if (EFI_ERROR(Plan->Buffers[i].Status)) continue;
+
+        PlanFailBuffer(&(Plan->Buffers[i]), Reason);
+    }
+}
+
+
+/* The unused bytes at the start of a buffer's allocation, before its file contents. */
+STATIC
+UINTN
+PlanLeadingGap(IN LOADER_PLAN_BUFFER *Buffer)
+{
+    return ((EFI_SIZE_TO_PAGES(Buffer->HeadSize) * EFI_PAGE_SIZE) - Buffer->HeadSize);
+}
+
+
+STATIC
+EFI_STATUS
+PlanGetFreeRegions(OUT PLAN_FREE_REGION **Regions,
+                   OUT UINTN *RegionsLength)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_MEMORY_MAP_META Map = {0};
+    UINTN DescriptorCount = 0;
+
+    ERRCHECK(GetMemoryMap(&Map));
+
+    DescriptorCount = (Map.MemoryMapSize / Map.DescriptorSize);
+
+    *RegionsLength = 0;
+    /* Extra room is left at the end for regions split apart by aligned placements and claims. */
+    *Regions = (PLAN_FREE_REGION *)
+        AllocateZeroPool(sizeof(PLAN_FREE_REGION)
+            * (DescriptorCount + LOADER_PLAN_MAX_BUFFERS + LOADER_PLAN_MAX_CLAIMS));
+    if (NULL == *Regions) {
+        FreePool(Map.BaseDescriptor);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINTN i = 0; i < DescriptorCount; ++i) {
+        EFI_MEMORY_DESCRIPTOR *d = (EFI_MEMORY_DESCRIPTOR *)
+            ((EFI_PHYSICAL_ADDRESS)(Map.BaseDescriptor) + (i * Map.DescriptorSize));
+
+        if (EfiConventionalMemory != d->Type || 0 == d->NumberOfPages) continue;
+
+        EFI_PHYSICAL_ADDRESS Start = d->PhysicalStart;
+        EFI_PHYSICAL_ADDRESS End = d->PhysicalStart + (d->NumberOfPages * EFI_PAGE_SIZE);
+
+        if (End <= PLAN_LOW_MEMORY_LIMIT) continue;
+        if (Start < PLAN_LOW_MEMORY_LIMIT) Start = PLAN_LOW_MEMORY_LIMIT;
+
+        (*Regions)[*RegionsLength].Start = Start;
+        (*Regions)[*RegionsLength].Pages = ((End - Start) / EFI_PAGE_SIZE);
+        ++(*RegionsLength);
+    }
+
+    FreePool(Map.BaseDescriptor);
+    return EFI_SUCCESS;
+}
+
+
+/* Best-fit: the smallest free region which can hold the buffer, so large regions
+    stay intact for the large buffers (and for whatever the next stage needs). The
+    returned address is chosen so that `Address + LeadBytes` lands on `Alignment`.
+    Low memory placements are the exception: they go as high under 4 GiB as they can. */
+STATIC
+BOOLEAN
+PlanPlaceInRegions(IN OUT PLAN_FREE_REGION *Regions,
+                   IN OUT UINTN *RegionsLength,
+                   IN UINTN Pages,
+                   IN UINTN LeadBytes,
+                   IN UINT64 Alignment,
+                   IN BOOLEAN PreferHighMemory,
+                   IN BOOLEAN PreferLowMemory,
+                   OUT EFI_PHYSICAL_ADDRESS *Address)
+{
+    PLAN_FREE_REGION *Best = NULL;
+    EFI_PHYSICAL_ADDRESS BestAddress = 0;
+    BOOLEAN FirstPass = (TRUE == PreferHighMemory || TRUE == PreferLowMemory);
+
+    /* The first pass only considers memory above (or below) 4 GiB; the second considers everything. */
+    for (UINTN Pass = (TRUE == FirstPass ? 0 : 1); Pass < 2 && NULL == Best; ++Pass) {
+        for (UINTN i = 0; i < *RegionsLength; ++i) {
+            EFI_PHYSICAL_ADDRESS Floor = Regions[i].Start;
+            EFI_PHYSICAL_ADDRESS End = Regions[i].Start + (Regions[i].Pages * EFI_PAGE_SIZE);
+            EFI_PHYSICAL_ADDRESS Candidate = 0;
+
+            if (0 == Pass && TRUE == PreferLowMemory) {
+                End = MIN(End, PLAN_HIGH_MEMORY_START);
+                if (End < (Floor + (Pages * EFI_PAGE_SIZE))) continue;
+
+                Candidate = ((End - (Pages * EFI_PAGE_SIZE) + LeadBytes) & ~(Alignment - 1)) - LeadBytes;
+                if (Candidate < Floor || Candidate > End) continue;
+
+                if (NULL == Best || Candidate > BestAddress) {
+                    Best = &(Regions[i]);
+                    BestAddress = Candidate;
+                }
+
+                continue;
+            }
+
+            if (0 == Pass) Floor = MAX(Floor, PLAN_HIGH_MEMORY_START);
+
+            Candidate = PLAN_ALIGN_UP(Floor + LeadBytes, Alignment) - LeadBytes;
+            if (Candidate < Floor || (Candidate + (Pages * EFI_PAGE_SIZE)) > End) continue;
+
+            if (NULL == Best || Regions[i].Pages < Best->Pages) {
+                Best = &(Regions[i]);
+                BestAddress = Candidate;
+            }
+        }
+    }
+
+    if (NULL == Best) return FALSE;
+
+    EFI_PHYSICAL_ADDRESS BestEnd = Best->Start + (Best->Pages * EFI_PAGE_SIZE);
+
+    /* The slack skipped in front of an aligned placement remains free for others. */
+    if (BestAddress > Best->Start) {
+        Regions[*RegionsLength].Start = Best->Start;
+        Regions[*RegionsLength].Pages = ((BestAddress - Best->Start) / EFI_PAGE_SIZE);
+        ++(*RegionsLength);
+    }
+
+    Best->Start = BestAddress + (Pages * EFI_PAGE_SIZE);
+    Best->Pages = ((BestEnd - Best->Start) / EFI_PAGE_SIZE);
+
+    *Address = BestAddress;
+    return TRUE;
+}
+
+
+/* Carves an exact range out of whichever free region holds all of it. */
+STATIC
+BOOLEAN
+PlanClaimInRegions(IN OUT PLAN_FREE_REGION *Regions,
+                   IN OUT UINTN *RegionsLength,
+                   IN EFI_PHYSICAL_ADDRESS Address,
+                   IN UINTN Pages)
+{
+    EFI_PHYSICAL_ADDRESS End = Address + (Pages * EFI_PAGE_SIZE);
+
+    for (UINTN i = 0; i < *RegionsLength; ++i) {
+        EFI_PHYSICAL_ADDRESS RegionEnd = Regions[i].Start + (Regions[i].Pages * EFI_PAGE_SIZE);
+
+        if (Address < Regions[i].Start || End > RegionEnd) continue;
+
+        /* Whatever follows the claimed range becomes a region of its own. */
+        if (End < RegionEnd) {
+            Regions[*RegionsLength].Start = End;
+            Regions[*RegionsLength].Pages = ((RegionEnd - End) / EFI_PAGE_SIZE);
+            ++(*RegionsLength);
+        }
+
+        Regions[i].Pages = ((Address - Regions[i].Start) / EFI_PAGE_SIZE);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/* Takes a range out of every free region it overlaps, whether or not all of it is free.
+    At most one region is split in two, when the range sits strictly inside of it. */
+STATIC
+VOID
+PlanCarveFromRegions(IN OUT PLAN_FREE_REGION *Regions,
+                     IN OUT UINTN *RegionsLength,
+                     IN EFI_PHYSICAL_ADDRESS Address,
+                     IN UINTN Pages)
+{
+    EFI_PHYSICAL_ADDRESS End = Address + (Pages * EFI_PAGE_SIZE);
+    UINTN Length = *RegionsLength;
+
+    for (UINTN i = 0; i < Length; ++i) {
+        EFI_PHYSICAL_ADDRESS Start = Regions[i].Start;
+        EFI_PHYSICAL_ADDRESS RegionEnd = Start + (Regions[i].Pages * EFI_PAGE_SIZE);
+
+        if (End <= Start || Address >= RegionEnd) continue;
+
+        if (End < RegionEnd && Address <= Start) {
+            Regions[i].Start = End;
+            Regions[i].Pages = ((RegionEnd - End) / EFI_PAGE_SIZE);
+            continue;
+        }
+
+        if (End < RegionEnd) {
+            Regions[*RegionsLength].Start = End;
+            Regions[*RegionsLength].Pages = ((RegionEnd - End) / EFI_PAGE_SIZE);
+            ++(*RegionsLength);
+        }
+
+        Regions[i].Pages = ((MAX(Address, Start) - Start) / EFI_PAGE_SIZE);
+    }
+}
+
+
+/* Splits a buffer across the largest free regions when none of them can hold it whole.
+    Whole pages are taken from each region, so every extent except the last is a multiple
+    of the ramdisk block size. Nothing is carved out unless enough regions are found. */
+STATIC
+BOOLEAN
+PlanScatterInRegions(IN OUT PLAN_FREE_REGION *Regions,
+                     IN UINTN RegionsLength,
+                     IN OUT LOADER_PLAN_BUFFER *Buffer)
+{
+    UINTN Chosen[LOADER_PLAN_MAX_EXTENTS] = {0};
+    UINTN ChosenLength = 0;
+    UINT64 ChosenPages = 0;
+    UINT64 PagesLeft = Buffer->Pages;
+    UINT64 BytesLeft = Buffer->Size;
+
+    while (ChosenPages < Buffer->Pages && ChosenLength < LOADER_PLAN_MAX_EXTENTS) {
+        PLAN_FREE_REGION *Largest = NULL;
+        UINTN LargestIndex = 0;
+
+        for (UINTN i = 0; i < RegionsLength; ++i) {
+            BOOLEAN Taken = FALSE;
+
+            for (UINTN c = 0; c < ChosenLength; ++c) Taken |= (Chosen[c] == i);
+            if (TRUE == Taken || 0 == Regions[i].Pages) continue;
+
+            if (NULL == Largest || Regions[i].Pages > Largest->Pages) {
+                Largest = &(Regions[i]);
+                LargestIndex = i;
+            }
+        }
+
+        if (NULL == Largest) break;
+
+        Chosen[ChosenLength] = LargestIndex;
+        ++ChosenLength;
+        ChosenPages += Largest->Pages;
+    }
+
+    if (ChosenPages < Buffer->Pages) return FALSE;
+
+    for (UINTN c = 0; c < ChosenLength; ++c) {
+        PLAN_FREE_REGION *r = &(Regions[Chosen[c]]);
+        RAMDISK_EXTENT *e = &(Buffer->Extents[c]);
+        UINT64 Take = MIN(r->Pages, PagesLeft);
+
+        e->StartingAddr = r->Start;
+        e->Size = MIN((Take * EFI_PAGE_SIZE), BytesLeft);
+        e->Offset = (Buffer->Size - BytesLeft);
+
+        r->Start += (Take * EFI_PAGE_SIZE);
+        r->Pages -= Take;
+
+        PagesLeft -= Take;
+        BytesLeft -= e->Size;
+    }
+
+    Buffer->ExtentsLength = ChosenLength;
+    return TRUE;
+}
+
+
+/* Reserves each extent of a scattered buffer at its planned address and zeroes whatever
+    part of it won't have file contents read into it. Releases everything on failure. */
+STATIC
+EFI_STATUS
+PlanAllocateExtents(IN OUT LOADER_PLAN_BUFFER *Buffer)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    for (UINTN i = 0; i < Buffer->ExtentsLength; ++i) {
+        RAMDISK_EXTENT *e = &(Buffer->Extents[i]);
+        EFI_PHYSICAL_ADDRESS Address = e->StartingAddr;
+        UINTN Pages = EFI_SIZE_TO_PAGES(e->Size);
+
+        Status = BS->AllocatePages(AllocateAddress, Buffer->MemoryType, Pages, &Address);
+        if (EFI_ERROR(Status)) {
+            for (UINTN j = 0; j < i; ++j) {
+                BS->FreePages(Buffer->Extents[j].StartingAddr, EFI_SIZE_TO_PAGES(Buffer->Extents[j].Size));
+            }
+
+            Buffer->ExtentsLength = 0;
+            return Status;
+        }
+
+        if ((e->Offset + (Pages * EFI_PAGE_SIZE)) > Buffer->DataSize) {
+            UINT64 From = MAX(e->Offset, Buffer->DataSize) - e->Offset;
+
+            SetMem((VOID *)(e->StartingAddr + From), ((Pages * EFI_PAGE_SIZE) - From), 0x00);
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+/* Reads the single file of a scattered buffer piece by piece into its extents. */
+STATIC
+EFI_STATUS
+PlanReadScattered(IN LOADER_PLAN_FILE *File,
+                  IN LOADER_PLAN_BUFFER *Buffer)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN ProgressBase = mPlanProgressBase;
+
+    for (UINTN i = 0; i < Buffer->ExtentsLength; ++i) {
+        RAMDISK_EXTENT *e = &(Buffer->Extents[i]);
+
+        if (e->Offset >= File->FileSize) break;
+
+        UINTN Length = (UINTN)MIN(e->Size, (File->FileSize - e->Offset));
+
+        Status = ReadFileRange(File->DeviceHandle,
+                               File->Path,
+                               e->Offset,
+                               Length,
+                               (VOID *)(e->StartingAddr),
+                               PlanProgressWrapper);
+        if (EFI_ERROR(Status)) break;
+
+        mPlanProgressBase += Length;
+    }
+
+    /* The caller advances the progress past the whole file. */
+    mPlanProgressBase = ProgressBase;
+    return Status;
+}
+
+
+/* Places every buffer of the given requirement class, largest first. Each buffer tries
+    the largest page boundary it is big enough for, then falls back to smaller ones. */
+STATIC
+EFI_STATUS
+PlanPlaceBuffers(IN LOADER_PLAN *Plan,
+                 IN PLAN_FREE_REGION *Regions,
+                 IN OUT UINTN *RegionsLength,
+                 IN BOOLEAN Required,
+                 OUT EFI_PHYSICAL_ADDRESS *Placements)
+{
+    BOOLEAN Placed[LOADER_PLAN_MAX_BUFFERS] = {0};
+    CONST UINT64 Alignments[] = { PLAN_ALIGN_1G, PLAN_ALIGN_2M, EFI_PAGE_SIZE };
+
+    for (UINTN n = 0; n < Plan->BuffersLength; ++n) {
+        LOADER_PLAN_BUFFER *Largest = NULL;
+        UINTN LargestIndex = 0;
+        BOOLEAN Fits = FALSE;
+
+        for (UINTN i = 0; i < Plan->BuffersLength; ++i) {
+            LOADER_PLAN_BUFFER *b = &(Plan->Buffers[i]);
+
+            if (
+                TRUE == Placed[i]
+                || 0 != Placements[i]
+                || Required != b->IsRequired
+                || EFI_ERROR(b->Status)
+            ) continue;
+
+            if (NULL == Largest || b->Pages > Largest->Pages) {
+                Largest = b;
+                LargestIndex = i;
+            }
+        }
+
+        if (NULL == Largest) break;
+        Placed[LargestIndex] = TRUE;
+
+        for (UINTN a = 0; a < (sizeof(Alignments) / sizeof(Alignments[0])) && FALSE == Fits; ++a) {
+            if (Largest->Size < Alignments[a] && EFI_PAGE_SIZE != Alignments[a]) continue;
+
+            Fits = PlanPlaceInRegions(Regions,
+                                      RegionsLength,
+                                      Largest->Pages,
+                                      (EFI_SIZE_TO_PAGES(Largest->HeadSize) * EFI_PAGE_SIZE),
+                                      Alignments[a],
+                                      Largest->PreferHighMemory,
+                                      Largest->PreferLowMemory,
+                                      &(Placements[LargestIndex]));
+        }
+
+        /* Buffers which are only ever read through a ramdisk can live in pieces instead. */
+        if (
+            FALSE == Fits
+            && TRUE == Largest->AllowScatter
+            && 0 == Largest->HeadSize
+        ) {
+            Fits = PlanScatterInRegions(Regions, *RegionsLength, Largest);
+            Placements[LargestIndex] = 0;
+        }
+
+        if (FALSE == Fits) {
+            DPRINTLN("No free region can hold planned buffer %u (%u pages).", LargestIndex, Largest->Pages);
+
+            if (TRUE == Required) return EFI_OUT_OF_RESOURCES;
+            Largest->Status = EFI_OUT_OF_RESOURCES;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+PlanAddBuffer(IN LOADER_PLAN *Plan,
+              IN EFI_MEMORY_TYPE MemoryType,
+              IN UINTN RoundToBlockSize,
+              IN UINTN ExtraEndAllocation,
+              IN BOOLEAN IsRequired,
+              OUT UINTN *BufferIndex)
+{
+    if (NULL == Plan || NULL == BufferIndex) return EFI_INVALID_PARAMETER;
+
+    if (Plan->BuffersLength >= LOADER_PLAN_MAX_BUFFERS) return EFI_OUT_OF_RESOURCES;
+
+    LOADER_PLAN_BUFFER *b = &(Plan->Buffers[Plan->BuffersLength]);
+    SetMem(b, sizeof(LOADER_PLAN_BUFFER), 0x00);
+
+    b->MemoryType = MemoryType;
+    b->RoundToBlockSize = RoundToBlockSize;
+    b->ExtraEndAllocation = ExtraEndAllocation;
+    b->IsRequired = IsRequired;
+    b->PreferHighMemory = TRUE;
+    b->Status = EFI_SUCCESS;
+
+    *BufferIndex = Plan->BuffersLength;
+    ++Plan->BuffersLength;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+PlanAddFile(IN LOADER_PLAN *Plan,
+            IN UINTN BufferIndex,
+            IN EFI_HANDLE DeviceHandle,
+            IN CHAR16 *Path)
+{
+    if (
+        NULL == Plan
+        || NULL == DeviceHandle
+        || NULL == Path
+        || BufferIndex >= Plan->BuffersLength
+    ) return EFI_INVALID_PARAMETER;
+
+    if (Plan->FilesLength >= LOADER_PLAN_MAX_FILES) return EFI_OUT_OF_RESOURCES;
+
+    LOADER_PLAN_FILE *f = &(Plan->Files[Plan->FilesLength]);
+    SetMem(f, sizeof(LOADER_PLAN_FILE), 0x00);
+
+    f->DeviceHandle = DeviceHandle;
+    f->Path = Path;
+    f->BufferIndex = BufferIndex;
+
+    ++Plan->FilesLength;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+PlanAddClaim(IN LOADER_PLAN *Plan,
+             IN EFI_PHYSICAL_ADDRESS Start,
+             IN UINTN Pages)
+{
+    if (NULL == Plan || 0 == Pages || 0 != (Start & EFI_PAGE_MASK)) return EFI_INVALID_PARAMETER;
+
+    if (Plan->ClaimsLength >= LOADER_PLAN_MAX_CLAIMS) return EFI_OUT_OF_RESOURCES;
+
+    Plan->Claims[Plan->ClaimsLength].Start = Start;
+    Plan->Claims[Plan->ClaimsLength].Pages = Pages;
+    ++Plan->ClaimsLength;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+PlanPrepare(IN LOADER_PLAN *Plan)
+{
+    if (NULL == Plan) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    PLAN_FREE_REGION *Regions = NULL;
+    UINTN RegionsLength = 0;
+    EFI_PHYSICAL_ADDRESS Placements[LOADER_PLAN_MAX_BUFFERS] = {0};
+    UINTN HeadroomPages = 0;
+    UINT64 LargestRemaining = 0;
+
+    /* Size everything first. This only touches directory entries, so it's cheap
+        compared to the reads and surfaces missing files before any allocation. */
+    for (UINTN i = 0; i < Plan->FilesLength; ++i) {
+        LOADER_PLAN_FILE *f = &(Plan->Files[i]);
+        LOADER_PLAN_BUFFER *b = &(Plan->Buffers[f->BufferIndex]);
+
+        if (EFI_ERROR(b->Status)) continue;
+
+        Status = FileSizeFromPath(f->Path, f->DeviceHandle, FALSE, &(f->FileSize));
+        if (EFI_ERROR(Status)) {
+            DPRINTLN("Planned file '%s' could not be sized (%u).", f->Path, Status);
+
+            if (TRUE == b->IsRequired) return Status;
+            PlanFailBuffer(b, Status);
+            continue;
+        }
+
+        /* Files sharing a buffer are laid out consecutively, in the order they were added. */
+        f->BufferOffset = b->DataSize;
+        b->DataSize += f->FileSize;
+    }
+
+    /* Work out the footprint of every buffer before touching the memory map. */
+    for (UINTN i = 0; i < Plan->BuffersLength; ++i) {
+        LOADER_PLAN_BUFFER *b = &(Plan->Buffers[i]);
+
+        if (EFI_ERROR(b->Status)) continue;
+
+        /* Nothing is read into a reservation, but it still needs all of its room. */
+        b->DataSize = MAX(b->DataSize, b->ReserveSize);
+
+        if (0 == b->DataSize) {
+            if (TRUE == b->IsRequired) return EFI_END_OF_FILE;
+            PlanFailBuffer(b, EFI_END_OF_FILE);
+            continue;
+        }
+
+        if (0 != b->RoundToBlockSize) {
+            /* Round the buffer up to the requested block size. */
+            b->Size = ((b->DataSize + b->RoundToBlockSize - 1) / b->RoundToBlockSize) * b->RoundToBlockSize;
+        } else {
+            b->Size = b->DataSize;
+        }
+
+        b->Size += b->ExtraEndAllocation;
+
+        /* The allocation begins with however much of the header doesn't fit in whole pages,
+            so that the header ends (and the data begins) exactly on a page boundary. */
+        b->Pages = EFI_SIZE_TO_PAGES(PlanLeadingGap(b) + b->Size);
+    }
+
+    /* Place the whole chain against the memory map before allocating anything. If it
+        doesn't fit, the chain is rejected without having read or reserved a single byte. */
+    ERRCHECK(PlanGetFreeRegions(&Regions, &RegionsLength));
+
+    /* Claimed ranges are allocated by the loader itself, at exactly those addresses, after
+        the plan is done. Anything placed over them would make those allocations fail. */
+    for (UINTN i = 0; i < Plan->ClaimsLength; ++i) {
+        PlanCarveFromRegions(Regions, &RegionsLength, Plan->Claims[i].Start, Plan->Claims[i].Pages);
+    }
+
+    /* Fixed buffers go first, before anything else can be placed over their address. One
+        that lands where it asked needs no working copy: it's already where it belongs. */
+    for (UINTN i = 0; i < Plan->BuffersLength; ++i) {
+        LOADER_PLAN_BUFFER *b = &(Plan->Buffers[i]);
+
+        if (EFI_ERROR(b->Status) || 0 == b->FixedBase) continue;
+
+        /* Any header sits in the pages just below the fixed address, so that the data
+            following it (decrypted in place) starts right there. */
+        UINTN HeadBytes = EFI_SIZE_TO_PAGES(b->HeadSize) * EFI_PAGE_SIZE;
+
+        if (
+            b->FixedBase >= HeadBytes
+            && TRUE == PlanClaimInRegions(Regions, &RegionsLength, (b->FixedBase - HeadBytes), b->Pages)
+        ) {
+            Placements[i] = (b->FixedBase - HeadBytes);
+            b->NeedsWorkingCopy = FALSE;
+            continue;
+        }
+
+        DPRINTLN("Planned buffer %u can't be placed at its fixed address %p.", i, (VOID *)b->FixedBase);
+        b->FixedBase = 0;
+    }
+
+    for (UINTN i = 0; i < Plan->BuffersLength; ++i) {
+        LOADER_PLAN_BUFFER *b = &(Plan->Buffers[i]);
+
+        if (EFI_ERROR(b->Status) || FALSE == b->NeedsWorkingCopy) continue;
+
+        HeadroomPages = MAX(HeadroomPages, EFI_SIZE_TO_PAGES(b->DataSize));
+    }
+
+    Status = PlanPlaceBuffers(Plan, Regions, &RegionsLength, TRUE, Placements);
+    if (EFI_ERROR(Status)) goto PlanPrepare__Exit;
+
+    /* Whatever consumes the loaded payload later needs its own contiguous space too. */
+    for (UINTN i = 0; i < RegionsLength; ++i) LargestRemaining = MAX(LargestRemaining, Regions[i].Pages);
+
+    if (LargestRemaining < HeadroomPages) {
+        DPRINTLN("Not enough working memory would remain after loading (%u of %u pages).",
+                 LargestRemaining, HeadroomPages);
+        Status = EFI_OUT_OF_RESOURCES;
+        goto PlanPrepare__Exit;
+    }
+
+    /* Optional buffers only get what the required ones (and their working space) leave behind. */
+    for (UINTN i = 0; i < RegionsLength; ++i) {
+        if (Regions[i].Pages == LargestRemaining) {
+            Regions[i].Pages -= HeadroomPages;
+            Regions[i].Start += (HeadroomPages * EFI_PAGE_SIZE);
+            break;
+        }
+    }
+
+    Status = PlanPlaceBuffers(Plan, Regions, &RegionsLength, FALSE, Placements);
+    if (EFI_ERROR(Status)) goto PlanPrepare__Exit;
+
+    /* Now reserve every buffer, so a chain cannot fail on allocation halfway through reading. */
+    for (UINTN i = 0; i < Plan->BuffersLength; ++i) {
+        LOADER_PLAN_BUFFER *b = &(Plan->Buffers[i]);
+
+        if (EFI_ERROR(b->Status)) continue;
+
+        if (0 != b->ExtentsLength) {
+            Status = PlanAllocateExtents(b);
+            if (EFI_ERROR(Status)) {
+                if (TRUE == b->IsRequired) {
+                    PlanReleaseBuffers(Plan, i, Status);
+                    goto PlanPrepare__Exit;
+                }
+
+                PlanFailBuffer(b, Status);
+                continue;
+            }
+
+            DPRINTLN("Planned buffer %u: %u bytes across %u extents.", i, b->Size, b->ExtentsLength);
+            continue;
+        }
+
+        /* The memory map can shift slightly between planning and now (pool allocations
+            and so on), in which case the firmware is asked to place the buffer instead.
+            That loses the large-page alignment, but the header still ends on a page. */
+        b->AllocationBase = Placements[i];
+        Status = BS->AllocatePages(AllocateAddress, b->MemoryType, b->Pages, &(b->AllocationBase));
+        if (EFI_ERROR(Status)) {
+            b->FixedBase = 0;
+            Status = BS->AllocatePages(AllocateAnyPages, b->MemoryType, b->Pages, &(b->AllocationBase));
+        }
+
+        if (EFI_ERROR(Status) || 0 == b->AllocationBase) {
+            if (EFI_SUCCESS == Status) Status = EFI_OUT_OF_RESOURCES;
+            b->AllocationBase = 0;
+
+            if (TRUE == b->IsRequired) {
+                PlanReleaseBuffers(Plan, i, Status);
+                goto PlanPrepare__Exit;
+            }
+
+            PlanFailBuffer(b, Status);
+            continue;
+        }
+
+        b->Base = b->AllocationBase + PlanLeadingGap(b);
+
+        /* Ensure the trailing padding (which won't have a file read into it) is explicitly set to zero. */
+        EFI_PHYSICAL_ADDRESS AllocationEnd = b->AllocationBase + (b->Pages * EFI_PAGE_SIZE);
+        if (AllocationEnd > (b->Base + b->DataSize)) {
+            SetMem((VOID *)(b->Base + b->DataSize), (AllocationEnd - (b->Base + b->DataSize)), 0x00);
+        }
+
+        DPRINTLN("Planned buffer %u: %u bytes at %p.", i, b->Size, b->Base);
+    }
+
+    Status = EFI_SUCCESS;
+
+PlanPrepare__Exit:
+    FreePool(Regions);
+    return Status;
+}
+
+
+EFI_STATUS
+EFIAPI
+PlanExecute(IN LOADER_PLAN *Plan,
+            IN PROGRESS_UPDATE_HOOK ProgressHook OPTIONAL)
+{
+    if (NULL == Plan) return EFI_INVALID_PARAMETER;
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    BOOLEAN Issued[LOADER_PLAN_MAX_FILES] = {0};
+    UINTN Unused = 0;
+
+    mPlanProgressHook = ProgressHook;
+    mPlanProgressBase = 0;
+    mPlanProgressTotal = 0;
+
+    for (UINTN i = 0; i < Plan->FilesLength; ++i) {
+        if (EFI_ERROR(Plan->Buffers[Plan->Files[i].BufferIndex].Status)) continue;
+        mPlanProgressTotal += Plan->Files[i].FileSize;
+    }
+
+    /* Each outer iteration picks up the next device which hasn't been read from yet, and
+        the inner loop drains every file on that device before switching. This keeps a
+        single device busy with back-to-back reads rather than alternating between media.
+        NOTE: The SFS protocol doesn't expose where a file physically resides, so files
+        on the same device are read in the order they were planned. */
+    for (UINTN i = 0; i < Plan->FilesLength; ++i) {
+        if (TRUE == Issued[i]) continue;
+
+        EFI_HANDLE CurrentDevice = Plan->Files[i].DeviceHandle;
+
+        for (UINTN j = i; j < Plan->FilesLength; ++j) {
+            LOADER_PLAN_FILE *f = &(Plan->Files[j]);
+            LOADER_PLAN_BUFFER *b = &(Plan->Buffers[f->BufferIndex]);
+
+            if (TRUE == Issued[j] || CurrentDevice != f->DeviceHandle) continue;
+            Issued[j] = TRUE;
+
+            if (EFI_ERROR(b->Status)) continue;
+
+            UINT8 *Destination = (UINT8 *)(b->Base + f->BufferOffset);
+
+            if (0 != b->ExtentsLength) {
+                Status = PlanReadScattered(f, b);
+            } else {
+                Status = ReadFile(f->DeviceHandle,
+                                  f->Path,
+                                  0U,
+                                  &Destination,
+                                  &Unused,
+                                  FALSE,
+                                  b->MemoryType,
+                                  0,
+                                  0,
+                                  PlanProgressWrapper);
+            }
+            if (EFI_ERROR(Status)) {
+                DPRINTLN("Planned file '%s' could not be read (%u).", f->Path, Status);
+
+                if (TRUE == b->IsRequired) goto PlanExecute__Exit;
+                PlanFailBuffer(b, Status);
+            }
+
+            mPlanProgressBase += f->FileSize;
+        }
+    }
+
+    Status = EFI_SUCCESS;
+
+PlanExecute__Exit:
+    mPlanProgressHook = NULL;
+    return Status;
+}
+
+
+VOID
+EFIAPI
+PlanDestroy(IN LOADER_PLAN *Plan)
+{
+    if (NULL == Plan) return;
+
+    for (UINTN i = 0; i < Plan->FilesLength; ++i) {
+        if (NULL != Plan->Files[i].Path) FreePool(Plan->Files[i].Path);
+        Plan->Files[i].Path = NULL;
+    }
+
+    for (UINTN i = 0; i < Plan->BuffersLength; ++i) {
+        if (EFI_ERROR(Plan->Buffers[i].Status)) PlanFailBuffer(&(Plan->Buffers[i]), Plan->Buffers[i].Status);
+    }
+
+    Plan->FilesLength = 0;
+}
@@ -0,0 +1,170 @@
+#include "../include/loaders/uki.h"
+#include "../include/loaders/exe.h"
+
+#include "../include/drivers/displays.h"
+#include "../include/drivers/initrd.h"
+
+
+
+/* Only the few PE/COFF fields needed to walk the section table. */
+#define UKI_DOS_SIGNATURE       0x5A4D       /* "MZ" */
+#define UKI_PE_SIGNATURE        0x00004550   /* "PE\0\0" */
+
+#pragma pack(push, 1)
+typedef
+struct __attribute__((packed)) {
+    UINT32  Signature;
+    UINT16  Machine;
+    UINT16  NumberOfSections;
+    UINT32  TimeDateStamp;
+    UINT32  PointerToSymbolTable;
+    UINT32  NumberOfSymbols;
+    UINT16  SizeOfOptionalHeader;
+    UINT16  Characteristics;
+} UKI_PE_HEADER;
+
+typedef
+struct __attribute__((packed)) {
+    CHAR8   Name[8];
+    UINT32  VirtualSize;
+    UINT32  VirtualAddress;
+    UINT32  SizeOfRawData;
+    UINT32  PointerToRawData;
+    UINT32  PointerToRelocations;
+    UINT32  PointerToLinenumbers;
+    UINT16  NumberOfRelocations;
+    UINT16  NumberOfLinenumbers;
+    UINT32  Characteristics;
+} UKI_SECTION_HEADER;
+#pragma pack(pop)
+
+/* Offset of the PE header's offset within the DOS header. */
+#define UKI_DOS_LFANEW_OFFSET   0x3C
+
+
+/* Finds a section's contents within the flat (file layout) image. A section's virtual size
+    is its exact length, while its raw data is padded out to the file alignment. */
+STATIC
+EFI_STATUS
+UkiFindSection(IN CONST UINT8 *Image,
+               IN UINTN ImageSize,
+               IN CONST CHAR8 *Name,
+               OUT CONST UINT8 **Section,
+               OUT UINTN *SectionSize)
+{
+    UINT32 PeOffset = 0;
+    UKI_PE_HEADER *Pe = NULL;
+    UKI_SECTION_HEADER *Sections = NULL;
+    UINTN SectionsOffset = 0;
+    UINTN NameLength = AsciiStrLen(Name);
+
+    if (ImageSize < (UKI_DOS_LFANEW_OFFSET + sizeof(UINT32))) return EFI_LOAD_ERROR;
+    if (UKI_DOS_SIGNATURE != *((UINT16 *)Image)) return EFI_LOAD_ERROR;
+
+    PeOffset = *((UINT32 *)&(Image[UKI_DOS_LFANEW_OFFSET]));
+    if ((UINT64)PeOffset + sizeof(UKI_PE_HEADER) > ImageSize) return EFI_LOAD_ERROR;
+
+    Pe = (UKI_PE_HEADER *)&(Image[PeOffset]);
+    if (UKI_PE_SIGNATURE != Pe->Signature) return EFI_LOAD_ERROR;
+
+    SectionsOffset = PeOffset + sizeof(UKI_PE_HEADER) + Pe->SizeOfOptionalHeader;
+    if (SectionsOffset + (Pe->NumberOfSections * sizeof(UKI_SECTION_HEADER)) > ImageSize) {
+        return EFI_LOAD_ERROR;
+    }
+
+    Sections = (UKI_SECTION_HEADER *)&(Image[SectionsOffset]);
+
+    for (UINTN i = 0; i < Pe->NumberOfSections; ++i) {
+        UKI_SECTION_HEADER *s = &(Sections[i]);
+        UINTN Size = s->SizeOfRawData;
+
+        /* Names shorter than 8 characters are NUL-padded. */
+        if (
+            0 != CompareMem(s->Name, Name, NameLength)
+            || (NameLength < sizeof(s->Name) && '\0' != s->Name[NameLength])
+        ) continue;
+
+        if (0 != s->VirtualSize) Size = MIN(Size, (UINTN)s->VirtualSize);
+
+        if ((UINT64)s->PointerToRawData + Size > ImageSize) return EFI_LOAD_ERROR;
+
+        *Section = &(Image[s->PointerToRawData]);
+        *SectionSize = Size;
+
+        return EFI_SUCCESS;
+    }
+
+    return EFI_NOT_FOUND;
+}
+
+
+STATIC
+EFIAPI
+VOID
+LoadImage(IN LOADER_CONTEXT *Context)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    CONST UINT8 *Image = (CONST UINT8 *)Context->LoadedImageBase;
+    UINTN ImageSize = Context->LoadedImageSize;
+    CONST UINT8 *Kernel = NULL, *Initrd = NULL, *CmdLine = NULL;
+    UINTN KernelSize = 0, InitrdSize = 0, CmdLineSize = 0;
+
+    Status = UkiFindSection(Image, ImageSize, UKI_SECTION_LINUX, &Kernel, &KernelSize);
+    if (EFI_ERROR(Status) || 0 == KernelSize) {
+        DISPLAY->Panic(DISPLAY,
+                       "The payload is not a unified kernel image with a '.linux' section.",
+                       (EFI_SUCCESS == Status ? EFI_LOAD_ERROR : Status),
+                       TRUE,
+                       EFI_SECONDS_TO_MICROSECONDS(10));
+        HALT;
+    }
+
+    /* The embedded command line only applies when the chain doesn't set its own. */
+    if (
+        NULL == Context->Chain->CmdLine
+        && !EFI_ERROR(UkiFindSection(Image, ImageSize, UKI_SECTION_CMDLINE, &CmdLine, &CmdLineSize))
+        && 0 != CmdLineSize
+    ) {
+        /* Trailing NULs and newlines aren't part of the command line. */
+        while (CmdLineSize > 0 && ('\0' == CmdLine[CmdLineSize - 1] || '\n' == CmdLine[CmdLineSize - 1])) {
+            --CmdLineSize;
+        }
+
+        if (CmdLineSize > 0) {
+            Context->Chain->CmdLine = (CHAR8 *)AllocateZeroPool(CmdLineSize + 1);
+            if (NULL == Context->Chain->CmdLine) {
+                EFI_WARNINGLN("No memory to copy the UKI's command line. Booting without it.");
+            } else {
+                CopyMem(Context->Chain->CmdLine, CmdLine, CmdLineSize);
+            }
+        }
+    }
+
+    /* The initrd is served to the kernel's stub straight from where it sits in the image,
+        so the image must outlive the handoff instead of being retired with the kernel. */
+    if (
+        !EFI_ERROR(UkiFindSection(Image, ImageSize, UKI_SECTION_INITRD, &Initrd, &InitrdSize))
+        && 0 != InitrdSize
+    ) {
+        Status = InitrdInstall(Initrd, InitrdSize);
+        if (EFI_ALREADY_STARTED == Status) {
+            EFI_WARNINGLN("Another initrd is already being served. The UKI's own is ignored.");
+        } else if (EFI_ERROR(Status)) {
+            EFI_WARNINGLN("Could not serve the UKI's initrd (%u). Booting without it.", Status);
+        } else {
+            SetMem(&(Context->LoadedImageAllocation), sizeof(LOADER_STAGING_BUFFER), 0x00);
+        }
+    }
+
+    DPRINTLN("UKI kernel at '%p' (%u bytes), initrd at '%p' (%u bytes).",
+             (VOID *)Kernel, KernelSize, (VOID *)Initrd, InitrdSize);
+
+    /* From here on, the kernel section is chainloaded like any other EFI binary. */
+    Context->LoadedImageBase = (EFI_PHYSICAL_ADDRESS)Kernel;
+    Context->LoadedImageSize = KernelSize;
+
+    ExeLoader.Load(Context);
+}
+
+
+EFI_EXECUTABLE_LOADER UkiLoader = { .Load = LoadImage };